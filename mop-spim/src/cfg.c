@@ -15,7 +15,7 @@
 
 static bb_node_t *bb_dummy_new(cfg_context_t *ctx)
 {
-	bb_node_t *bb = calloc(1, sizeof(*bb));
+	bb_node_t *bb = mem_alloc(sizeof(*bb));
 
 	bb->is_dummy = true;
 	bb->has_condition = false;
@@ -27,7 +27,7 @@ static bb_node_t *bb_dummy_new(cfg_context_t *ctx)
 
 static bb_node_t *bb_new(cfg_context_t *ctx)
 {
-	bb_node_t *bb = calloc(1, sizeof(*bb));
+	bb_node_t *bb = mem_alloc(sizeof(*bb));
 
 	bb->is_dummy = false;
 	bb->has_condition = false;
@@ -47,7 +47,7 @@ static void promote_bb(bb_node_t *bb)
 
 static inst_t *inst_new(void)
 {
-	return calloc(1, sizeof(inst_t));
+	return mem_alloc(sizeof(inst_t));
 }
 
 static bool is_simple_identifier(expr_t *ex)
@@ -68,13 +68,12 @@ static char *get_identifier(expr_t *ex)
 	return "(nil)";
 }
 
-static char *get_next_temp_id(void)
+char *get_next_temp_id(cfg_context_t *cfg)
 {
-	static int n = 0;
 	char buf[32];
 
-	snprintf(buf, 32, "_t%d", n++);
-	return strdup(buf);
+	snprintf(buf, 32, "_t%u", cfg->temp_count++);
+	return mem_strdup(buf);
 }
 
 /* this one strings together all consecutive
@@ -96,7 +95,7 @@ static bb_node_t* print_to_cfg(stmt_t*, cfg_context_t*, bb_node_t *entry);
 /* some helpers */
 static bool result_is_reference(inst_t *i);
 static inst_op_t *get_result_op(inst_t *i);
-static char *load_result(list_t *is, inst_t *tgt);
+static char *load_result(cfg_context_t *cfg, list_t *is, inst_t *tgt);
 
 /* convert an expression to a list of
  * three addr instructions. if var name
@@ -110,13 +109,12 @@ static void remove_dummy_blocks(cfg_context_t *cfg);
 
 /* labels every basic block with an integer value
  * and creates lists of parent nodes for each */
-static void update_metadata(cfg_context_t *cfg);
 
 cfg_context_t* func_to_cfg(func_t *f)
 {
 	cfg_context_t *cfg;
 
-	cfg = calloc(1, sizeof(*cfg));
+	cfg = mem_alloc(sizeof(*cfg));
 	cfg->fn = f;
 
 	cfg->all_bb = list_new();
@@ -160,7 +158,7 @@ static bb_node_t* if_to_cfg(stmt_t *stmt, cfg_context_t *cfg, bb_node_t *entry)
 
 	test_i->type = I_IF;
 	test_i->cond.is_val = false;
-	test_i->cond.id = get_next_temp_id();
+	test_i->cond.id = get_next_temp_id(cfg);
 
 	entry->has_condition = true;
 	promote_bb(entry);
@@ -187,9 +185,10 @@ static bb_node_t* while_to_cfg(stmt_t *stmt, cfg_context_t *cfg, bb_node_t *entr
 
 	test_i->type = I_IF;
 	test_i->cond.is_val = false;
-	test_i->cond.id = get_next_temp_id();
+	test_i->cond.id = get_next_temp_id(cfg);
 
 	test->has_condition = true;
+	test->is_while = true;
 	test->instructions = list_new();
 	test->tb = bb_new(cfg);
 
@@ -224,7 +223,7 @@ static bb_node_t* assign_to_cfg(stmt_t *stmt, cfg_context_t *cfg, bb_node_t *ent
 			l = inst_new();
 			l->type = I_LOAD;
 			l->m.src.is_val = false;
-			l->m.src.id = get_next_temp_id();
+			l->m.src.id = get_next_temp_id(cfg);
 			l->m.dst.is_val = false;
 			l->m.dst.id = op->id;
 			op->id = l->m.src.id;
@@ -232,11 +231,11 @@ static bb_node_t* assign_to_cfg(stmt_t *stmt, cfg_context_t *cfg, bb_node_t *ent
 		}
 
 	} else {
-		tr = get_next_temp_id();
+		tr = get_next_temp_id(cfg);
 		r = expr_to_tac(cfg, entry->instructions,
 		                stmt->assign.rhs, tr);
 
-		char *p = load_result(entry->instructions, r);
+		char *p = load_result(cfg, entry->instructions, r);
 		if (p != NULL)
 			tr = p;
 
@@ -246,7 +245,7 @@ static bb_node_t* assign_to_cfg(stmt_t *stmt, cfg_context_t *cfg, bb_node_t *ent
 
 		} else if (stmt->assign.lhs->op == OP_SYMBOL &&
 		           stmt->assign.lhs->sym->tag == SYM_FIELD) {
-			tl = get_next_temp_id();
+			tl = get_next_temp_id(cfg);
 
 			l = inst_new();
 			l->type = I_ATTRIBUTE;
@@ -261,7 +260,7 @@ static bb_node_t* assign_to_cfg(stmt_t *stmt, cfg_context_t *cfg, bb_node_t *ent
 			list_append(entry->instructions, l);
 
 		} else {
-			tl = get_next_temp_id();
+			tl = get_next_temp_id(cfg);
 			l = expr_to_tac(cfg, entry->instructions,
 			                stmt->assign.lhs, tl);
 
@@ -290,9 +289,9 @@ static bb_node_t* print_to_cfg(stmt_t *stmt, cfg_context_t *cfg, bb_node_t *entr
 
 	promote_bb(entry);
 
-	to = get_next_temp_id();
+	to = get_next_temp_id(cfg);
 	r = expr_to_tac(cfg, entry->instructions, stmt->print, to);
-	p = load_result(entry->instructions, r);
+	p = load_result(cfg, entry->instructions, r);
 	if (p != NULL)
 		to = p;
 
@@ -413,7 +412,7 @@ static inst_op_t *get_result_op(inst_t *i)
 	}
 }
 
-static char *load_result(list_t *is, inst_t *tgt)
+static char *load_result(cfg_context_t *cfg, list_t *is, inst_t *tgt)
 {
 	inst_t *i;
 	inst_op_t *op;
@@ -431,11 +430,11 @@ static char *load_result(list_t *is, inst_t *tgt)
 	i->type = I_LOAD;
 	i->m.dst.is_val = i->m.src.is_val = false;
 	i->m.src.id = op->id;
-	i->m.dst.id = get_next_temp_id();
+	i->m.dst.id = get_next_temp_id(cfg);
 
 	list_append(is, i);
 
-	return strdup(i->m.dst.id);
+	return mem_strdup(i->m.dst.id);
 }
 
 static void expr_op_to_tac(cfg_context_t *cfg, list_t *is, expr_t *ex, inst_op_t *op, bool load)
@@ -451,9 +450,9 @@ static void expr_op_to_tac(cfg_context_t *cfg, list_t *is, expr_t *ex, inst_op_t
 		op->id = get_identifier(ex);
 	} else {
 		op->is_val = false;
-		op->id = get_next_temp_id();
+		op->id = get_next_temp_id(cfg);
 		res = expr_to_tac(cfg, is, ex, op->id);
-		if (load && (p = load_result(is, res)) != NULL)
+		if (load && (p = load_result(cfg, is, res)) != NULL)
 			op->id = p;
 	}
 }
@@ -660,9 +659,9 @@ static inst_t *expr_to_tac(cfg_context_t *cfg, list_t *is, expr_t *e, char *vnam
 			sym = e->apply.fn->sym;
 
 		} else if (e->apply.fn->op == OP_ATTRIBUTE) {
-			this_id = get_next_temp_id();
+			this_id = get_next_temp_id(cfg);
 			res = expr_to_tac(cfg, is, e->apply.fn->ops[0], this_id);
-			if ((p = load_result(is, res)) != NULL)
+			if ((p = load_result(cfg, is, res)) != NULL)
 				this_id = p;
 
 			if (e->apply.fn->ops[1]->op != OP_SYMBOL) {
@@ -682,7 +681,7 @@ static inst_t *expr_to_tac(cfg_context_t *cfg, list_t *is, expr_t *e, char *vnam
 		i->c.fn = sym->fn;
 
 		/* build arguments list */
-		op = calloc(1, sizeof(*op));
+		op = mem_alloc(sizeof(*op));
 		op->is_val = false;
 		op->id = this_id;
 		list_append(i->c.args, op);
@@ -691,7 +690,7 @@ static inst_t *expr_to_tac(cfg_context_t *cfg, list_t *is, expr_t *e, char *vnam
 		LIST_EACH(e->apply.args, n, ex) {
 			symbol_t *sym = argn->v;
 
-			op = calloc(1, sizeof(*op));
+			op = mem_alloc(sizeof(*op));
 			expr_op_to_tac(cfg, is, ex, op,
 			               sym->tag != SYM_REF_PARAMETER);
 			list_append(i->c.args, op);
@@ -730,7 +729,7 @@ static inst_t *expr_to_tac(cfg_context_t *cfg, list_t *is, expr_t *e, char *vnam
 		i2->c.fn = e->t->cls->ctor;
 
 		/* build arguments list */
-		op = calloc(1, sizeof(*op));
+		op = mem_alloc(sizeof(*op));
 		op->is_val = false;
 		op->id = vname;
 		list_append(i2->c.args, op);
@@ -739,7 +738,7 @@ static inst_t *expr_to_tac(cfg_context_t *cfg, list_t *is, expr_t *e, char *vnam
 		LIST_EACH(e->apply.args, n, ex) {
 			symbol_t *sym = argn->v;
 
-			op = calloc(1, sizeof(*op));
+			op = mem_alloc(sizeof(*op));
 			expr_op_to_tac(cfg, is, ex, op,
 			               sym->tag != SYM_REF_PARAMETER);
 			list_append(i2->c.args, op);
@@ -819,12 +818,12 @@ static void remove_dummy_blocks(cfg_context_t *cfg)
 		/* if all references gone, free the node */
 		if (bb->label <= 0) {
 			list_delete(cfg->all_bb, bb->n);
-			free(bb);
+			mem_free(bb);
 		}
 	}
 }
 
-static void update_metadata(cfg_context_t *cfg)
+void update_metadata(cfg_context_t *cfg)
 {
 	list_node_t *cur;
 	bb_node_t *bb;
@@ -856,7 +855,7 @@ static void dump_inst_op_to_str(inst_op_t *op, char *buf, int n)
 	}
 }
 
-static void dump_inst(bb_node_t *bb, inst_t *i)
+static void dump_inst(FILE *out, bb_node_t *bb, inst_t *i)
 {
 	char b0[512], b1[512], b2[512];
 	list_node_t *n;
@@ -870,22 +869,22 @@ static void dump_inst(bb_node_t *bb, inst_t *i)
 		switch (i->a.op) {
 		case OP_IDENTIFIER:
 		case OP_INTEGER_CONSTANT:
-			fprintf(stderr, "    %s <- %s\n", b0, b1);
+			fprintf(out, "    %s <- %s\n", b0, b1);
 			break;
 
 		case OP_NOT:
-			fprintf(stderr, "    %s <- NOT %s\n", b0, b1);
+			fprintf(out, "    %s <- NOT %s\n", b0, b1);
 			break;
 
 		case OP_INDEX:
 			dump_inst_op_to_str(&i->a.r[1],  b2, 512);
-			fprintf(stderr, "    %s <- &%s[%s] (%s)\n",
+			fprintf(out, "    %s <- &%s[%s] (%s)\n",
 			        b0, b1, b2, type_to_name(i->a.t));
 			break;
 
 		default:
 			dump_inst_op_to_str(&i->a.r[1],  b2, 512);
-			fprintf(stderr, "    %s <- %s %2s %s\n", b0, b1,
+			fprintf(out, "    %s <- %s %2s %s\n", b0, b1,
 			       expr_op_to_glyph[i->a.op], b2);
 			break;
 		}
@@ -893,50 +892,50 @@ static void dump_inst(bb_node_t *bb, inst_t *i)
 
 	case I_IF:
 		dump_inst_op_to_str(&i->cond, b1, 512);
-		fprintf(stderr, "    test %s\n", b1);
+		fprintf(out, "    test %s\n", b1);
 		break;
 
 	case I_ATTRIBUTE:
 		dump_inst_op_to_str(&i->a.l,     b0, 512);
 		dump_inst_op_to_str(&i->a.r[0],  b1, 512);
 		dump_inst_op_to_str(&i->a.r[1],  b2, 512);
-		fprintf(stderr, "    %s <- &%s->%s\n", b0, b1, b2);
+		fprintf(out, "    %s <- &%s->%s\n", b0, b1, b2);
 		break;
 
 	case I_LOAD:
 		dump_inst_op_to_str(&i->m.dst, b0, 512);
 		dump_inst_op_to_str(&i->m.src, b1, 512);
-		fprintf(stderr, "    %s <- *%s\n", b0, b1);
+		fprintf(out, "    %s <- *%s\n", b0, b1);
 		break;
 
 	case I_STORE:
 		dump_inst_op_to_str(&i->m.dst, b0, 512);
 		dump_inst_op_to_str(&i->m.src, b1, 512);
-		fprintf(stderr, "    %s -> *%s\n", b1, b0);
+		fprintf(out, "    %s -> *%s\n", b1, b0);
 		break;
 
 	case I_CALL:
 		dump_inst_op_to_str(&i->c.ret, b0, 512);
-		fprintf(stderr, "    %s <- \x1b[1;32m%s\x1b[0m(",
+		fprintf(out, "    %s <- \x1b[1;32m%s\x1b[0m(",
 		        b0, i->c.fn->name);
 		comma = false;
 		LIST_EACH(i->c.args, n, arg) {
 			dump_inst_op_to_str(arg, b0, 512);
-			fprintf(stderr, "%s%s", comma ? ", " : "", b0);
+			fprintf(out, "%s%s", comma ? ", " : "", b0);
 			comma = true;
 		}
-		fprintf(stderr, ")\n");
+		fprintf(out, ")\n");
 		break;
 
 	case I_ALLOC:
 		dump_inst_op_to_str(&i->alloc.dst, b0, 512);
-		fprintf(stderr, "    %s <- \x1b[1;32mnew %s\x1b[0m\n",
+		fprintf(out, "    %s <- \x1b[1;32mnew %s\x1b[0m\n",
 		        b0, type_to_name(i->alloc.t));
 		break;
 
 	case I_PRINT:
 		dump_inst_op_to_str(&i->a.r[0], b0, 512);
-		fprintf(stderr, "    print %s\n", b0);
+		fprintf(out, "    print %s\n", b0);
 		break;
 	}
 }
@@ -1028,7 +1027,7 @@ static void dump_add_variables(bb_node_t *bb, list_t *vs)
 	}
 }
 
-__unused static void dump_variables_pretty(cfg_context_t *cfg)
+__unused static void dump_variables_pretty(FILE *out, cfg_context_t *cfg)
 {
 	list_node_t *cur;
 	list_t *variables;
@@ -1041,46 +1040,46 @@ __unused static void dump_variables_pretty(cfg_context_t *cfg)
 	LIST_EACH(cfg->all_bb, cur, bb)
 		dump_add_variables(bb, variables);
 
-	fprintf(stderr, "  \x1b[1mvariables:\x1b[0m");
+	fprintf(out, "  \x1b[1mvariables:\x1b[0m");
 	i = -1;
 	nth = 0;
 	LIST_EACH(variables, cur, id) {
 		if (nth != 0)
-			fprintf(stderr, ", ");
+			fprintf(out, ", ");
 		if (i < 0 || i + strlen(id) > 40) {
-			fprintf(stderr, "\n    ");
+			fprintf(out, "\n    ");
 			i = 0;
 		}
-		fprintf(stderr, "%s%s\x1b[0m",
+		fprintf(out, "%s%s\x1b[0m",
 		        id[0] == '_' ? "\x1b[34m" : "\x1b[1;36m", id);
 		i += strlen(id) + (i == 0 ? 0 : 2);
 		nth++;
 	}
-	fprintf(stderr, "\n");
+	fprintf(out, "\n");
 }
 
-static void dump_bb(cfg_context_t *cfg, bb_node_t *bb)
+static void dump_bb(FILE *out, cfg_context_t *cfg, bb_node_t *bb)
 {
 	list_node_t *cur;
 	inst_t *i;
 
-	fprintf(stderr, "  \x1b[1mblock #%d:\x1b[0m\n", bb->label);
+	fprintf(out, "  \x1b[1mblock #%d:\x1b[0m\n", bb->label);
 
 	if (is_dummy(bb)) {
-		fprintf(stderr, "    (dummy)\n");
+		fprintf(out, "    (dummy)\n");
 	} else {
 		LIST_EACH(bb->instructions, cur, i)
-			dump_inst(bb, i);
+			dump_inst(out, bb, i);
 	}
 
 	if (bb->fb)
-		fprintf(stderr, "    goto #%d, if false\n", bb->fb->label);
+		fprintf(out, "    goto #%d, if false\n", bb->fb->label);
 
 	if (bb->tb)
-		fprintf(stderr, "    goto #%d\n", bb->tb->label);
+		fprintf(out, "    goto #%d\n", bb->tb->label);
 }
 
-void dump_cfg(cfg_context_t *cfg)
+void dump_cfg(cfg_context_t *cfg, FILE *out)
 {
 	list_node_t *cur;
 	bb_node_t *bb;
@@ -1092,10 +1091,10 @@ void dump_cfg(cfg_context_t *cfg)
 		bb->label = i++;
 	}
 
-	//dump_variables_pretty(cfg);
+	//dump_variables_pretty(out, cfg);
 
 	LIST_EACH(cfg->all_bb, cur, bb)
-		dump_bb(cfg, bb);
+		dump_bb(out, cfg, bb);
 }
 
 int run_op(expr_op_t op, int a, int b)
@@ -1122,3 +1121,72 @@ bool is_dummy(bb_node_t *bb)
 {
 	return bb && (bb->is_dummy || bb->instructions == NULL);
 }
+
+static void mark_reachable(bb_node_t *bb)
+{
+	while (bb != NULL && !bb->visited) {
+		bb->visited = 1;
+		mark_reachable(bb->fb);
+		bb = bb->tb;
+	}
+}
+
+bool remove_unreachable_blocks(cfg_context_t *cfg)
+{
+	list_node_t *n, *nn;
+	bb_node_t *bb;
+	bool changed = false;
+
+	LIST_EACH(cfg->all_bb, n, bb)
+		bb->visited = 0;
+
+	mark_reachable(cfg->entry);
+
+	LIST_EACH_NODE_SAFE(cfg->all_bb, n, nn) {
+		bb = n->v;
+
+		if (bb->visited)
+			continue;
+
+		if (bb == cfg->exit)
+			cfg->exit = NULL;
+		list_delete(cfg->all_bb, n);
+		changed = true;
+	}
+
+	if (changed)
+		update_metadata(cfg);
+
+	return changed;
+}
+
+bb_node_t *skip_empty_blocks(cfg_context_t *cfg, bb_node_t *bb)
+{
+	size_t steps = 0;
+
+	/* gives up after visiting as many blocks as there are in the
+	   function, which can only happen on an empty infinite loop */
+	while (bb != NULL && bb->tb != NULL && !bb->has_condition &&
+	       (is_dummy(bb) || bb->instructions->length == 0)) {
+		if (steps++ > cfg->all_bb->length)
+			break;
+		bb = bb->tb;
+	}
+
+	return bb;
+}
+
+void cfg_count(cfg_context_t *cfg, unsigned long *blocks, unsigned long *insts)
+{
+	list_node_t *cur;
+	bb_node_t *bb;
+
+	*blocks = 0;
+	*insts = 0;
+
+	LIST_EACH(cfg->all_bb, cur, bb) {
+		(*blocks)++;
+		if (!is_dummy(bb))
+			*insts += bb->instructions->length;
+	}
+}
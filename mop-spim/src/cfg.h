@@ -10,6 +10,7 @@
 #define __CFG_H__
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "container.h"
 #include "type.h"
@@ -19,6 +20,7 @@ typedef struct _bb_node bb_node_t;
 typedef struct _inst inst_t;
 typedef struct _inst_op inst_op_t;
 typedef struct _cfg_context cfg_context_t;
+typedef struct _live_ctx live_ctx_t;
 
 enum _inst_type {
 	I_ASSIGN,
@@ -47,6 +49,10 @@ struct _bb_node {
 
 	/* a list of bb_node_t* */
 	list_t *parent_nodes;
+
+	/* filled in by compute_liveness: */
+	unsigned long *live_in;
+	unsigned long *live_out;
 };
 
 struct _inst_op { /* instruction operand */
@@ -96,6 +102,12 @@ struct _inst {
 			/* if ret.is_val == true, then the return value
 			   is to be discarded */
 			inst_op_t ret;
+			/* variables live across the call, filled in
+			   by compute_liveness */
+			unsigned long *live;
+			/* set by eliminate_tail_calls if the call can
+			   reuse the caller's frame */
+			bool tail;
 		} c;
 
 		struct {
@@ -115,14 +127,34 @@ struct _cfg_context {
 
 	/* used only during dump: */
 	int next_label;
+
+	/* counters for naming temporaries and numbering values. these are
+	   kept per function so that functions can be compiled independently */
+	unsigned temp_count;
+	unsigned vnum_count, vnum_attr_count;
+
+	/* filled in by compute_liveness */
+	live_ctx_t *live;
+};
+
+struct _live_ctx {
+	/* char *id -> index + 1 */
+	htab_t *index;
+	/* index -> char *id */
+	vec_t *names;
+	/* number of unsigned longs in a set of variables */
+	unsigned words;
 };
 
 /* == cfg.c == */
 
 extern cfg_context_t* func_to_cfg(func_t *f);
 
-/* dumps cfg to stdout, very lazily */
-extern void dump_cfg(cfg_context_t *cfg);
+/* makes up a name for a new temporary */
+extern char *get_next_temp_id(cfg_context_t *cfg);
+
+/* dumps cfg to the given stream, very lazily */
+extern void dump_cfg(cfg_context_t *cfg, FILE *out);
 
 /* performs the given operation on the constant operands */
 extern int run_op(expr_op_t op, int a, int b);
@@ -130,6 +162,21 @@ extern int run_op(expr_op_t op, int a, int b);
 /* determines if the given block is a dummy block */
 extern bool is_dummy(bb_node_t *bb);
 
+/* renumbers the blocks and rebuilds their lists of parents */
+extern void update_metadata(cfg_context_t *cfg);
+
+/* deletes blocks that can't be reached from the entry block, returning true
+   if there were any */
+extern bool remove_unreachable_blocks(cfg_context_t *cfg);
+
+/* follows a chain of empty, unconditional blocks to the first block that
+   does something */
+extern bb_node_t *skip_empty_blocks(cfg_context_t *cfg, bb_node_t *bb);
+
+/* counts the basic blocks and instructions in the cfg */
+extern void cfg_count(cfg_context_t *cfg, unsigned long *blocks,
+                      unsigned long *insts);
+
 /* == cfg_vnum.c == */
 
 /* performs simple value numbering on a basic block */
@@ -143,4 +190,42 @@ extern void value_numbering_extended(cfg_context_t *cfg);
 /* deletes temporary variables which are only aliases for others */
 extern bool eliminate_redundant_temporaries(cfg_context_t *cfg);
 
+/* == cfg_live.c == */
+
+/* returns the operand written by the instruction, or NULL if none */
+extern inst_op_t *inst_def(inst_t *i);
+
+/* calls cb on every operand read by the instruction */
+extern void inst_each_use(inst_t *i, void (*cb)(void*, inst_op_t*), void*);
+
+/* computes live_in and live_out for every basic block, and the set of
+   variables live across every call */
+extern void compute_liveness(cfg_context_t *cfg);
+
+/* updates the set of live variables to what it was before the instruction */
+extern void live_transfer(cfg_context_t *cfg, unsigned long *set, inst_t *i);
+
+/* determines if the given variable is in the set */
+extern bool live_set_has(cfg_context_t *cfg, unsigned long *set, char *id);
+
+/* == cfg_tail.c == */
+
+/* turns self-recursive calls in tail position into loops, and marks other
+   calls in tail position so that they reuse the caller's frame. returns
+   true if any were found */
+extern bool eliminate_tail_calls(cfg_context_t *cfg);
+
+/* == cfg_dce.c == */
+
+/* deletes instructions whose results are never used, and blocks that can
+   never be reached. returns true if anything was removed */
+extern bool eliminate_dead_code(cfg_context_t *cfg);
+
+/* == cfg_layout.c == */
+
+/* reorders the blocks so that as many edges as possible fall through, and
+   while loops are entered at the test and run with one branch per
+   iteration */
+extern void layout_blocks(cfg_context_t *cfg);
+
 #endif
@@ -0,0 +1,217 @@
+/*
+ * CSE 440, Project 3
+ * Mini Object Pascal Code Generation
+ *
+ * Alex Iadicicco
+ * shmibs
+ */
+
+/* Dead code elimination. eliminate_redundant_temporaries only ever looks at
+   one block at a time, so a value computed in one block and never read by
+   any block after it survives all the way to the code generator. This pass
+   uses the global liveness information to find and delete such
+   instructions, and cleans up the control flow graph around them:
+
+    - an I_IF whose condition value numbering has folded to a constant
+      becomes an unconditional edge to the branch that is actually taken
+
+    - an I_IF whose two branches lead, through empty blocks, to the same
+      place is useless, and is dropped along with the test feeding it
+
+    - blocks no longer reachable from the entry block are deleted
+
+    - an instruction without side effects whose result is not live
+      afterwards is deleted, as is an assignment of a variable to itself,
+      and a store that is overwritten by a later store to the same address
+      in the same block, with no load or call in between
+
+   Each of these can expose more of the others, so they are repeated until
+   nothing changes. */
+
+#include <string.h>
+#include "cfg.h"
+#include "container.h"
+
+/* turns the conditional block into an unconditional jump to target */
+static void drop_condition(bb_node_t *bb, bb_node_t *target)
+{
+	list_delete(bb->instructions, list_tail(bb->instructions));
+	bb->has_condition = false;
+	bb->tb = target;
+	bb->fb = NULL;
+}
+
+static bool simplify_branches(cfg_context_t *cfg)
+{
+	list_node_t *n;
+	bb_node_t *bb;
+	inst_t *test;
+	bool changed = false;
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		if (!bb->has_condition)
+			continue;
+
+		test = list_tail(bb->instructions)->v;
+		if (test->type != I_IF)
+			continue;
+
+		if (test->cond.is_val) {
+			drop_condition(bb, test->cond.val ? bb->tb : bb->fb);
+			changed = true;
+		} else if (skip_empty_blocks(cfg, bb->tb) ==
+		           skip_empty_blocks(cfg, bb->fb)) {
+			drop_condition(bb, bb->tb);
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+/* instructions that do nothing but compute a value into their destination */
+static bool is_pure(inst_t *i)
+{
+	switch (i->type) {
+	case I_ASSIGN:
+	case I_ATTRIBUTE:
+	case I_LOAD:
+	case I_ALLOC:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/* x <- x does nothing, but keeps its block from being empty */
+static bool is_self_assign(inst_t *i)
+{
+	return i->type == I_ASSIGN && i->a.op == OP_IDENTIFIER &&
+	       !i->a.r[0].is_val && !strcmp(i->a.l.id, i->a.r[0].id);
+}
+
+/* deletes stores to an address which is stored to again further down the
+   block before anything could have read the first value */
+static bool remove_dead_stores(bb_node_t *bb)
+{
+	list_node_t *n, *pn;
+	inst_op_t *def;
+	inst_t *i;
+	htab_t *stored; /* address names that are stored to further down */
+	bool changed = false;
+
+	stored = htab_new(HTAB_DEFAULT_ORDER);
+
+	for (n = bb->instructions->root.prev;
+	     n != &bb->instructions->root; n = pn) {
+		pn = n->prev;
+		i = n->v;
+
+		switch (i->type) {
+		case I_STORE:
+			if (htab_get(stored, i->m.dst.id)) {
+				list_delete(bb->instructions, n);
+				changed = true;
+			} else {
+				htab_put(stored, i->m.dst.id, i->m.dst.id);
+			}
+			break;
+
+		case I_LOAD:
+		case I_CALL:
+			htab_release(stored);
+			stored = htab_new(HTAB_DEFAULT_ORDER);
+			break;
+
+		default:
+			break;
+		}
+
+		/* the address no longer means the same thing above here */
+		if ((def = inst_def(i)) != NULL)
+			htab_delete(stored, def->id);
+	}
+
+	htab_release(stored);
+
+	return changed;
+}
+
+static bool remove_dead_instructions(cfg_context_t *cfg)
+{
+	list_node_t *n, *in, *pn;
+	bb_node_t *bb;
+	inst_op_t *def;
+	inst_t *i;
+	unsigned long *live;
+	bool changed = false;
+
+	compute_liveness(cfg);
+
+	live = mem_alloc(cfg->live->words * sizeof(unsigned long));
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		if (is_dummy(bb))
+			continue;
+
+		if (remove_dead_stores(bb))
+			changed = true;
+
+		memcpy(live, bb->live_out,
+		       cfg->live->words * sizeof(unsigned long));
+
+		for (in = bb->instructions->root.prev;
+		     in != &bb->instructions->root; in = pn) {
+			pn = in->prev;
+			i = in->v;
+			def = inst_def(i);
+
+			if (is_self_assign(i)) {
+				list_delete(bb->instructions, in);
+				changed = true;
+				continue;
+			}
+
+			if (def != NULL && !live_set_has(cfg, live, def->id)) {
+				if (is_pure(i)) {
+					list_delete(bb->instructions, in);
+					changed = true;
+					continue;
+				}
+
+				/* the call still has to be made, but its
+				   result can be thrown away */
+				if (i->type == I_CALL) {
+					i->c.ret.is_val = true;
+					i->c.ret.val = 0;
+					changed = true;
+				}
+			}
+
+			live_transfer(cfg, live, i);
+		}
+	}
+
+	mem_free(live);
+
+	return changed;
+}
+
+bool eliminate_dead_code(cfg_context_t *cfg)
+{
+	bool changed, any = false;
+
+	do {
+		changed = simplify_branches(cfg);
+		if (remove_unreachable_blocks(cfg))
+			changed = true;
+		if (remove_dead_instructions(cfg))
+			changed = true;
+
+		if (changed)
+			any = true;
+	} while (changed);
+
+	return any;
+}
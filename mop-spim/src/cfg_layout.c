@@ -0,0 +1,142 @@
+/*
+ * CSE 440, Project 3
+ * Mini Object Pascal Code Generation
+ *
+ * Alex Iadicicco
+ * shmibs
+ */
+
+/* Basic block layout. The code generator emits blocks in the order they
+   appear in all_bb, and every edge that doesn't lead to the very next
+   block costs a jump. The order the CFG is built in puts a while loop's
+   test before its body, so every iteration executes both the test's
+   branch out of the loop and the body's jump back up to the test.
+
+   This pass picks a better order. Blocks are chained so that each one is
+   followed by one of its successors wherever possible. A block where
+   control flow merges, like the one after an if statement, is not placed
+   until all of its predecessors have been, so that neither arm has to
+   jump over the other to reach it.
+
+   Loops are rotated: the body of a while loop is placed first and the test
+   after it, so the body falls into the test, and the test branches back to
+   the top of the body while the loop keeps going and falls out of it when
+   it is done. The loop is entered with a single jump to the test.
+
+   Before any of that, every edge that leads to an empty block is pointed
+   past it, so that a jump never lands on another jump. The empty blocks
+   are then unreachable, and are deleted. */
+
+#include "cfg.h"
+#include "container.h"
+
+static void thread_jumps(cfg_context_t *cfg)
+{
+	list_node_t *n;
+	bb_node_t *bb;
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		bb->tb = skip_empty_blocks(cfg, bb->tb);
+		bb->fb = skip_empty_blocks(cfg, bb->fb);
+	}
+}
+
+/* counts in bb->label the predecessors of each block that reach it along a
+   forward edge. an edge to a block that is still being searched from
+   closes a loop, and isn't waited for, since it can only be placed after
+   the block it leads to. that includes a loop body that jumps straight
+   back to itself once its test has been optimized away */
+static void count_forward_edges(bb_node_t *bb)
+{
+	bb_node_t *succ[2];
+	int i;
+
+	succ[0] = bb->tb;
+	succ[1] = bb->has_condition ? bb->fb : NULL;
+
+	bb->visited = 1;
+
+	for (i=0; i<2; i++) {
+		if (succ[i] == NULL || succ[i]->visited == 1)
+			continue;
+
+		succ[i]->label++;
+		if (succ[i]->visited == 0)
+			count_forward_edges(succ[i]);
+	}
+
+	bb->visited = 2;
+}
+
+/* places bb and every block reachable from it that hasn't been placed yet,
+   following the chain of fallthrough successors as far as it goes. while
+   this runs, bb->label counts the forward predecessors of bb not yet
+   placed */
+static void place(cfg_context_t *cfg, list_t *order, bb_node_t *bb)
+{
+	while (bb != NULL && !bb->visited) {
+		/* loop tests are reached again from the end of the body, so
+		   they're placed as soon as they're reached from outside */
+		if (!bb->is_while && --bb->label > 0)
+			return;
+
+		bb->visited = 1;
+
+		/* the entry block has to come first, so it is never rotated */
+		if (bb->is_while && bb->has_condition && bb != cfg->entry) {
+			place(cfg, order, bb->tb);
+			bb->n = list_append(order, bb);
+			bb = bb->fb;
+			continue;
+		}
+
+		bb->n = list_append(order, bb);
+
+		if (bb->has_condition) {
+			place(cfg, order, bb->tb);
+			bb = bb->fb;
+		} else {
+			bb = bb->tb;
+		}
+	}
+}
+
+void layout_blocks(cfg_context_t *cfg)
+{
+	list_node_t *n;
+	bb_node_t *bb;
+	list_t *order;
+
+	thread_jumps(cfg);
+	remove_unreachable_blocks(cfg);
+	update_metadata(cfg);
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		bb->visited = 0;
+		bb->label = 0;
+	}
+
+	count_forward_edges(cfg->entry);
+
+	LIST_EACH(cfg->all_bb, n, bb)
+		bb->visited = 0;
+
+	/* the entry block has no predecessors to wait for */
+	cfg->entry->label = 1;
+
+	order = list_new();
+	place(cfg, order, cfg->entry);
+
+	/* every block is reachable, so this shouldn't find anything, but a
+	   block left out here would never be emitted */
+	LIST_EACH(cfg->all_bb, n, bb) {
+		if (!bb->visited) {
+			bb->label = 1;
+			place(cfg, order, bb);
+		}
+	}
+
+	list_release(cfg->all_bb);
+	cfg->all_bb = order;
+	update_metadata(cfg);
+}
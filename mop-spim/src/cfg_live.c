@@ -0,0 +1,328 @@
+/*
+ * CSE 440, Project 3
+ * Mini Object Pascal Code Generation
+ *
+ * Alex Iadicicco
+ * shmibs
+ */
+
+/* Global liveness analysis. A variable is live at some point in the program
+   if its current value may be read along some path leading away from that
+   point. This is the classic backwards dataflow problem:
+
+      live_out(B) = union of live_in(S), for every successor S of B
+      live_in(B)  = use(B) + (live_out(B) - def(B))
+
+   iterated until nothing changes. The only value that escapes a function is
+   its return value, which is read in the post-amble, so that is the only
+   variable live on exit.
+
+   Every distinct identifier in the CFG is given a small index, and sets of
+   variables are plain bit vectors. The per-instruction sets are not stored,
+   since they can be recovered cheaply by walking a block backwards from its
+   live_out set with live_transfer. The one exception is I_CALL, where the
+   set of variables live across the call is saved on the instruction, since
+   the code generator needs it while walking forwards. */
+
+#include <string.h>
+#include "error.h"
+#include "cfg.h"
+#include "container.h"
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+static unsigned long *live_set_new(live_ctx_t *live)
+{
+	return mem_alloc(live->words * sizeof(unsigned long));
+}
+
+static void live_set_copy(live_ctx_t *live, unsigned long *dst,
+                          unsigned long *src)
+{
+	memcpy(dst, src, live->words * sizeof(unsigned long));
+}
+
+/* returns the index of the given variable, or -1 if it is not known */
+static int live_index(live_ctx_t *live, char *id)
+{
+	unsigned long idx = (unsigned long) htab_get(live->index, id);
+
+	return (int) idx - 1;
+}
+
+static void live_add_name(live_ctx_t *live, inst_op_t *op)
+{
+	if (op == NULL || op->is_val || htab_get(live->index, op->id))
+		return;
+
+	vec_append(live->names, op->id);
+	htab_put(live->index, op->id, (void*) (unsigned long) live->names->size);
+}
+
+static void live_gen(live_ctx_t *live, unsigned long *set, inst_op_t *op)
+{
+	int idx;
+
+	if (op->is_val || (idx = live_index(live, op->id)) < 0)
+		return;
+
+	set[idx / BITS_PER_WORD] |= 1UL << (idx % BITS_PER_WORD);
+}
+
+static void live_kill(live_ctx_t *live, unsigned long *set, inst_op_t *op)
+{
+	int idx;
+
+	if (op->is_val || (idx = live_index(live, op->id)) < 0)
+		return;
+
+	set[idx / BITS_PER_WORD] &= ~(1UL << (idx % BITS_PER_WORD));
+}
+
+inst_op_t *inst_def(inst_t *i)
+{
+	switch (i->type) {
+	case I_ASSIGN:
+	case I_ATTRIBUTE:
+		return &i->a.l;
+
+	case I_LOAD:
+		return &i->m.dst;
+
+	case I_CALL:
+		return i->c.ret.is_val ? NULL : &i->c.ret;
+
+	case I_ALLOC:
+		return &i->alloc.dst;
+
+	case I_IF:
+	case I_STORE:
+	case I_PRINT:
+		return NULL;
+	}
+
+	return NULL;
+}
+
+void inst_each_use(inst_t *i, void (*cb)(void*, inst_op_t*), void *priv)
+{
+	list_node_t *n;
+	inst_op_t *arg;
+
+	switch (i->type) {
+	case I_ASSIGN:
+		switch (i->a.op) {
+		case OP_IDENTIFIER:
+		case OP_INTEGER_CONSTANT:
+		case OP_NOT:
+			cb(priv, &i->a.r[0]);
+			break;
+
+		default:
+			cb(priv, &i->a.r[0]);
+			cb(priv, &i->a.r[1]);
+			break;
+		}
+		break;
+
+	case I_IF:
+		cb(priv, &i->cond);
+		break;
+
+	case I_ATTRIBUTE:
+		/* r[1] is the name of the attribute, not a variable */
+		cb(priv, &i->a.r[0]);
+		break;
+
+	case I_LOAD:
+		cb(priv, &i->m.src);
+		break;
+
+	case I_STORE:
+		/* dst is an address, and so is read, not written */
+		cb(priv, &i->m.dst);
+		cb(priv, &i->m.src);
+		break;
+
+	case I_CALL:
+		LIST_EACH(i->c.args, n, arg)
+			cb(priv, arg);
+		break;
+
+	case I_ALLOC:
+		break;
+
+	case I_PRINT:
+		cb(priv, &i->a.r[0]);
+		break;
+	}
+}
+
+struct live_gen_ctx {
+	live_ctx_t *live;
+	unsigned long *set;
+};
+
+static void live_gen_cb(void *_ctx, inst_op_t *op)
+{
+	struct live_gen_ctx *ctx = _ctx;
+
+	live_gen(ctx->live, ctx->set, op);
+}
+
+static void live_add_name_cb(void *live, inst_op_t *op)
+{
+	live_add_name(live, op);
+}
+
+void live_transfer(cfg_context_t *cfg, unsigned long *set, inst_t *i)
+{
+	struct live_gen_ctx ctx = { cfg->live, set };
+	inst_op_t *def;
+
+	if ((def = inst_def(i)) != NULL)
+		live_kill(cfg->live, set, def);
+
+	inst_each_use(i, live_gen_cb, &ctx);
+}
+
+bool live_set_has(cfg_context_t *cfg, unsigned long *set, char *id)
+{
+	int idx = live_index(cfg->live, id);
+
+	if (idx < 0)
+		return false;
+
+	return (set[idx / BITS_PER_WORD] >> (idx % BITS_PER_WORD)) & 1;
+}
+
+/* recomputes bb->live_in from bb->live_out. returns true if it changed */
+static bool live_update_bb(cfg_context_t *cfg, bb_node_t *bb,
+                           unsigned long *tmp)
+{
+	list_node_t *n;
+	bool changed;
+
+	live_set_copy(cfg->live, tmp, bb->live_out);
+
+	if (!is_dummy(bb)) {
+		for (n = bb->instructions->root.prev;
+		     n != &bb->instructions->root; n = n->prev)
+			live_transfer(cfg, tmp, n->v);
+	}
+
+	changed = memcmp(tmp, bb->live_in,
+	                 cfg->live->words * sizeof(unsigned long));
+	live_set_copy(cfg->live, bb->live_in, tmp);
+
+	return changed;
+}
+
+static void live_merge(live_ctx_t *live, unsigned long *dst, bb_node_t *bb)
+{
+	unsigned w;
+
+	if (bb == NULL)
+		return;
+
+	for (w=0; w<live->words; w++)
+		dst[w] |= bb->live_in[w];
+}
+
+/* records the set of variables live across each call in the block */
+static void live_annotate_calls(cfg_context_t *cfg, bb_node_t *bb,
+                                unsigned long *tmp)
+{
+	list_node_t *n;
+	inst_t *i;
+
+	if (is_dummy(bb))
+		return;
+
+	live_set_copy(cfg->live, tmp, bb->live_out);
+
+	for (n = bb->instructions->root.prev;
+	     n != &bb->instructions->root; n = n->prev) {
+		i = n->v;
+
+		if (i->type == I_CALL) {
+			if (i->c.live == NULL)
+				i->c.live = live_set_new(cfg->live);
+			live_set_copy(cfg->live, i->c.live, tmp);
+			if (!i->c.ret.is_val)
+				live_kill(cfg->live, i->c.live, &i->c.ret);
+		}
+
+		live_transfer(cfg, tmp, i);
+	}
+}
+
+void compute_liveness(cfg_context_t *cfg)
+{
+	live_ctx_t *live;
+	list_node_t *n, *n2;
+	bb_node_t *bb;
+	inst_t *i;
+	inst_op_t ret;
+	unsigned long *tmp;
+	unsigned w;
+	bool changed;
+
+	live = mem_alloc(sizeof(*live));
+	live->index = htab_new(HTAB_DEFAULT_ORDER);
+	live->names = vec_new(32);
+	cfg->live = live;
+
+	/* number every variable in the function */
+	ret.is_val = false;
+	ret.id = cfg->fn->name;
+	live_add_name(live, &ret);
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		if (is_dummy(bb))
+			continue;
+
+		LIST_EACH(bb->instructions, n2, i) {
+			live_add_name(live, inst_def(i));
+			inst_each_use(i, live_add_name_cb, live);
+		}
+	}
+
+	live->words = (live->names->size + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		bb->live_in = live_set_new(live);
+		bb->live_out = live_set_new(live);
+	}
+
+	tmp = live_set_new(live);
+
+	/* visiting blocks in reverse order tends to follow the flow of
+	   information backwards, which makes this converge quickly */
+	do {
+		changed = false;
+
+		for (n = cfg->all_bb->root.prev;
+		     n != &cfg->all_bb->root; n = n->prev) {
+			bb = n->v;
+
+			if (bb->tb == NULL) {
+				/* falls off the end of the function */
+				live_gen(live, bb->live_out, &ret);
+			} else {
+				for (w=0; w<live->words; w++)
+					bb->live_out[w] = 0;
+				live_merge(live, bb->live_out, bb->tb);
+				live_merge(live, bb->live_out, bb->fb);
+			}
+
+			if (live_update_bb(cfg, bb, tmp))
+				changed = true;
+		}
+	} while (changed);
+
+	LIST_EACH(cfg->all_bb, n, bb)
+		live_annotate_calls(cfg, bb, tmp);
+
+	mem_free(tmp);
+}
@@ -0,0 +1,188 @@
+/*
+ * CSE 440, Project 3
+ * Mini Object Pascal Code Generation
+ *
+ * Alex Iadicicco
+ * shmibs
+ */
+
+/* Tail call elimination. A call is in tail position when its result goes
+   straight into the function's return value and nothing else happens
+   before the function returns. Such a call doesn't need a frame of its
+   own, since the caller's frame is dead as soon as the call is made.
+
+   When a function calls itself in tail position, the call is replaced by
+   assignments of the new argument values to the parameters and a jump back
+   to the entry block, making the recursion into a loop. Any other tail
+   call is marked as such, and the code generator pops the caller's frame
+   and jumps to the callee with the arguments in place of the caller's own,
+   so that the callee returns directly to the caller's caller. This needs
+   the callee to take no more arguments than the caller, since the
+   arguments have to fit in the space the caller's caller pushed.
+
+   Either way, the caller's frame is gone (or reused) when the callee runs,
+   so a reference parameter may not point into it. Since only arrays live
+   in the frame, and everything else passed by reference lives on the heap
+   or in some other function's frame, tail calls that pass reference
+   parameters are left alone in functions which have local arrays. */
+
+#include <string.h>
+#include "cfg.h"
+#include "container.h"
+
+static bool has_local_arrays(func_t *f)
+{
+	list_node_t *n;
+	symbol_t *s;
+
+	LIST_EACH(f->vars, n, s) {
+		if (s->t->tag == T_ARRAY)
+			return true;
+	}
+
+	return false;
+}
+
+static bool has_ref_parameters(func_t *f)
+{
+	list_node_t *n;
+	symbol_t *s;
+
+	LIST_EACH(f->arguments, n, s) {
+		if (s->tag == SYM_REF_PARAMETER)
+			return true;
+	}
+
+	return false;
+}
+
+/* returns the call at the end of bb if it is in tail position */
+static inst_t *tail_call(cfg_context_t *cfg, bb_node_t *bb)
+{
+	bb_node_t *next;
+	inst_t *i;
+
+	if (is_dummy(bb) || bb->has_condition || bb->instructions->length == 0)
+		return NULL;
+
+	i = list_tail(bb->instructions)->v;
+	if (i->type != I_CALL || i->c.ret.is_val ||
+	    strcmp(i->c.ret.id, cfg->fn->name))
+		return NULL;
+
+	/* the return value must not be touched again on the way out */
+	if (bb->tb != NULL) {
+		next = skip_empty_blocks(cfg, bb->tb);
+		if (next->tb != NULL ||
+		    (!is_dummy(next) && next->instructions->length != 0))
+			return NULL;
+	}
+
+	return i;
+}
+
+static inst_t *assign_new(inst_op_t *l, inst_op_t *r)
+{
+	inst_t *i = mem_alloc(sizeof(*i));
+
+	i->type = I_ASSIGN;
+	i->a.op = r->is_val ? OP_INTEGER_CONSTANT : OP_IDENTIFIER;
+	i->a.l = *l;
+	i->a.r[0] = *r;
+
+	return i;
+}
+
+static bool is_parameter(func_t *f, char *id)
+{
+	list_node_t *n;
+	symbol_t *s;
+
+	if (!strcmp(id, "this"))
+		return true;
+
+	LIST_EACH(f->arguments, n, s) {
+		if (!strcmp(s->name, id))
+			return true;
+	}
+
+	return false;
+}
+
+/* replaces the call at the end of bb with a jump to the top of the
+   function, after assigning the arguments to the parameters. an argument
+   which is itself a parameter is copied to a temporary first, in case that
+   parameter is assigned to before the argument is read */
+static void call_to_jump(cfg_context_t *cfg, bb_node_t *bb, inst_t *call)
+{
+	list_node_t *n, *pn = NULL;
+	inst_op_t *arg, param, tmp;
+	list_t *assigns;
+	inst_t *i;
+
+	list_delete(bb->instructions, list_tail(bb->instructions));
+	assigns = list_new();
+
+	/* the first argument is 'this', and the rest line up with the
+	   function's parameters */
+	param.is_val = false;
+
+	LIST_EACH(call->c.args, n, arg) {
+		param.id = pn ? ((symbol_t*) pn->v)->name : "this";
+		pn = pn ? pn->next : cfg->fn->arguments->root.next;
+
+		if (!arg->is_val && !strcmp(arg->id, param.id))
+			continue;
+
+		if (!arg->is_val && is_parameter(cfg->fn, arg->id)) {
+			tmp.is_val = false;
+			tmp.id = get_next_temp_id(cfg);
+			list_append(bb->instructions, assign_new(&tmp, arg));
+			arg = &tmp;
+		}
+
+		list_append(assigns, assign_new(&param, arg));
+	}
+
+	LIST_EACH(assigns, n, i)
+		list_append(bb->instructions, i);
+	list_release(assigns);
+
+	bb->tb = cfg->entry;
+}
+
+bool eliminate_tail_calls(cfg_context_t *cfg)
+{
+	list_node_t *n;
+	bb_node_t *bb;
+	inst_t *i;
+	bool local_arrays, jumped = false, any = false;
+
+	local_arrays = has_local_arrays(cfg->fn);
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		if ((i = tail_call(cfg, bb)) == NULL)
+			continue;
+
+		if (local_arrays && has_ref_parameters(i->c.fn))
+			continue;
+
+		if (i->c.fn == cfg->fn) {
+			call_to_jump(cfg, bb, i);
+			jumped = true;
+		} else if (i->c.args->length <=
+		           cfg->fn->arguments->length + 1) {
+			i->c.tail = true;
+		} else {
+			continue;
+		}
+
+		any = true;
+	}
+
+	/* the entry block has gained predecessors */
+	if (jumped)
+		update_metadata(cfg);
+
+	return any;
+}
@@ -27,9 +27,6 @@
 
 #define OP_COMMUTATIVE 1
 
-static unsigned vnum_count = 0;
-static unsigned vnum_attr_count = 0;
-
 /* this is a table of properties for different operators */
 static unsigned op_flags[] = {
 	[OP_INDEX]             = 0,
@@ -107,6 +104,9 @@ struct _vnum {
 /* value numbering context */
 struct _vnum_ctx {
 	vnum_ctx_t *parent;
+
+	/* the function being numbered, which owns the value number counters */
+	cfg_context_t *cfg;
 	
 	/* a table mapping symbols to vnum_t. note that different symbols can
 	   point to the same vnum_t. */
@@ -129,10 +129,11 @@ struct _vnum_match_context {
 };
 
 /* creates a new value numbering context */
-static vnum_ctx_t *vnum_ctx_new(vnum_ctx_t *parent)
+static vnum_ctx_t *vnum_ctx_new(cfg_context_t *cfg, vnum_ctx_t *parent)
 {
-	vnum_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	vnum_ctx_t *ctx = mem_alloc(sizeof(*ctx));
 
+	ctx->cfg = cfg;
 	ctx->vtab = htab_new(HTAB_DEFAULT_ORDER);
 	ctx->attrtab = htab_new(HTAB_DEFAULT_ORDER);
 	ctx->nums = vec_new(10);
@@ -147,23 +148,22 @@ static void vnum_ctx_release(vnum_ctx_t *ctx)
 	unsigned i;
 
 	for (i=0; i<ctx->nums->size; i++)
-		free(vec_get(ctx->nums, i));
+		mem_free(vec_get(ctx->nums, i));
 
 	htab_release(ctx->vtab);
 	htab_release(ctx->attrtab);
 	vec_release(ctx->nums);
 
-	free(ctx);
+	mem_free(ctx);
 }
 
 /* allocates the next vnum_t */
 static vnum_t *vnum_next(vnum_ctx_t *ctx)
 {
-	vnum_t *vnum = calloc(1, sizeof(*vnum));
+	vnum_t *vnum = mem_alloc(sizeof(*vnum));
 
 	vnum->is_constant = false;
-	vnum->number = vnum_count;
-	vnum_count++;
+	vnum->number = ctx->cfg->vnum_count++;
 	vnum->inst = I_ASSIGN;
 	vnum->op = OP_NONE;
 
@@ -175,11 +175,10 @@ static vnum_t *vnum_next(vnum_ctx_t *ctx)
 /* allocates the next attr vnum_t */
 static vnum_t *vnum_next_attr(vnum_ctx_t *ctx)
 {
-	vnum_t *vnum = calloc(1, sizeof(*vnum));
+	vnum_t *vnum = mem_alloc(sizeof(*vnum));
 
 	vnum->is_constant = false;
-	vnum->number = vnum_attr_count;
-	vnum_attr_count++;
+	vnum->number = ctx->cfg->vnum_attr_count++;
 	vnum->inst = I_ATTRIBUTE;
 	vnum->op = OP_NONE;
 
@@ -254,7 +253,7 @@ static void id_for_vnum_check(void *_match_context, char *id, void *_vnum)
 		return;
 
 	if (vnum_eq(vnum, match_context->vnum_to_match))
-		match_context->id_match = strdup(id);
+		match_context->id_match = mem_strdup(id);
 
 	return;
 }
@@ -631,9 +630,9 @@ skip:
 	 * pass the parent */
 	if (bb->fb != NULL && bb->fb->visited == 0) {
 		if (bb->fb->parent_nodes->length != 1)
-			new_ctx = vnum_ctx_new(NULL);
+			new_ctx = vnum_ctx_new(ctx->cfg, NULL);
 		else
-			new_ctx = vnum_ctx_new(ctx);
+			new_ctx = vnum_ctx_new(ctx->cfg, ctx);
 
 		bb->fb->visited = 1;
 		value_numbering_ctx(bb->fb, new_ctx);
@@ -641,9 +640,9 @@ skip:
 	
 	if (bb->tb != NULL && bb->tb->visited == 0) {
 		if (bb->tb->parent_nodes->length != 1)
-			new_ctx = vnum_ctx_new(NULL);
+			new_ctx = vnum_ctx_new(ctx->cfg, NULL);
 		else
-			new_ctx = vnum_ctx_new(ctx);
+			new_ctx = vnum_ctx_new(ctx->cfg, ctx);
 
 		bb->tb->visited = 1;
 		value_numbering_ctx(bb->tb, new_ctx);
@@ -653,7 +652,7 @@ skip:
 /* performs basic value numbering for the given cfg */
 void value_numbering_basic(cfg_context_t *cfg)
 {
-	vnum_ctx_t *ctx = vnum_ctx_new(NULL);
+	vnum_ctx_t *ctx;
 	list_node_t *cur;
 	bb_node_t *bb;
 
@@ -663,7 +662,7 @@ void value_numbering_basic(cfg_context_t *cfg)
 		bb->visited = 1;
 
 	LIST_EACH(cfg->all_bb, cur, bb) {
-		ctx = vnum_ctx_new(NULL);
+		ctx = vnum_ctx_new(cfg, NULL);
 		value_numbering_ctx(bb, ctx);
 		vnum_ctx_release(ctx);
 	}
@@ -672,7 +671,7 @@ void value_numbering_basic(cfg_context_t *cfg)
 /* performs extended value numbering for the given cfg */
 void value_numbering_extended(cfg_context_t *cfg)
 {
-	vnum_ctx_t *ctx = vnum_ctx_new(NULL);
+	vnum_ctx_t *ctx;
 	list_node_t *cur;
 	bb_node_t *bb;
 
@@ -690,7 +689,7 @@ void value_numbering_extended(cfg_context_t *cfg)
 		if (bb->visited || bb->parent_nodes->length == 1)
 			continue;
 
-		ctx = vnum_ctx_new(NULL);
+		ctx = vnum_ctx_new(cfg, NULL);
 		value_numbering_ctx(bb, ctx);
 		vnum_ctx_release(ctx);
 	}
@@ -11,6 +11,9 @@
 #ifndef __INC_CG_H__
 #define __INC_CG_H__
 
+#include <stdbool.h>
+#include <stdio.h>
+
 #include "container.h"
 #include "cfg.h"
 
@@ -20,6 +23,43 @@
 #define BYTES_IN_POINTER 4
 #define INTEGERS_IN_POINTER 1
 
+/* code generation options, set from the command line */
+extern bool cg_tail_calls;   /* turn tail calls into jumps */
+extern bool cg_dce;          /* run dead code elimination */
+extern bool cg_layout;       /* reorder basic blocks */
+extern bool cg_peephole;     /* run the peephole optimizer */
+extern bool cg_delay_slots;  /* target has branch delay slots */
+extern bool cg_verbose;      /* dump CFGs and statistics to stderr */
+extern unsigned cg_jobs;     /* number of functions to compile at once */
+
+#define ASM_LINE_MAX 512
+
+/* a single line of emitted assembly. a function's worth of these is
+   buffered up so that the peephole optimizer can look at it before it is
+   written out */
+typedef struct asm_line {
+	enum {
+		ASM_BLANK,
+		ASM_COMMENT,
+		ASM_LABEL,
+		ASM_DIRECTIVE,
+		ASM_INST,
+	} kind;
+
+	/* the line itself, and its end-of-line comment or NULL. these are
+	   allocated to fit, since a function's worth of lines is kept */
+	char *text;
+	char *comment;
+
+	/* for instructions, the mnemonic and operands, and for labels, the
+	   name of the label. these all point into buf, a copy of text made
+	   in the same allocation */
+	char *op;
+	char *args[3];
+	int nargs;
+	char *buf;
+} asm_line_t;
+
 /* == cg_common.c == */
 
 /* gets the 'field' size of a type, meaning the size of a function local
@@ -36,6 +76,21 @@ extern void allocate_symbols(prog_t *p);
 
 /* == cg_mips.c == */
 
-extern void mips_emit_program(prog_t *p);
+extern void mips_emit_program(prog_t *p, FILE *out);
+
+/* == cg_mips_peep.c == */
+
+/* replaces the line's text, and fills in kind, op, and args from it */
+extern void asm_line_set_text(asm_line_t *line, const char *text);
+
+/* frees the line and its strings */
+extern void asm_line_free(asm_line_t *line);
+
+/* runs the peephole optimizer over a list of asm_line_t*, returning the
+   number of instructions eliminated */
+extern unsigned mips_peephole(list_t *lines);
+
+/* fills branch delay slots, with nops if nothing better can be found */
+extern void mips_fill_delay_slots(list_t *lines);
 
 #endif
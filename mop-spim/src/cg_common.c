@@ -116,7 +116,7 @@ static void allocate_locals(void *unused, char *name, void *_type)
 
 	LIST_EACH(type->cls->functions, n, fn) {
 		snprintf(buf, 2048, "%s_%s", type->cls->name, fn->name);
-		fn->mangled_name = strdup(buf);
+		fn->mangled_name = mem_strdup(buf);
 		DEBUG("    %s:\n", fn->mangled_name);
 
 		/* implicit 'this' */
@@ -10,10 +10,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "error.h"
 #include "cfg.h"
 #include "cg.h"
+#include "timing.h"
 
 #define TAB "\t"
 
@@ -74,48 +76,73 @@ static const char *reg_names[] = {
 
 #define _N(reg) (reg_names[(reg)]) /* register to char* name */
 
-static FILE *output = NULL;
+bool cg_tail_calls = true;
+bool cg_dce = true;
+bool cg_layout = true;
+bool cg_peephole = true;
+bool cg_delay_slots = false;
+bool cg_verbose = true;
+unsigned cg_jobs = 1;
+
+/* the emitter's state is per thread, so that batch mode can compile several
+   programs at once */
+static __thread FILE *output = NULL;
+
+/* lines are buffered up in 'lines' as asm_line_t*, and only written to
+   output when _E_flush is called, so that the peephole optimizer gets a
+   chance to look at them first */
+static __thread list_t *lines = NULL;
 
 #define NUM_EOL 10
-static int cur_col = 0;
-static char eol_extra[NUM_EOL][512];
-static int eol_top = 0;
+static __thread char eol_extra[NUM_EOL][512];
+static __thread int eol_top = 0;
+
+static asm_line_t *_E_line(void)
+{
+	asm_line_t *line;
+
+	if (lines == NULL)
+		lines = list_new();
+
+	line = mem_alloc(sizeof(*line));
+	memset(line, 0, sizeof(*line));
+	list_append(lines, line);
+
+	return line;
+}
 
 /* emit line */
 static void _E(const char *fmt, ...)
 {
+	asm_line_t *line = _E_line();
+	char text[ASM_LINE_MAX];
 	va_list va;
 
-	if (output == NULL)
-		output = stdout;
-
 	va_start(va, fmt);
-	cur_col = vfprintf(output, fmt, va);
+	vsnprintf(text, ASM_LINE_MAX, fmt, va);
 	if (eol_top) {
 		eol_top--;
-		while (cur_col < 30) {
-			putc(' ', output);
-			cur_col++;
-		}
-		fprintf(output, "%s", eol_extra[eol_top]);
+		line->comment = mem_strdup(eol_extra[eol_top]);
 	}
-	putc('\n', output);
 	va_end(va);
+
+	asm_line_set_text(line, text);
 }
 
 /* emit comment */
 static void _E_C(const char *fmt, ...)
 {
+	asm_line_t *line = _E_line();
+	char text[ASM_LINE_MAX];
 	va_list va;
-
-	if (output == NULL)
-		output = stdout;
+	int len;
 
 	va_start(va, fmt);
-	fprintf(output, "\t# ");
-	vfprintf(output, fmt, va);
-	fprintf(output, "\n");
+	len = snprintf(text, ASM_LINE_MAX, "\t# ");
+	vsnprintf(text + len, ASM_LINE_MAX - len, fmt, va);
 	va_end(va);
+
+	asm_line_set_text(line, text);
 }
 
 /* set end-of-line */
@@ -128,6 +155,105 @@ static void _E_EOL(const char *fmt, ...)
 	va_end(va);
 }
 
+/* -ftime-report helpers. cfg passes are measured in basic blocks and IR
+   instructions, passes over the buffered assembly in MIPS instructions
+   only */
+
+static void cfg_pass_begin(time_pass_t *t, cfg_context_t *cfg)
+{
+	unsigned long blocks = 0, insts = 0;
+
+	if (time_report && cfg != NULL)
+		cfg_count(cfg, &blocks, &insts);
+
+	time_pass_begin(t, blocks, insts);
+}
+
+static void cfg_pass_end(time_pass_t *t, const char *name,
+                         cfg_context_t *cfg)
+{
+	unsigned long blocks = 0, insts = 0;
+
+	if (time_report)
+		cfg_count(cfg, &blocks, &insts);
+
+	time_pass_end(t, name, blocks, insts);
+}
+
+static unsigned long asm_count(void)
+{
+	list_node_t *n;
+	asm_line_t *line;
+	unsigned long insts = 0;
+
+	if (!time_report || lines == NULL)
+		return 0;
+
+	LIST_EACH(lines, n, line) {
+		if (line->kind == ASM_INST)
+			insts++;
+	}
+
+	return insts;
+}
+
+static void asm_pass_begin(time_pass_t *t)
+{
+	time_pass_begin(t, 0, asm_count());
+}
+
+static void asm_pass_end(time_pass_t *t, const char *name)
+{
+	time_pass_end(t, name, 0, asm_count());
+}
+
+/* last touches to the buffered lines before they can be written */
+static void _E_finish(void)
+{
+	time_pass_t t;
+
+	if (lines == NULL || !cg_delay_slots)
+		return;
+
+	asm_pass_begin(&t);
+	mips_fill_delay_slots(lines);
+	asm_pass_end(&t, "mips_fill_delay_slots");
+}
+
+/* write out and discard the given lines */
+static void _E_write(list_t *ls)
+{
+	list_node_t *n;
+	asm_line_t *line;
+	int cur_col;
+
+	LIST_EACH(ls, n, line) {
+		cur_col = fprintf(output, "%s", line->text);
+		if (line->comment) {
+			while (cur_col < 30) {
+				putc(' ', output);
+				cur_col++;
+			}
+			fprintf(output, "%s", line->comment);
+		}
+		putc('\n', output);
+		asm_line_free(line);
+	}
+
+	list_release(ls);
+}
+
+/* write out and discard all buffered lines */
+static void _E_flush(void)
+{
+	if (lines == NULL)
+		return;
+
+	_E_finish();
+	_E_write(lines);
+	lines = NULL;
+}
+
 /* emit blank line */
 #define _E_LF() _E("")
 
@@ -177,6 +303,12 @@ typedef struct {
 		unsigned num;
 	};
 	char *name;
+
+	/* for memory locations, the register the location is relative to,
+	   and the distance from it in bytes. arguments are above the base
+	   register, everything else is below it */
+	reg_t base;
+	unsigned offset;
 } loc_t;
 
 typedef struct {
@@ -187,19 +319,28 @@ typedef struct {
 	bool used_registers[LOC_REG_COUNT];
 	unsigned arg_count;
 	unsigned stack_count;
+	/* leaf functions don't set up a frame, and address everything
+	   relative to $sp instead of $fp */
+	bool is_leaf;
 } loc_context_t;
 
-static loc_context_t *loc_context_new()
+static loc_context_t *loc_context_new(bool is_leaf)
 {
 	loc_context_t *l;
 
-	l = calloc(1, sizeof(*l));
+	l = mem_alloc(sizeof(*l));
 
 	l->loc_tab = htab_new(HTAB_DEFAULT_ORDER);
+	l->is_leaf = is_leaf;
 
 	return l;
 }
 
+static reg_t loc_frame_reg(loc_context_t *ctx)
+{
+	return ctx->is_leaf ? REG_SP : REG_FP;
+}
+
 /* look through the current function's list of locations and return
  * one that matches the given key. return NULL if not found */
 static inline loc_t *_L(char *key, loc_context_t *ctx)
@@ -220,12 +361,17 @@ static loc_t *loc_add_real(char *key, loc_context_t *ctx, bool is_arg)
 	loc_t *l;
 	int i;
 
-	l = calloc(1, sizeof(*l));
+	l = mem_alloc(sizeof(*l));
 	l->name = key;
 
 	if(is_arg) {
 		l->type = L_ARGUMENT;
 		l->num = ctx->arg_count;
+		l->base = loc_frame_reg(ctx);
+		l->offset = l->num * BYTES_IN_INTEGER;
+		/* skip the saved $fp and $ra, if there are any */
+		if (!ctx->is_leaf)
+			l->offset += 2 * BYTES_IN_POINTER;
 		ctx->arg_count++;
 		htab_put(ctx->loc_tab, key, (void*)l);
 		return l;
@@ -245,6 +391,8 @@ static loc_t *loc_add_real(char *key, loc_context_t *ctx, bool is_arg)
 		l->type = L_STACK;
 		ctx->stack_count++;
 		l->num = ctx->stack_count;
+		l->base = loc_frame_reg(ctx);
+		l->offset = l->num * BYTES_IN_INTEGER;
 		htab_put(ctx->loc_tab, key, (void*)l);
 		return l;
 	}
@@ -254,12 +402,14 @@ static loc_t *loc_add_array(char *key, type_t *t, loc_context_t *ctx)
 {
 	loc_t *l;
 
-	l = calloc(1, sizeof(*l));
+	l = mem_alloc(sizeof(*l));
 	l->name = key;
 
 	l->type = L_ARRAY;
 	ctx->stack_count += get_size(t);
 	l->num = ctx->stack_count;
+	l->base = loc_frame_reg(ctx);
+	l->offset = l->num * BYTES_IN_INTEGER;
 	htab_put(ctx->loc_tab, key, l);
 
 	return l;
@@ -270,14 +420,48 @@ static loc_t *loc_add(char *key, loc_context_t *ctx)
 	return loc_add_real(key, ctx, false);
 }
 
-static unsigned loc_get_used_mask(loc_context_t *ctx)
+/* gives every value written anywhere in the function a location up front,
+   so that the set of registers in use is known before the first call site
+   is emitted. locations are handed out in the same order emission would
+   otherwise have created them in */
+static void loc_add_cfg(cfg_context_t *cfg, loc_context_t *ctx)
+{
+	list_node_t *n, *n2;
+	bb_node_t *bb;
+	inst_t *i;
+	inst_op_t *def;
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		if (is_dummy(bb))
+			continue;
+
+		LIST_EACH(bb->instructions, n2, i) {
+			def = inst_def(i);
+
+			if (def != NULL && _L_unchecked(def->id, ctx) == NULL)
+				loc_add(def->id, ctx);
+		}
+	}
+}
+
+/* gets the mask of registers holding variables in the given live set */
+static unsigned loc_get_live_mask(cfg_context_t *cfg, loc_context_t *ctx,
+                                  unsigned long *live)
 {
 	unsigned mask = 0;
-	int i;
+	unsigned idx;
+	char *id;
+	loc_t *l;
+
+	for (idx=0; idx<cfg->live->names->size; idx++) {
+		id = vec_get(cfg->live->names, idx);
 
-	for (i=0; i<LOC_REG_COUNT; i++) {
-		if (ctx->used_registers[i])
-			mask |= 1 << (i + LOC_REG_FIRST);
+		if (!live_set_has(cfg, live, id))
+			continue;
+
+		l = _L_unchecked(id, ctx);
+		if (l != NULL && l->type == L_REGISTER)
+			mask |= 1 << l->reg;
 	}
 
 	return mask;
@@ -290,18 +474,17 @@ static reg_t loc_get(reg_t dest, loc_t *l)
 	switch(l->type) {
 	case L_ARGUMENT:
 		_E_EOL("  # argument %s", l->name);
-		_E(TAB "lw %s, %u($fp)", _N(dest), 2 * BYTES_IN_POINTER +
-				l->num * BYTES_IN_INTEGER);
+		_E(TAB "lw %s, %u(%s)", _N(dest), l->offset, _N(l->base));
 		return dest;
 
 	case L_STACK:
 		_E_EOL("  # stack %s", l->name);
-		_E(TAB "lw %s, -%u($fp)", _N(dest), l->num * BYTES_IN_INTEGER);
+		_E(TAB "lw %s, -%u(%s)", _N(dest), l->offset, _N(l->base));
 		return dest;
 
 	case L_ARRAY:
 		_E_EOL("  # array %s", l->name);
-		_E(TAB "addi %s, $fp, -%u", _N(dest), l->num * BYTES_IN_INTEGER);
+		_E(TAB "addi %s, %s, -%u", _N(dest), _N(l->base), l->offset);
 		return dest;
 
 	case L_REGISTER:
@@ -321,13 +504,12 @@ static void loc_store(reg_t source, loc_t *l)
 
 	case L_ARGUMENT:
 		_E_EOL("  # argument %s", l->name);
-		_E(TAB "sw %s, %u($fp)", _N(source), 2 * BYTES_IN_POINTER +
-				l->num * BYTES_IN_INTEGER);
+		_E(TAB "sw %s, %u(%s)", _N(source), l->offset, _N(l->base));
 		return;
 
 	case L_STACK:
 		_E_EOL("  # stack %s", l->name);
-		_E(TAB "sw %s, -%u($fp)", _N(source), l->num * BYTES_IN_INTEGER);
+		_E(TAB "sw %s, -%u(%s)", _N(source), l->offset, _N(l->base));
 		return;
 
 	case L_REGISTER:
@@ -717,17 +899,124 @@ void mips_set1(char *source, char *dest, loc_context_t *ctx)
 	loc_store(rdest, ldest);
 }
 
+static void emit_push_arguments(inst_t *i, loc_context_t *ctx)
+{
+	list_node_t *n;
+	inst_op_t *arg;
+	unsigned idx = 0;
+	reg_t r;
+
+	_E(TAB "addi $sp, $sp, -%u", i->c.args->length * BYTES_IN_INTEGER);
+
+	LIST_EACH(i->c.args, n, arg) {
+		if (arg->is_val) {
+			_E(TAB "addi %s, $zero, %d", _N(REG_T0), arg->val);
+			r = REG_T0;
+		} else {
+			r = loc_get(REG_T0, _L(arg->id, ctx));
+		}
+
+		_E(TAB "sw %s, %u($sp)", _N(r), idx * BYTES_IN_INTEGER);
+		idx++;
+	}
+}
+
+/* determines if the argument is read from some other argument's slot,
+   which would be overwritten when passing arguments in place */
+static bool arg_moves(inst_op_t *arg, unsigned idx, loc_context_t *ctx)
+{
+	loc_t *l;
+
+	if (arg->is_val)
+		return false;
+
+	l = _L(arg->id, ctx);
+	return l->type == L_ARGUMENT && l->num != idx;
+}
+
+/* a call in tail position writes its arguments over the caller's own,
+   pops the caller's frame, and jumps, so the callee returns straight to
+   the caller's caller. nothing is live after the call, so no registers
+   are saved. a function making a call is never a leaf, so the frame
+   pointer is always there to find the caller's arguments with */
+static void emit_tail_call(inst_t *i, loc_context_t *ctx)
+{
+	list_node_t *n;
+	inst_op_t *arg;
+	unsigned idx = 0, offset;
+	bool staged = false;
+	loc_t *l;
+	reg_t r;
+
+	LIST_EACH(i->c.args, n, arg) {
+		if (arg_moves(arg, idx++, ctx))
+			staged = true;
+	}
+
+	/* when arguments trade places, they're pushed as for an ordinary
+	   call first, and copied up from there */
+	if (staged) {
+		if (ctx->stack_count) {
+			_E(TAB "addi $sp, $sp, -%u",
+			   ctx->stack_count * BYTES_IN_INTEGER);
+		}
+
+		emit_push_arguments(i, ctx);
+	}
+
+	idx = 0;
+	LIST_EACH(i->c.args, n, arg) {
+		offset = idx * BYTES_IN_INTEGER;
+
+		if (staged) {
+			_E(TAB "lw %s, %u($sp)", _N(REG_T0), offset);
+			r = REG_T0;
+		} else if (arg->is_val) {
+			_E(TAB "addi %s, $zero, %d", _N(REG_T0), arg->val);
+			r = REG_T0;
+		} else {
+			/* already where it needs to be */
+			l = _L(arg->id, ctx);
+			if (l->type == L_ARGUMENT) {
+				idx++;
+				continue;
+			}
+			r = loc_get(REG_T0, l);
+		}
+
+		_E(TAB "sw %s, %u($fp)", _N(r), offset + 2 * BYTES_IN_POINTER);
+		idx++;
+	}
+
+	_E_C("pop the frame, and let the callee return for us");
+	_E(TAB "addi $sp, $fp, %u", 2 * BYTES_IN_POINTER);
+	_E(TAB "lw $ra, 4($fp)");
+	_E(TAB "lw $fp, 0($fp)");
+	_E(TAB "j %s", i->c.fn->mangled_name);
+}
+
+/* determines if the block ends by jumping to another function */
+static bool ends_in_tail_call(bb_node_t *bbn)
+{
+	inst_t *i;
+
+	if (is_dummy(bbn) || bbn->instructions->length == 0)
+		return false;
+
+	i = list_tail(bbn->instructions)->v;
+	return i->type == I_CALL && i->c.tail;
+}
+
 static void emit_bb_body(bb_node_t *bbn, cfg_context_t *cfg, loc_context_t *ctx)
 {
-	list_node_t *n, *argn;
+	list_node_t *n;
 	void *v;
 	inst_t *i;
 	loc_t *l;
 	reg_t r;
-	inst_op_t *arg;
 	symbol_t *sym;
 	char b[512];
-	int idx;
+	unsigned saved;
 
 	if (is_dummy(bbn))
 		return;
@@ -768,8 +1057,14 @@ static void emit_bb_body(bb_node_t *bbn, cfg_context_t *cfg, loc_context_t *ctx)
 				r = loc_get(REG_T0, _L(i->cond.id, ctx));
 				_E_EOL("  # test %s", i->cond.id);
 			}
-			_E(TAB "beq %s, $zero, %s_%i", _N(r), cfg->fn->mangled_name,
-				bbn->fb->label);
+			/* fall through to whichever branch comes next */
+			if (bbn->tb->label == bbn->label + 1) {
+				_E(TAB "beq %s, $zero, %s_%i", _N(r),
+					cfg->fn->mangled_name, bbn->fb->label);
+			} else {
+				_E(TAB "bne %s, $zero, %s_%i", _N(r),
+					cfg->fn->mangled_name, bbn->tb->label);
+			}
 			break;
 
 		case I_ATTRIBUTE:
@@ -851,30 +1146,22 @@ static void emit_bb_body(bb_node_t *bbn, cfg_context_t *cfg, loc_context_t *ctx)
 			_E_LF();
 			_E_C("call %s in %s", i->c.fn->name, i->c.fn->parent->name);
 
-			/* save registers */
+			if (i->c.tail) {
+				emit_tail_call(i, ctx);
+				break;
+			}
+
+			/* save only the registers whose values are still
+			   needed after the call */
+			saved = loc_get_live_mask(cfg, ctx, i->c.live);
+
 			if (ctx->stack_count) {
 				_E(TAB "addi $sp, $sp, -%u",
 				   ctx->stack_count * BYTES_IN_INTEGER);
 			}
-			emit_save_registers(loc_get_used_mask(ctx));
+			emit_save_registers(saved);
 
-			/* pass arguments */
-			_E(TAB "addi $sp, $sp, -%u",
-			   i->c.args->length * BYTES_IN_INTEGER);
-			idx = 0;
-			LIST_EACH(i->c.args, argn, arg) {
-				if (arg->is_val) {
-					_E(TAB "addi %s, $zero, %d",
-					   _N(REG_T0), arg->val);
-					r = REG_T0;
-				} else {
-					r = loc_get(REG_T0, _L(arg->id, ctx));
-				}
-
-				_E(TAB "sw %s, %u($sp)", _N(r),
-				   idx * BYTES_IN_INTEGER);
-				idx++;
-			}
+			emit_push_arguments(i, ctx);
 
 			_E(TAB "jal %s", i->c.fn->mangled_name);
 
@@ -883,7 +1170,7 @@ static void emit_bb_body(bb_node_t *bbn, cfg_context_t *cfg, loc_context_t *ctx)
 			   i->c.args->length * BYTES_IN_INTEGER);
 
 			/* restore registers */
-			emit_restore_registers(loc_get_used_mask(ctx));
+			emit_restore_registers(saved);
 			if (ctx->stack_count) {
 				_E(TAB "addi $sp, $sp, %u",
 				   ctx->stack_count * BYTES_IN_INTEGER);
@@ -953,12 +1240,17 @@ static void emit_bb_body(bb_node_t *bbn, cfg_context_t *cfg, loc_context_t *ctx)
 
 static void emit_bb(bb_node_t *bbn, cfg_context_t *cfg, loc_context_t *ctx)
 {
+	bb_node_t *next;
+
 	_E_LF();
 	_E("%s_%i:", cfg->fn->mangled_name, bbn->label);
 
 	if(!is_dummy(bbn))
 		emit_bb_body(bbn, cfg, ctx);
 
+	if (ends_in_tail_call(bbn))
+		return;
+
 	if(bbn->tb == NULL) {
 		if (bbn->label != cfg->all_bb->length - 1)
 			_E(TAB "j %s_return", cfg->fn->mangled_name);
@@ -966,15 +1258,60 @@ static void emit_bb(bb_node_t *bbn, cfg_context_t *cfg, loc_context_t *ctx)
 		return;
 	}
 
-	if (bbn->label != bbn->tb->label - 1) {
-		_E(TAB "j %s_%i", cfg->fn->mangled_name,
-				bbn->has_condition ? bbn->fb->label
-				: bbn->tb->label);
+	/* a conditional block has already branched to one of its successors,
+	   and continues on to the other */
+	next = bbn->tb;
+	if (bbn->has_condition && bbn->tb->label != bbn->label + 1)
+		next = bbn->fb;
+
+	if (next->label != bbn->label + 1)
+		_E(TAB "j %s_%i", cfg->fn->mangled_name, next->label);
+}
+
+/* a leaf function makes no calls. __builtin_print is reached with a jal,
+   so printing counts as a call too, since it clobbers $ra */
+static bool is_leaf_function(cfg_context_t *cfg)
+{
+	list_node_t *n, *n2;
+	bb_node_t *bb;
+	inst_t *i;
+
+	LIST_EACH(cfg->all_bb, n, bb) {
+		if (is_dummy(bb))
+			continue;
+
+		LIST_EACH(bb->instructions, n2, i) {
+			if (i->type == I_CALL || i->type == I_PRINT)
+				return false;
+		}
 	}
+
+	return true;
 }
 
-static void emit_function_body(func_t *f)
+/* one function's worth of output. functions are compiled independently,
+   possibly by several threads at once, and then written out in order */
+typedef struct fn_job {
+	func_t *fn;
+
+	/* owns everything built while compiling the function */
+	arena_t *arena;
+
+	/* the finished assembly */
+	list_t *lines;
+
+	/* CFG dumps and statistics. this is stderr when compiling serially,
+	   otherwise it's buffered until the job is written out */
+	FILE *log;
+	char *log_buf;
+	size_t log_len;
+
+	bool done;
+} fn_job_t;
+
+static void emit_function_body(fn_job_t *job)
 {
+	func_t *f = job->fn;
 	cfg_context_t *cfg;
 	list_node_t *n;
 	symbol_t *s;
@@ -982,6 +1319,15 @@ static void emit_function_body(func_t *f)
 	int i;
 
 	loc_context_t *lctx;
+	arena_t *arena, *prev_arena;
+	time_pass_t t;
+	bool changed;
+
+	/* everything built for this function, from the CFG to the buffered
+	   assembly, is thrown away once it has been written out */
+	arena = arena_new();
+	prev_arena = arena_enter(arena);
+	job->arena = arena;
 
 	_E_LF();
 	_E_LF();
@@ -989,27 +1335,68 @@ static void emit_function_body(func_t *f)
 	_E_C("%s in %s", f->name, f->parent->name);
 	_E_C("");
 
+	cfg_pass_begin(&t, NULL);
 	cfg = func_to_cfg(f);
+	cfg_pass_end(&t, "func_to_cfg", cfg);
+
 	do {
+		cfg_pass_begin(&t, cfg);
 		value_numbering_extended(cfg);
-	} while (eliminate_redundant_temporaries(cfg));
-	fprintf(stderr, "\n\x1b[1;33m%s.%s:\x1b[0m\n", f->parent->name, f->name);
-	dump_cfg(cfg);
+		cfg_pass_end(&t, "value_numbering_extended", cfg);
+
+		cfg_pass_begin(&t, cfg);
+		changed = eliminate_redundant_temporaries(cfg);
+		cfg_pass_end(&t, "eliminate_redundant_temporaries", cfg);
+	} while (changed);
+
+	if (cg_tail_calls) {
+		cfg_pass_begin(&t, cfg);
+		eliminate_tail_calls(cfg);
+		cfg_pass_end(&t, "eliminate_tail_calls", cfg);
+	}
+
+	if (cg_dce) {
+		cfg_pass_begin(&t, cfg);
+		eliminate_dead_code(cfg);
+		cfg_pass_end(&t, "eliminate_dead_code", cfg);
+	}
+
+	if (cg_layout) {
+		cfg_pass_begin(&t, cfg);
+		layout_blocks(cfg);
+		cfg_pass_end(&t, "layout_blocks", cfg);
+	}
+
+	if (cg_verbose) {
+		fprintf(job->log, "\n\x1b[1;33m%s.%s:\x1b[0m\n",
+		        f->parent->name, f->name);
+		dump_cfg(cfg, job->log);
+	}
+
+	cfg_pass_begin(&t, cfg);
+	compute_liveness(cfg);
+	cfg_pass_end(&t, "compute_liveness", cfg);
+
+	asm_pass_begin(&t);
 
 	/**************
 	 *  preamble  *
 	 **************/
 
+	lctx = loc_context_new(is_leaf_function(cfg));
+
 	_E_LF();
 	_E("%s:", f->mangled_name);
-	_E_C("save old frame pointer and current return address");
-	_E(TAB "addi $sp, $sp, -8");
-	_E(TAB "sw $fp, 0($sp)");
-	_E(TAB "sw $ra, 4($sp)");
-	_E_C("stack pointer becomes frame pointer");
-	_E(TAB "add $fp, $zero, $sp");
-
-	lctx = loc_context_new();
+	if (lctx->is_leaf) {
+		_E_C("leaf function, no frame needed");
+	} else {
+		_E_C("save old frame pointer and current return address");
+		_E(TAB "addi $sp, $sp, -8");
+		_E(TAB "sw $fp, 0($sp)");
+		_E(TAB "sw $ra, 4($sp)");
+		_E_C("stack pointer becomes frame pointer");
+		_E(TAB "add $fp, $zero, $sp");
+	}
 
 	/* return value has same name as function */
 	loc_add(f->name, lctx);
@@ -1028,6 +1415,9 @@ static void emit_function_body(func_t *f)
 		}
 	}
 
+	/* and for every temporary */
+	loc_add_cfg(cfg, lctx);
+
 	/***********
 	 *  amble  *
 	 ***********/
@@ -1044,29 +1434,142 @@ static void emit_function_body(func_t *f)
 	 ****************/
 
 	reg_t r = loc_get(REG_T0, _L(f->name, lctx));
+	unsigned eliminated;
 
 	_E_LF();
 	_E("%s_return:", f->mangled_name);
 	_E_C("copy return value into v0");
 	_E(TAB "add $v0, $zero, %s", _N(r));
-	_E_C("restore frame ptr, return address, and return");
-	_E(TAB "lw $fp, 0($sp)");
-	_E(TAB "lw $ra, 4($sp)");
-	_E(TAB "addi $sp, $sp, 8");
+	if (lctx->is_leaf) {
+		_E_C("return");
+	} else {
+		_E_C("restore frame ptr, return address, and return");
+		_E(TAB "lw $fp, 0($sp)");
+		_E(TAB "lw $ra, 4($sp)");
+		_E(TAB "addi $sp, $sp, 8");
+	}
 	_E(TAB "jr $ra");
+
+	asm_pass_end(&t, "emit_bb");
+
+	if (cg_peephole) {
+		asm_pass_begin(&t);
+		eliminated = mips_peephole(lines);
+		asm_pass_end(&t, "mips_peephole");
+		if (cg_verbose) {
+			fprintf(job->log, "  \x1b[1mpeephole:\x1b[0m %u "
+			        "instructions eliminated\n", eliminated);
+		}
+	}
+
+	_E_finish();
+	job->lines = lines;
+	lines = NULL;
+
+	arena_leave(prev_arena);
+}
+
+/* writes out a finished job and throws it away */
+static void emit_job_output(fn_job_t *job)
+{
+	if (job->log != stderr) {
+		fclose(job->log);
+		fwrite(job->log_buf, 1, job->log_len, stderr);
+		free(job->log_buf);
+	}
+
+	_E_write(job->lines);
+	arena_release(job->arena);
 }
 
-static void emit_class(void *_p, char *name, void *_t)
+static void collect_class(void *_jobs, char *name, void *_t)
 {
+	vec_t *jobs = _jobs;
 	type_t *t = _t;
 	list_node_t *n;
+	fn_job_t *job;
 	func_t *fn;
 
 	if (t->tag != T_CLASS)
 		return;
 
-	LIST_EACH(t->cls->functions, n, fn)
-		emit_function_body(fn);
+	LIST_EACH(t->cls->functions, n, fn) {
+		job = mem_alloc(sizeof(*job));
+		job->fn = fn;
+		vec_append(jobs, job);
+	}
+}
+
+struct fn_pool {
+	vec_t *jobs;
+	unsigned next;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void *fn_worker(void *_pool)
+{
+	struct fn_pool *pool = _pool;
+	fn_job_t *job;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		job = vec_get(pool->jobs, pool->next++);
+		pthread_mutex_unlock(&pool->lock);
+
+		if (job == NULL)
+			break;
+
+		job->log = open_memstream(&job->log_buf, &job->log_len);
+		emit_function_body(job);
+
+		pthread_mutex_lock(&pool->lock);
+		job->done = true;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+/* compiles every function on cg_jobs threads, writing each one out as soon
+   as it and all the functions before it are done, so the output is the
+   same as when compiling serially */
+static void emit_functions_parallel(vec_t *jobs)
+{
+	struct fn_pool pool;
+	pthread_t *threads;
+	unsigned i, nthreads;
+	fn_job_t *job;
+
+	pool.jobs = jobs;
+	pool.next = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	nthreads = cg_jobs < jobs->size ? cg_jobs : jobs->size;
+	threads = calloc(nthreads, sizeof(*threads));
+
+	for (i=0; i<nthreads; i++)
+		pthread_create(&threads[i], NULL, fn_worker, &pool);
+
+	for (i=0; i<jobs->size; i++) {
+		job = vec_get(jobs, i);
+
+		pthread_mutex_lock(&pool.lock);
+		while (!job->done)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		pthread_mutex_unlock(&pool.lock);
+
+		emit_job_output(job);
+	}
+
+	for (i=0; i<nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.lock);
 }
 
 static bool locate_main(prog_t *p, type_t **m_cls, func_t **m_fn)
@@ -1109,11 +1612,31 @@ static void emit_footer(prog_t *p)
 	emit_exit();
 }
 
-void mips_emit_program(prog_t *p)
+void mips_emit_program(prog_t *p, FILE *out)
 {
+	vec_t *jobs;
+	fn_job_t *job;
+	unsigned i;
+
+	output = out;
+
 	emit_header();
+	_E_flush();
+
+	jobs = vec_new(16);
+	htab_each(p->types, collect_class, jobs);
 
-	htab_each(p->types, emit_class, p);
+	if (cg_jobs > 1 && jobs->size > 1) {
+		emit_functions_parallel(jobs);
+	} else {
+		for (i=0; i<jobs->size; i++) {
+			job = vec_get(jobs, i);
+			job->log = stderr;
+			emit_function_body(job);
+			emit_job_output(job);
+		}
+	}
 
 	emit_footer(p);
+	_E_flush();
 }
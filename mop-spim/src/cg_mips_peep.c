@@ -0,0 +1,747 @@
+/*
+ * CSE 440, Project 3
+ * Mini Object Pascal MIPS Peephole Optimizer
+ *
+ * Alex Iadicicco
+ * shmibs
+ */
+
+/* The code generator works one IR instruction at a time, and every value
+   makes its way through $t0-$t2 on its way between locations, so the
+   emitted code is full of little redundancies that are only visible once
+   the instructions are sitting next to each other: moves of a register to
+   itself, loads of a slot that was just stored to, the same array base
+   address being computed again and again, jumps to the very next line, and
+   so on.
+
+   The optimizer works on the parsed text of the emitted lines. Everything it
+   needs to know about a mnemonic lives in the op_info table below, and each
+   optimization is a rule in the peep_rules table. A rule looks at the
+   instruction at the current position, and possibly those following it, and
+   either rewrites or deletes some of them. Labels are never crossed, since
+   control could arrive at them from elsewhere. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+#include "error.h"
+#include "cg.h"
+
+#define DEBUG(X...) fprintf(stderr, X)
+#undef DEBUG
+#define DEBUG(X...)
+
+/****************************************************************************
+ **  PARSING                                                               **
+ ****************************************************************************/
+
+static char *trim(char *s)
+{
+	char *e;
+
+	while (isspace(*s))
+		s++;
+
+	e = s + strlen(s);
+	while (e > s && isspace(e[-1]))
+		*--e = '\0';
+
+	return s;
+}
+
+static void asm_line_parse(asm_line_t *line)
+{
+	char *s, *p;
+
+	line->op = NULL;
+	line->nargs = 0;
+
+	strcpy(line->buf, line->text);
+
+	/* anything after a # is a comment, even mid-line */
+	if ((p = strchr(line->buf, '#')) != NULL)
+		*p = '\0';
+	s = trim(line->buf);
+
+	if (*s == '\0') {
+		line->kind = line->text[0] ? ASM_COMMENT : ASM_BLANK;
+		return;
+	}
+
+	if (*s == '.') {
+		line->kind = ASM_DIRECTIVE;
+		return;
+	}
+
+	if (s[strlen(s) - 1] == ':') {
+		line->kind = ASM_LABEL;
+		s[strlen(s) - 1] = '\0';
+		line->op = s;
+		return;
+	}
+
+	line->kind = ASM_INST;
+	line->op = s;
+
+	while (*s && !isspace(*s))
+		s++;
+	if (*s == '\0')
+		return;
+	*s++ = '\0';
+
+	while (line->nargs < 3) {
+		p = strchr(s, ',');
+		if (p != NULL)
+			*p = '\0';
+
+		line->args[line->nargs++] = trim(s);
+
+		if (p == NULL)
+			break;
+		s = p + 1;
+	}
+}
+
+void asm_line_set_text(asm_line_t *line, const char *text)
+{
+	size_t len = strlen(text) + 1;
+
+	/* the old text's op and args are no longer needed */
+	mem_free(line->text);
+
+	line->text = mem_alloc(2 * len);
+	line->buf = line->text + len;
+	memcpy(line->text, text, len);
+
+	asm_line_parse(line);
+}
+
+void asm_line_free(asm_line_t *line)
+{
+	mem_free(line->text);
+	mem_free(line->comment);
+	mem_free(line);
+}
+
+/* replaces the instruction on the line, keeping its comment */
+static void asm_line_set(asm_line_t *line, const char *fmt, ...)
+{
+	char text[ASM_LINE_MAX];
+	va_list va;
+
+	va_start(va, fmt);
+	vsnprintf(text, ASM_LINE_MAX, fmt, va);
+	va_end(va);
+
+	asm_line_set_text(line, text);
+}
+
+/****************************************************************************
+ **  INSTRUCTION PROPERTIES                                                **
+ ****************************************************************************/
+
+#define OP_DEF0      0x001 /* writes the register in args[0] */
+#define OP_USE0      0x002 /* reads the register in args[0] */
+#define OP_USE1      0x004 /* reads the register in args[1] */
+#define OP_USE2      0x008 /* reads the register in args[2] */
+#define OP_MEM_READ  0x010 /* args[1] is a memory operand, which is read */
+#define OP_MEM_WRITE 0x020 /* args[1] is a memory operand, which is written */
+#define OP_HILO_DEF  0x040 /* writes $hi and $lo */
+#define OP_HILO_USE  0x080 /* reads $hi or $lo */
+#define OP_BRANCH    0x100 /* transfers control */
+#define OP_BARRIER   0x200 /* may do anything at all to registers and memory */
+#define OP_PSEUDO    0x400 /* may be more than one machine instruction */
+
+struct op_info {
+	const char *name;
+	unsigned flags;
+};
+
+static const struct op_info op_info[] = {
+	{ "add",     OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "addu",    OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "addi",    OP_DEF0 | OP_USE1 },
+	{ "addiu",   OP_DEF0 | OP_USE1 },
+	{ "sub",     OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "subu",    OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "and",     OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "andi",    OP_DEF0 | OP_USE1 },
+	{ "or",      OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "ori",     OP_DEF0 | OP_USE1 },
+	{ "xor",     OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "xori",    OP_DEF0 | OP_USE1 },
+	{ "slt",     OP_DEF0 | OP_USE1 | OP_USE2 },
+	{ "slti",    OP_DEF0 | OP_USE1 },
+	{ "sll",     OP_DEF0 | OP_USE1 },
+	{ "mult",    OP_USE0 | OP_USE1 | OP_HILO_DEF },
+	{ "multu",   OP_USE0 | OP_USE1 | OP_HILO_DEF },
+	{ "div",     OP_USE0 | OP_USE1 | OP_HILO_DEF },
+	{ "mflo",    OP_DEF0 | OP_HILO_USE },
+	{ "mfhi",    OP_DEF0 | OP_HILO_USE },
+	{ "lw",      OP_DEF0 | OP_MEM_READ },
+	{ "sw",      OP_USE0 | OP_MEM_WRITE },
+	{ "move",    OP_DEF0 | OP_USE1 },
+	{ "la",      OP_DEF0 | OP_PSEUDO },
+	{ "li",      OP_DEF0 | OP_PSEUDO },
+	{ "nop",     0 },
+	{ "j",       OP_BRANCH },
+	{ "beq",     OP_USE0 | OP_USE1 | OP_BRANCH },
+	{ "bne",     OP_USE0 | OP_USE1 | OP_BRANCH },
+	{ "jal",     OP_BRANCH | OP_BARRIER },
+	{ "jr",      OP_USE0 | OP_BRANCH | OP_BARRIER },
+	{ "syscall", OP_BARRIER },
+	{ NULL,      0 }
+};
+
+static unsigned op_flags(asm_line_t *line)
+{
+	int i;
+
+	if (line->kind != ASM_INST)
+		return 0;
+
+	for (i=0; op_info[i].name; i++) {
+		if (!strcmp(op_info[i].name, line->op))
+			return op_info[i].flags;
+	}
+
+	/* if we don't know what it is, assume the worst */
+	return OP_BARRIER | OP_PSEUDO;
+}
+
+static bool is_reg(const char *arg)
+{
+	return arg[0] == '$';
+}
+
+/* copies the base register out of a memory operand like 12($fp) */
+static void mem_base(const char *arg, char *out, size_t n)
+{
+	const char *p = strchr(arg, '(');
+	size_t len;
+
+	out[0] = '\0';
+	if (p == NULL)
+		return;
+
+	p++;
+	len = strcspn(p, ")");
+	if (len >= n)
+		len = n - 1;
+	memcpy(out, p, len);
+	out[len] = '\0';
+}
+
+/* the register written by the instruction, or NULL */
+static const char *inst_writes(asm_line_t *line)
+{
+	if (!(op_flags(line) & OP_DEF0) || line->nargs < 1)
+		return NULL;
+
+	return line->args[0];
+}
+
+/* determines if the instruction reads the given register */
+static bool inst_reads(asm_line_t *line, const char *reg)
+{
+	unsigned flags = op_flags(line);
+	char base[32];
+	int i;
+
+	if (flags & OP_BARRIER)
+		return true;
+
+	for (i=0; i<line->nargs && i<3; i++) {
+		if ((flags & (OP_USE0 << i)) && !strcmp(line->args[i], reg))
+			return true;
+	}
+
+	if ((flags & (OP_MEM_READ | OP_MEM_WRITE)) && line->nargs > 1) {
+		mem_base(line->args[1], base, sizeof base);
+		if (!strcmp(base, reg))
+			return true;
+	}
+
+	return false;
+}
+
+/* determines if the instruction could change the given register */
+static bool inst_clobbers(asm_line_t *line, const char *reg)
+{
+	const char *w;
+
+	if (op_flags(line) & OP_BARRIER)
+		return true;
+
+	w = inst_writes(line);
+	return w != NULL && !strcmp(w, reg);
+}
+
+/* determines if every immediate and offset fits in 16 bits, so the
+   instruction is really just one machine instruction */
+static bool fits_one_inst(asm_line_t *line)
+{
+	long v, lo = -32768, hi = 32767;
+	int i;
+
+	/* logical immediates are zero extended instead */
+	if (!strcmp(line->op, "andi") || !strcmp(line->op, "ori") ||
+	    !strcmp(line->op, "xori")) {
+		lo = 0;
+		hi = 65535;
+	}
+
+	for (i=0; i<line->nargs; i++) {
+		if (is_reg(line->args[i]))
+			continue;
+		if (!isdigit(line->args[i][0]) && line->args[i][0] != '-')
+			continue;
+
+		v = strtol(line->args[i], NULL, 10);
+		if (v < lo || v > hi)
+			return false;
+	}
+
+	return true;
+}
+
+static bool is_zero(const char *arg)
+{
+	return !strcmp(arg, "0") || !strcmp(arg, "-0");
+}
+
+/* determines if the instruction is 'move dst, src', in any of its
+   disguises, filling in dst and src */
+static bool is_move(asm_line_t *line, char **dst, char **src)
+{
+	if (line->kind != ASM_INST || line->nargs < 2)
+		return false;
+
+	if (!strcmp(line->op, "move")) {
+		*dst = line->args[0];
+		*src = line->args[1];
+		return true;
+	}
+
+	if (line->nargs != 3)
+		return false;
+
+	if ((!strcmp(line->op, "add") || !strcmp(line->op, "addu") ||
+	     !strcmp(line->op, "or")) && !strcmp(line->args[1], "$zero")) {
+		*dst = line->args[0];
+		*src = line->args[2];
+		return true;
+	}
+
+	if ((!strcmp(line->op, "addi") || !strcmp(line->op, "addiu")) &&
+	    is_zero(line->args[2])) {
+		*dst = line->args[0];
+		*src = line->args[1];
+		return true;
+	}
+
+	return false;
+}
+
+/****************************************************************************
+ **  WALKING THE LINES                                                     **
+ ****************************************************************************/
+
+#define LINE(n) ((asm_line_t*) (n)->v)
+
+/* finds the next instruction after n. if a label is seen first, NULL is
+   returned, unless cross_labels is set */
+static list_node_t *next_inst(list_t *lines, list_node_t *n, bool cross_labels)
+{
+	for (n = n->next; n != &lines->root; n = n->next) {
+		switch (LINE(n)->kind) {
+		case ASM_INST:
+			return n;
+
+		case ASM_LABEL:
+		case ASM_DIRECTIVE:
+			if (!cross_labels)
+				return NULL;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* finds the instruction before n, stopping at labels */
+static list_node_t *prev_inst(list_t *lines, list_node_t *n)
+{
+	for (n = n->prev; n != &lines->root; n = n->prev) {
+		switch (LINE(n)->kind) {
+		case ASM_INST:
+			return n;
+
+		case ASM_LABEL:
+		case ASM_DIRECTIVE:
+			return NULL;
+
+		default:
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void delete_line(list_t *lines, list_node_t *n)
+{
+	DEBUG("    peephole: deleting '%s'\n", LINE(n)->text);
+
+	asm_line_free(n->v);
+	list_delete(lines, n);
+}
+
+/****************************************************************************
+ **  RULES                                                                 **
+ ****************************************************************************/
+
+/* each rule returns the number of instructions it eliminated, or -1 if it
+   changed something without eliminating anything. 0 means no match */
+
+/* move x, x  ->  (nothing) */
+static int peep_self_move(list_t *lines, list_node_t *n)
+{
+	char *dst, *src;
+
+	if (!is_move(LINE(n), &dst, &src) || strcmp(dst, src))
+		return 0;
+
+	delete_line(lines, n);
+	return 1;
+}
+
+/* move x, y; move y, x  ->  move x, y */
+static int peep_move_back(list_t *lines, list_node_t *n)
+{
+	list_node_t *n2;
+	char *d1, *s1, *d2, *s2;
+
+	if (!is_move(LINE(n), &d1, &s1))
+		return 0;
+	if ((n2 = next_inst(lines, n, false)) == NULL)
+		return 0;
+	if (!is_move(LINE(n2), &d2, &s2))
+		return 0;
+	if (strcmp(d1, s2) || strcmp(s1, d2))
+		return 0;
+
+	delete_line(lines, n2);
+	return 1;
+}
+
+/* sw x, M; lw y, M  ->  sw x, M; move y, x */
+static int peep_load_after_store(list_t *lines, list_node_t *n)
+{
+	asm_line_t *st = LINE(n), *ld;
+	list_node_t *n2;
+
+	if (st->kind != ASM_INST || strcmp(st->op, "sw") || st->nargs != 2)
+		return 0;
+	if ((n2 = next_inst(lines, n, false)) == NULL)
+		return 0;
+
+	ld = LINE(n2);
+	if (strcmp(ld->op, "lw") || ld->nargs != 2)
+		return 0;
+	if (strcmp(st->args[1], ld->args[1]))
+		return 0;
+
+	if (!strcmp(st->args[0], ld->args[0])) {
+		delete_line(lines, n2);
+		return 1;
+	}
+
+	asm_line_set(ld, "\tadd %s, $zero, %s", ld->args[0], st->args[0]);
+	return -1;
+}
+
+/* lw x, M; sw x, M  ->  lw x, M */
+static int peep_store_after_load(list_t *lines, list_node_t *n)
+{
+	asm_line_t *ld = LINE(n), *st;
+	list_node_t *n2;
+	char base[32];
+
+	if (ld->kind != ASM_INST || strcmp(ld->op, "lw") || ld->nargs != 2)
+		return 0;
+	if ((n2 = next_inst(lines, n, false)) == NULL)
+		return 0;
+
+	st = LINE(n2);
+	if (strcmp(st->op, "sw") || st->nargs != 2)
+		return 0;
+	if (strcmp(st->args[0], ld->args[0]) || strcmp(st->args[1], ld->args[1]))
+		return 0;
+
+	/* lw $t0, 0($t0) changes the address */
+	mem_base(ld->args[1], base, sizeof base);
+	if (!strcmp(base, ld->args[0]))
+		return 0;
+
+	delete_line(lines, n2);
+	return 1;
+}
+
+/* addi $sp, $sp, a; addi $sp, $sp, b  ->  addi $sp, $sp, a+b */
+static int peep_merge_sp(list_t *lines, list_node_t *n)
+{
+	asm_line_t *a = LINE(n), *b;
+	list_node_t *n2;
+	long sum;
+
+	if (a->kind != ASM_INST || strcmp(a->op, "addi") || a->nargs != 3)
+		return 0;
+	if (strcmp(a->args[0], "$sp") || strcmp(a->args[1], "$sp"))
+		return 0;
+	if ((n2 = next_inst(lines, n, false)) == NULL)
+		return 0;
+
+	b = LINE(n2);
+	if (strcmp(b->op, "addi") || b->nargs != 3)
+		return 0;
+	if (strcmp(b->args[0], "$sp") || strcmp(b->args[1], "$sp"))
+		return 0;
+
+	sum = strtol(a->args[2], NULL, 10) + strtol(b->args[2], NULL, 10);
+	delete_line(lines, n2);
+
+	if (sum == 0) {
+		delete_line(lines, n);
+		return 2;
+	}
+
+	asm_line_set(a, "\taddi $sp, $sp, %ld", sum);
+	return 1;
+}
+
+/* x = f(y); ...; x = f(y)  ->  x = f(y); ...
+
+   as long as nothing in between changes x or y (or memory, if f reads it),
+   the second computation is pointless. $t0-$t2 get the same array base or
+   argument loaded into them over and over, so this fires a lot */
+static int peep_recompute(list_t *lines, list_node_t *n)
+{
+	asm_line_t *a = LINE(n), *b;
+	list_node_t *n2;
+	const char *dst;
+	unsigned flags;
+	int i;
+
+	flags = op_flags(a);
+	if (flags & (OP_BARRIER | OP_BRANCH | OP_HILO_USE | OP_MEM_WRITE))
+		return 0;
+	if ((dst = inst_writes(a)) == NULL)
+		return 0;
+
+	/* x = x + 1 is not the same thing twice */
+	if (inst_reads(a, dst))
+		return 0;
+
+	for (n2 = next_inst(lines, n, false); n2 != NULL;
+	     n2 = next_inst(lines, n2, false)) {
+		b = LINE(n2);
+
+		if (!strcmp(a->text, b->text)) {
+			delete_line(lines, n2);
+			return 1;
+		}
+
+		if (op_flags(b) & (OP_BARRIER | OP_BRANCH))
+			return 0;
+		if ((flags & OP_MEM_READ) && (op_flags(b) & OP_MEM_WRITE))
+			return 0;
+		if (inst_clobbers(b, dst))
+			return 0;
+
+		for (i=1; i<a->nargs; i++) {
+			if (is_reg(a->args[i]) && inst_clobbers(b, a->args[i]))
+				return 0;
+		}
+		if (flags & OP_MEM_READ) {
+			char base[32];
+
+			mem_base(a->args[1], base, sizeof base);
+			if (inst_clobbers(b, base))
+				return 0;
+		}
+	}
+
+	return 0;
+}
+
+/* j L; L:  ->  L: */
+static int peep_jump_to_next(list_t *lines, list_node_t *n)
+{
+	asm_line_t *j = LINE(n);
+	const char *target;
+	list_node_t *n2;
+
+	if (j->kind != ASM_INST)
+		return 0;
+
+	if (!strcmp(j->op, "j") && j->nargs == 1)
+		target = j->args[0];
+	else if ((!strcmp(j->op, "beq") || !strcmp(j->op, "bne")) && j->nargs == 3)
+		target = j->args[2];
+	else
+		return 0;
+
+	for (n2 = n->next; n2 != &lines->root; n2 = n2->next) {
+		switch (LINE(n2)->kind) {
+		case ASM_INST:
+		case ASM_DIRECTIVE:
+			return 0;
+
+		case ASM_LABEL:
+			if (!strcmp(LINE(n2)->op, target)) {
+				delete_line(lines, n);
+				return 1;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+struct peep_rule {
+	const char *name;
+	int (*apply)(list_t *lines, list_node_t *n);
+};
+
+static const struct peep_rule peep_rules[] = {
+	{ "self move",         peep_self_move },
+	{ "move back",         peep_move_back },
+	{ "load after store",  peep_load_after_store },
+	{ "store after load",  peep_store_after_load },
+	{ "merge $sp",         peep_merge_sp },
+	{ "recompute",         peep_recompute },
+	{ "jump to next",      peep_jump_to_next },
+	{ NULL,                NULL }
+};
+
+unsigned mips_peephole(list_t *lines)
+{
+	list_node_t *n, *prev;
+	unsigned eliminated = 0;
+	bool changed;
+	int i, r;
+
+	do {
+		changed = false;
+
+		for (n = lines->root.next; n != &lines->root; ) {
+			if (LINE(n)->kind != ASM_INST) {
+				n = n->next;
+				continue;
+			}
+
+			/* rules only ever delete n or lines after it */
+			prev = n->prev;
+
+			for (i=0; peep_rules[i].name; i++) {
+				if ((r = peep_rules[i].apply(lines, n)) != 0)
+					break;
+			}
+
+			if (r == 0) {
+				n = n->next;
+				continue;
+			}
+
+			DEBUG("    peephole: %s\n", peep_rules[i].name);
+
+			if (r > 0)
+				eliminated += r;
+			changed = true;
+			n = prev->next;
+		}
+	} while (changed);
+
+	return eliminated;
+}
+
+/****************************************************************************
+ **  DELAY SLOTS                                                           **
+ ****************************************************************************/
+
+/* on real MIPS hardware, the instruction after a branch is executed before
+   the branch takes effect. the simplest thing to do is put a nop there, but
+   usually the instruction just before the branch can be moved into the slot
+   instead, as long as the branch doesn't depend on it */
+
+static bool can_fill_slot(asm_line_t *branch, asm_line_t *cand)
+{
+	const char *w = inst_writes(cand);
+	int i;
+
+	if (op_flags(cand) & (OP_BRANCH | OP_BARRIER | OP_PSEUDO))
+		return false;
+	if (!fits_one_inst(cand))
+		return false;
+
+	/* the branch can't depend on what the candidate writes */
+	for (i=0; w != NULL && i<branch->nargs; i++) {
+		if (!strcmp(branch->args[i], w))
+			return false;
+	}
+
+	/* and the candidate can't care that jal changed $ra */
+	if (!strcmp(branch->op, "jal") &&
+	    (inst_reads(cand, "$ra") || (w != NULL && !strcmp(w, "$ra"))))
+		return false;
+
+	return true;
+}
+
+/* determines if the instruction is sitting in another branch's slot */
+static bool in_delay_slot(list_t *lines, list_node_t *n)
+{
+	list_node_t *p = prev_inst(lines, n);
+
+	return p != NULL && (op_flags(LINE(p)) & OP_BRANCH);
+}
+
+void mips_fill_delay_slots(list_t *lines)
+{
+	list_node_t *n, *p;
+	asm_line_t *nop;
+
+	LIST_EACH_NODE(lines, n) {
+		if (!(op_flags(LINE(n)) & OP_BRANCH))
+			continue;
+
+		p = prev_inst(lines, n);
+
+		if (p != NULL && !in_delay_slot(lines, p) &&
+		    can_fill_slot(LINE(n), LINE(p))) {
+			/* unlink p and put it after the branch */
+			list_add_after(lines, n, p->v);
+			list_delete(lines, p);
+		} else {
+			nop = mem_alloc(sizeof(*nop));
+			memset(nop, 0, sizeof(*nop));
+			nop->comment = mem_strdup("  # delay slot");
+			asm_line_set_text(nop, "\tnop");
+			list_add_after(lines, n, nop);
+		}
+
+		/* skip over the slot */
+		n = n->next;
+	}
+}
@@ -9,6 +9,7 @@
 /* assorted containers */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
@@ -26,73 +27,176 @@ static int nibble(char *s, int nibnum)
 	}
 }
 
-typedef unsigned long hash_t;
-typedef unsigned char octet_t;
+typedef uint64_t hash_t;
 
-/* we have to implement as follows so that FNV works on both 32 and 64 bit
-   systems. not that bad, it just means that the multiply by prime step is
-   a little more complicated than it needs to be.
+/* a simple multiplicative hash that consumes the key a word at a time.
+   the old byte-at-a-time FNV-1a spent most of its time emulating a 64 bit
+   multiply with octet arithmetic so that it would work on 32 bit systems,
+   which is silly now that every compiler we care about has uint64_t.
 
-   all 8 octet vectors are big-endian representations of their 64 bit
-   counterparts
+   each word is mixed before it's folded in so that keys which differ only
+   in their high bytes still spread out, and the result gets a final
+   avalanche step since the table indexes with the low bits. */
 
-   i don't know if this implementation of FNV-1a is exactly to spec or not,
-   but it seems to act like a good hash function so i'm allowing it */
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+#define HASH_MUL  0xff51afd7ed558ccdULL
 
-static const octet_t FNV_OFFSET_BASIS[8] =
-	{ 0xcb, 0xf2, 0x9c, 0xe4, 0x84, 0x22, 0x23, 0x25 };
+static inline hash_t hash_word(hash_t h, uint64_t w)
+{
+	w *= HASH_MUL;
+	w ^= w >> 32;
+	return (h ^ w) * HASH_SEED;
+}
 
-static hash_t fnv1a(void *_s, unsigned len)
+static hash_t hash_str(const char *s, size_t len)
 {
-	octet_t hash[8], product[8];
-	octet_t *s = (octet_t*)_s;
-	unsigned carry;
-	int i;
+	hash_t h = HASH_SEED ^ len;
+	uint64_t w;
+
+	for (; len >= sizeof(w); s += sizeof(w), len -= sizeof(w)) {
+		memcpy(&w, s, sizeof(w));
+		h = hash_word(h, w);
+	}
+
+	if (len > 0) {
+		w = 0;
+		memcpy(&w, s, len);
+		h = hash_word(h, w);
+	}
 
-	for (i=0; i<8; i++)
-		hash[i] = FNV_OFFSET_BASIS[i];
+	h ^= h >> 33;
+	h *= HASH_MUL;
+	h ^= h >> 29;
 
-	while (len--) {
-		/* xor next octet in. easy */
-		hash[7] ^= *s;
+	return h;
+}
+
+/*
+ * arenas
+ */
 
-		/* multiply by the prime. not so easy */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN      16
+
+typedef struct arena_chunk arena_chunk_t;
+
+struct arena_chunk {
+	arena_chunk_t *next;
+	size_t size, used;
+	_Alignas(ARENA_ALIGN) unsigned char data[];
+};
 
-		/* the prime p is 0x100000001b3, which equals (1<<40) +
-		   (1<<8) + (0xb3). so to compute h * p, we distribute h
-		   across the summands and add those */
+struct arena {
+	arena_chunk_t *chunks;
+	size_t total;
+};
+
+/* each thread has its own current arena */
+static __thread arena_t *arena_current = NULL;
+
+arena_t *arena_new(void)
+{
+	return calloc(1, sizeof(arena_t));
+}
+
+void arena_release(arena_t *a)
+{
+	arena_chunk_t *cur, *next;
+
+	for (cur = a->chunks; cur; cur = next) {
+		next = cur->next;
+		free(cur);
+	}
+
+	free(a);
+}
+
+void *arena_alloc(arena_t *a, size_t size)
+{
+	arena_chunk_t *c = a->chunks;
+	void *p;
 
-		for (i=1; i<8; i++) /* 1<<8 */
-			product[i - 1] = hash[i];
-		product[7] = 0x00;
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
 
-		for (i=5; i<8; i++) /* 1<<40 */
-			product[i - 5] += hash[i];
+	if (c == NULL || c->used + size > c->size) {
+		size_t csize = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
 
-		carry = 0;
-		for (i=8; --i>0; ) { /* 0xb3 */
-			carry = hash[i] * 0xb3 + carry;
-			product[i] += carry & 0xff;
-			carry >>= 8;
+		/* an oversized request gets a chunk of its own, placed behind
+		   the current one so the space left in that isn't wasted */
+		if ((c = malloc(sizeof(*c) + csize)) == NULL)
+			abort();
+		c->size = csize;
+		c->used = 0;
+
+		if (size > ARENA_CHUNK_SIZE && a->chunks) {
+			c->next = a->chunks->next;
+			a->chunks->next = c;
+		} else {
+			c->next = a->chunks;
+			a->chunks = c;
 		}
 
-		for (i=0; i<8; i++)
-			hash[i] = product[i];
+		a->total += csize;
 	}
 
-	/*
-	for (i=0; i<8; i++)
-		printf("%02x", hash[i]);
-	printf("\n");
-	*/
+	p = c->data + c->used;
+	c->used += size;
+
+	return memset(p, 0, size);
+}
+
+size_t arena_size(arena_t *a)
+{
+	return a->total;
+}
+
+arena_t *arena_enter(arena_t *a)
+{
+	arena_t *prev = arena_current;
+
+	arena_current = a;
+
+	return prev;
+}
+
+void arena_leave(arena_t *prev)
+{
+	arena_current = prev;
+}
+
+void *mem_alloc(size_t size)
+{
+	if (arena_current)
+		return arena_alloc(arena_current, size);
+
+	return calloc(1, size);
+}
+
+char *mem_strdup(const char *s)
+{
+	size_t len = strlen(s) + 1;
+
+	return memcpy(mem_alloc(len), s, len);
+}
+
+void mem_free(void *p)
+{
+	if (arena_current == NULL)
+		free(p);
+}
+
+/* allocation for containers, which use the arena they were created in
+   rather than whichever one happens to be current */
 
-	return  0
-#if 0 /* maybe we can ifdef this to something 64 bit? */
-		+ (hash[0] << 56) + (hash[1] << 48)
-		+ (hash[2] << 40) + (hash[3] << 32)
-#endif
-		+ (hash[4] << 24) + (hash[5] << 16)
-		+ (hash[6] <<  8) + (hash[7] <<  0);
+static void *c_alloc(arena_t *a, size_t size)
+{
+	return a ? arena_alloc(a, size) : calloc(1, size);
+}
+
+static void c_free(arena_t *a, void *p)
+{
+	if (a == NULL)
+		free(p);
 }
 
 /*
@@ -103,20 +207,23 @@ static hash_t fnv1a(void *_s, unsigned len)
 
 static list_t *list_alloc(void)
 {
-	return calloc(1, sizeof(list_t));
+	list_t *ll = c_alloc(arena_current, sizeof(list_t));
+	ll->arena = arena_current;
+
+	return ll;
 }
 
-static list_node_t *list_node_alloc(void *v)
+static list_node_t *list_node_alloc(list_t *ll, void *v)
 {
-	list_node_t *n = calloc(1, sizeof(list_node_t));
+	list_node_t *n = c_alloc(ll->arena, sizeof(list_node_t));
 	n->v = v;
 
 	return n;
 }
 
-static void list_node_free(list_node_t *n)
+static void list_node_free(list_t *ll, list_node_t *n)
 {
-	free(n);
+	c_free(ll->arena, n);
 }
 
 list_t *list_new(void)
@@ -134,9 +241,9 @@ void list_release(list_t *ll)
 	list_node_t *n, *nn;
 
 	LIST_EACH_NODE_SAFE(ll, n, nn)
-		list_node_free(n);
+		list_node_free(ll, n);
 
-	free(ll);
+	c_free(ll->arena, ll);
 }
 
 void list_release_callback(list_t *ll, void (*free_node)(const void*) )
@@ -145,10 +252,10 @@ void list_release_callback(list_t *ll, void (*free_node)(const void*) )
 
 	LIST_EACH_NODE_SAFE(ll, n, nn) {
 		(*free_node)(n->v);
-		list_node_free(n);
+		list_node_free(ll, n);
 	}
 
-	free(ll);
+	c_free(ll->arena, ll);
 }
 
 static void __ll_put_after(list_node_t *aft, list_node_t *n)
@@ -162,7 +269,7 @@ static void __ll_put_after(list_node_t *aft, list_node_t *n)
 
 list_node_t *list_append(list_t *ll, void *v)
 {
-	list_node_t *n = list_node_alloc(v);
+	list_node_t *n = list_node_alloc(ll, v);
 
 	__ll_put_after(ROOT(ll)->prev, n);
 	ll->length += 1;
@@ -172,7 +279,7 @@ list_node_t *list_append(list_t *ll, void *v)
 
 list_node_t *list_prepend(list_t *ll, void *v)
 {
-	list_node_t *n = list_node_alloc(v);
+	list_node_t *n = list_node_alloc(ll, v);
 
 	__ll_put_after(ROOT(ll), n);
 	ll->length += 1;
@@ -182,7 +289,7 @@ list_node_t *list_prepend(list_t *ll, void *v)
 
 list_node_t *list_add_before(list_t *ll, list_node_t *n, void *v)
 {
-	list_node_t *n2 = list_node_alloc(v);
+	list_node_t *n2 = list_node_alloc(ll, v);
 
 	__ll_put_after(n->prev, n2);
 	ll->length += 1;
@@ -192,7 +299,7 @@ list_node_t *list_add_before(list_t *ll, list_node_t *n, void *v)
 
 list_node_t *list_add_after(list_t *ll, list_node_t *n, void *v)
 {
-	list_node_t *n2 = list_node_alloc(v);
+	list_node_t *n2 = list_node_alloc(ll, v);
 
 	__ll_put_after(n, n2);
 	ll->length += 1;
@@ -213,7 +320,7 @@ void list_delete(list_t *ll, list_node_t *n)
 
 	ll->length -= 1;
 
-	list_node_free(n);
+	list_node_free(ll, n);
 }
 
 list_node_t *list_find(list_t *ll, void *p)
@@ -241,23 +348,24 @@ void list_delete_val(list_t *ll, void *p)
 
 vec_t *vec_new(unsigned capacity)
 {
-	vec_t *vec = malloc(sizeof(*vec));
+	vec_t *vec = c_alloc(arena_current, sizeof(*vec));
 
+	vec->arena = arena_current;
 	vec->size = 0;
 	vec->capacity = capacity;
 
 	if (vec->capacity < VEC_MIN_CAPACITY)
 		vec->capacity = VEC_MIN_CAPACITY;
 
-	vec->v = calloc(vec->capacity, sizeof(*vec->v));
+	vec->v = c_alloc(vec->arena, vec->capacity * sizeof(*vec->v));
 
 	return vec;
 }
 
 void vec_release(vec_t *vec)
 {
-	free(vec->v);
-	free(vec);
+	c_free(vec->arena, vec->v);
+	c_free(vec->arena, vec);
 }
 
 void vec_set(vec_t *vec, unsigned idx, void *v)
@@ -269,8 +377,15 @@ void vec_set(vec_t *vec, unsigned idx, void *v)
 			cap = cap + (cap >> 1);
 
 		if (cap != vec->capacity) {
+			if (vec->arena) {
+				void **v = arena_alloc(vec->arena,
+				                       cap * sizeof(*vec->v));
+				memcpy(v, vec->v, vec->size * sizeof(*vec->v));
+				vec->v = v;
+			} else {
+				vec->v = realloc(vec->v, cap * sizeof(*vec->v));
+			}
 			vec->capacity = cap;
-			vec->v = realloc(vec->v, cap * sizeof(*vec->v));
 		}
 
 		while (idx >= vec->size)
@@ -289,19 +404,28 @@ void vec_append(vec_t *vec, void *v)
  * hash tables
  */
 
-#define MIN_ORDER  4 /* 2^4 = 16, kinda cramped but not too bad. */
-#define MAX_ORDER 12 /* 2^12 = 4096, which i think is plenty big. */
+#define MIN_ORDER  3 /* 2^3 = 8, tables grow as needed, so start small */
+#define MAX_ORDER 12 /* 2^12 = 4096, for initial sizes only */
+
+/* resize when the average chain is longer than this */
+#define MAX_LOAD   1
+
+/* keys are stored inline, after the cell, so that a put is one allocation
+   and a lookup touches one cache line instead of chasing a pointer to a
+   separately allocated string. the length is kept so most mismatches are
+   rejected without looking at the key at all */
 
 struct htab_cell {
-	char *k;
+	htab_cell_t *next;
 	hash_t hash;
 	void *v;
-	htab_cell_t *next;
+	size_t len;
+	char k[];
 };
 
 htab_t *htab_new(unsigned initial_order)
 {
-	htab_t *ht = calloc(1, sizeof(*ht));
+	htab_t *ht = c_alloc(arena_current, sizeof(*ht));
 
 	if (initial_order == 0)
 		initial_order = HTAB_DEFAULT_ORDER;
@@ -310,10 +434,11 @@ htab_t *htab_new(unsigned initial_order)
 	if (initial_order > MAX_ORDER)
 		initial_order = MAX_ORDER;
 
+	ht->arena = arena_current;
 	ht->order = initial_order;
 	ht->load = 0;
 
-	ht->tab = calloc(1 << ht->order, sizeof(htab_cell_t*));
+	ht->tab = c_alloc(ht->arena, sizeof(htab_cell_t*) << ht->order);
 
 	return ht;
 }
@@ -321,107 +446,128 @@ htab_t *htab_new(unsigned initial_order)
 void htab_release(htab_t *ht)
 {
 	htab_cell_t *cur, *next;
-	int i;
+	unsigned i;
 
-	for (i=0; i<1<<ht->order; i++) {
+	for (i=0; i<1U<<ht->order; i++) {
 		cur = ht->tab[i];
 
 		while (cur) {
 			next = cur->next;
-			free(cur->k);
-			free(cur);
+			c_free(ht->arena, cur);
 			cur = next;
 		}
 	}
 
-	free(ht->tab);
-	free(ht);
+	c_free(ht->arena, ht->tab);
+	c_free(ht->arena, ht);
 }
 
-void htab_put(htab_t *ht, char *k, void *v)
+/* doubles the number of buckets. cells remember their hash, so nothing is
+   rehashed, they're just relinked into their new buckets */
+static void htab_grow(htab_t *ht)
 {
-	hash_t hash;
-	htab_cell_t *cur;
-	unsigned idx;
+	htab_cell_t **tab, *cur, *next;
+	unsigned i, order, idx;
 
-	hash = fnv1a(k, strlen(k));
-	idx = hash & ((1 << ht->order) - 1);
-	cur = ht->tab[idx];
+	order = ht->order + 1;
+	tab = c_alloc(ht->arena, sizeof(htab_cell_t*) << order);
 
-	while (cur) {
-		if (cur->hash == hash && !strcmp(cur->k, k)) {
-			cur->v = v;
-			return;
+	for (i=0; i<1U<<ht->order; i++) {
+		for (cur = ht->tab[i]; cur; cur = next) {
+			next = cur->next;
+			idx = cur->hash & ((1 << order) - 1);
+			cur->next = tab[idx];
+			tab[idx] = cur;
 		}
-		cur = cur->next;
 	}
 
-	ht->load++;
+	c_free(ht->arena, ht->tab);
+	ht->tab = tab;
+	ht->order = order;
+}
 
-	/* TODO: resize if load above some threshold */
+static htab_cell_t **htab_find(htab_t *ht, char *k, size_t len, hash_t hash)
+{
+	htab_cell_t **cur;
 
-	cur = malloc(sizeof(*cur));
-	cur->k = strdup(k);
-	cur->v = v;
-	cur->hash = hash;
-	cur->next = ht->tab[idx];
+	/* cur points to the pointer we followed to get to the node being
+	   inspected so that callers can unlink or insert there */
+
+	cur = &ht->tab[hash & ((1 << ht->order) - 1)];
+
+	while (*cur) {
+		if ((*cur)->hash == hash && (*cur)->len == len &&
+		    !memcmp((*cur)->k, k, len))
+			break;
 
-	ht->tab[idx] = cur;
+		cur = &(*cur)->next;
+	}
+
+	return cur;
 }
 
-void *htab_get(htab_t *ht, char *k)
+void htab_put(htab_t *ht, char *k, void *v)
 {
+	htab_cell_t **at, *cur;
+	size_t len;
 	hash_t hash;
-	htab_cell_t *cur;
-	unsigned idx;
 
-	hash = fnv1a(k, strlen(k));
-	idx = hash & ((1 << ht->order) - 1);
-	cur = ht->tab[idx];
+	len = strlen(k);
+	hash = hash_str(k, len);
+	at = htab_find(ht, k, len, hash);
 
-	while (cur) {
-		if (cur->hash == hash && !strcmp(cur->k, k))
-			return cur->v;
+	if (*at) {
+		(*at)->v = v;
+		return;
+	}
 
-		cur = cur->next;
+	if (++ht->load > MAX_LOAD << ht->order) {
+		htab_grow(ht);
+		at = &ht->tab[hash & ((1 << ht->order) - 1)];
 	}
 
-	return NULL;
+	cur = c_alloc(ht->arena, sizeof(*cur) + len + 1);
+	memcpy(cur->k, k, len + 1);
+	cur->len = len;
+	cur->v = v;
+	cur->hash = hash;
+	cur->next = *at;
+
+	*at = cur;
 }
 
-void *htab_delete(htab_t *ht, char *k)
+void *htab_get(htab_t *ht, char *k)
 {
-	hash_t hash;
-	htab_cell_t **cur;
-	unsigned idx;
+	htab_cell_t *cur;
+	size_t len;
 
-	/* this time, cur points to the pointer we followed to get to the
-	   node being inspected so that when we eventually delete the node
-	   we can adjust the pointer */
+	len = strlen(k);
+	cur = *htab_find(ht, k, len, hash_str(k, len));
 
-	hash = fnv1a(k, strlen(k));
-	idx = hash & ((1 << ht->order) - 1);
+	return cur ? cur->v : NULL;
+}
 
-	cur = &ht->tab[idx];
+void *htab_delete(htab_t *ht, char *k)
+{
+	htab_cell_t **cur, *next;
+	size_t len;
+	void *nuked;
 
-	while (*cur) {
-		if ((*cur)->hash == hash && !strcmp((*cur)->k, k)) {
-			void *nuked = (*cur)->v;
-			htab_cell_t *next = (*cur)->next;
+	len = strlen(k);
+	cur = htab_find(ht, k, len, hash_str(k, len));
 
-			free((*cur)->k);
-			free(*cur);
-			*cur = next;
+	if (*cur == NULL)
+		return NULL;
 
-			ht->load--;
+	nuked = (*cur)->v;
+	next = (*cur)->next;
 
-			return nuked;
-		}
+	c_free(ht->arena, *cur);
+	*cur = next;
 
-		cur = &(*cur)->next;
-	}
+	ht->load--;
 
-	return NULL;
+	return nuked;
 }
 
 void htab_each(htab_t *ht, void (*cb)(void*, char *k, void *v), void *priv)
@@ -429,7 +575,7 @@ void htab_each(htab_t *ht, void (*cb)(void*, char *k, void *v), void *priv)
 	htab_cell_t *cur;
 	unsigned idx;
 
-	for (idx = 0; idx < 1 << ht->order; idx++) {
+	for (idx = 0; idx < 1U << ht->order; idx++) {
 		for (cur = ht->tab[idx]; cur; cur = cur->next)
 			cb(priv, cur->k, cur->v);
 	}
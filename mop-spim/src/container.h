@@ -20,6 +20,32 @@
 #define __unused
 #endif
 
+/* arenas */
+
+/* an arena hands out zeroed memory from large chunks and frees it all at
+   once. the containers below remember which arena was current when they
+   were created and allocate from it, so whole groups of objects (an AST,
+   or everything built while compiling one function) can be thrown away
+   together instead of being freed piece by piece, or more often leaked. */
+
+typedef struct arena arena_t;
+
+extern arena_t *arena_new(void);
+extern void arena_release(arena_t*);
+extern void *arena_alloc(arena_t*, size_t);
+extern size_t arena_size(arena_t*);
+
+/* makes the given arena current, returning the previous one, which should
+   be passed to arena_leave when done */
+extern arena_t *arena_enter(arena_t*);
+extern void arena_leave(arena_t *prev);
+
+/* allocate from the current arena, or the heap if there is none. mem_free
+   does nothing while an arena is current */
+extern void *mem_alloc(size_t);
+extern char *mem_strdup(const char*);
+extern void mem_free(void*);
+
 /* linked lists */
 
 typedef struct list_node list_node_t;
@@ -33,6 +59,7 @@ struct list_node {
 struct list {
 	list_node_t root;
 	size_t length;
+	arena_t *arena;
 };
 
 #define LIST_EACH_NODE(LL, CUR) \
@@ -90,6 +117,7 @@ typedef struct vec vec_t;
 struct vec {
 	unsigned size, capacity;
 	void **v;
+	arena_t *arena;
 };
 
 extern vec_t *vec_new(unsigned capacity);
@@ -110,12 +138,13 @@ static inline void *vec_get(vec_t *vec, unsigned idx)
 typedef struct htab htab_t;
 typedef struct htab_cell htab_cell_t; /* defined internally */
 
-#define HTAB_DEFAULT_ORDER 5
+#define HTAB_DEFAULT_ORDER 4
 
 struct htab {
 	unsigned order; /* size = 2^order */
 	unsigned load;
 	htab_cell_t **tab;
+	arena_t *arena;
 };
 
 extern htab_t *htab_new(unsigned initial_order); /* size = 2^order */
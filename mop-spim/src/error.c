@@ -17,7 +17,7 @@ void assert_error(list_t *errs, int line_no, const char *format, ...)
 
 	va_start(va, format);
 	
-	if((e = malloc(sizeof(*e))) == NULL) {
+	if((e = mem_alloc(sizeof(*e))) == NULL) {
 		ERR("error errored!");
 		return;
 	}
@@ -33,7 +33,7 @@
 
 #define TRY_MALLOC(dest, size) \
 do { \
-	if( ((dest)=calloc(1, (size))) == NULL) \
+	if( ((dest)=mem_alloc(size)) == NULL) \
 		abort(); \
 } while(0)
 
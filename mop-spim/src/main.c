@@ -7,45 +7,297 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "shared.h"
 #include "dump.h"
 #include "type.h"
 #include "error.h"
-#include "y.tab.h"
 #include "cg.h"
+#include "timing.h"
 
-extern program_t *program;
+/* batch mode: compiles every file in 'files', writing foo.s next to each
+   foo.p. workers take the next file off the list until there are none
+   left */
+struct batch {
+	vec_t *files;
+	unsigned next;
+	int status;
+	pthread_mutex_t lock;
+};
 
-int main(int argc, char *argv[])
+static void usage(const char *argv0)
 {
-	if (yyparse() != 0) {
-		fprintf(stderr, "Errors detected. Exiting.\n");
-		return 1;
+	fprintf(stderr, "usage: %s [options] < program.p > program.s\n", argv0);
+	fprintf(stderr, "       %s [options] [-j N] file.p|dir ...\n", argv0);
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  -fno-tail-calls don't turn calls in tail position "
+	                "into jumps\n");
+	fprintf(stderr, "  -fno-dce        don't remove dead code and "
+	                "unreachable blocks\n");
+	fprintf(stderr, "  -fno-layout     emit blocks in the order they "
+	                "were built\n");
+	fprintf(stderr, "  -fno-peephole   don't run the peephole optimizer\n");
+	fprintf(stderr, "  -fdelay-slots   fill branch delay slots (for "
+	                "spim -delayed_branches)\n");
+	fprintf(stderr, "  -ftime-report   print time and memory used by each "
+	                "phase and pass\n");
+	fprintf(stderr, "  -j N            compile N functions at once, or N "
+	                "files at once in batch mode\n");
+}
+
+static void print_errors(prog_t *p, const char *filename)
+{
+	error_t *err;
+	list_node_t *n;
+
+	LIST_EACH(p->errs, n, err) {
+		if (filename)
+			fprintf(stderr, "%s:", filename);
+		if (err->line_no) {
+			fprintf(stderr, "ERROR:%d:%s\n", err->line_no,
+			        err->val);
+		} else {
+			fprintf(stderr, "ERROR:%s\n", err->val);
+		}
+	}
+}
+
+/* compiles one program from 'in' to 'out'. returns 0 on success, 1 for a
+   syntax error or 2 for a semantic error, like the exit status. filename
+   is only used for messages, and may be NULL */
+static int compile(FILE *in, FILE *out, const char *filename)
+{
+	program_t *program;
+	arena_t *unit, *prev;
+	prog_t *p;
+	double start;
+	int status = 0;
+
+	/* the AST and everything semantic analysis hangs off of it lives
+	   until the end of the compilation unit */
+	unit = arena_new();
+	prev = arena_enter(unit);
+
+	start = time_phase_begin();
+	program = parse_program(in, filename);
+	time_phase_end("parse", start);
+
+	if (program == NULL) {
+		status = 1;
+		goto out;
 	}
 
-	prog_t *p = build_semantic_tree(program);
+	start = time_phase_begin();
+	p = build_semantic_tree(program);
+	time_phase_end("build_semantic_tree", start);
 
 	if (p->errs->length != 0) {
-		error_t *err;
-		list_node_t *n;
-
-		LIST_EACH(p->errs, n, err) {
-			if (err->line_no) {
-				fprintf(stderr, "ERROR:%d:%s\n", err->line_no,
-				        err->val);
-			} else {
-				fprintf(stderr, "ERROR:%s\n", err->val);
-			}
+		print_errors(p, filename);
+		status = 2;
+		goto out;
+	}
+
+	start = time_phase_begin();
+	allocate_symbols(p);
+	time_phase_end("allocate_symbols", start);
+
+	start = time_phase_begin();
+	mips_emit_program(p, out);
+	time_phase_end("mips_emit_program", start);
+
+out:
+	arena_leave(prev);
+	arena_release(unit);
+
+	return status;
+}
+
+static int compile_file(const char *filename)
+{
+	char outname[4096];
+	FILE *in, *out;
+	size_t len;
+	int status;
+
+	len = strlen(filename);
+	if (len > 2 && !strcmp(filename + len - 2, ".p"))
+		len -= 2;
+	snprintf(outname, sizeof(outname), "%.*s.s", (int) len, filename);
+
+	if ((in = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		return 1;
+	}
+
+	if ((out = fopen(outname, "w")) == NULL) {
+		perror(outname);
+		fclose(in);
+		return 1;
+	}
+
+	status = compile(in, out, filename);
+
+	fclose(in);
+	fclose(out);
+
+	if (status != 0) {
+		fprintf(stderr, "%s: errors detected\n", filename);
+		remove(outname);
+	}
+
+	return status;
+}
+
+static void *batch_worker(void *_b)
+{
+	struct batch *b = _b;
+	char *filename;
+	int status;
+
+	for (;;) {
+		pthread_mutex_lock(&b->lock);
+		filename = vec_get(b->files, b->next++);
+		pthread_mutex_unlock(&b->lock);
+
+		if (filename == NULL)
+			break;
+
+		status = compile_file(filename);
+
+		pthread_mutex_lock(&b->lock);
+		if (status > b->status)
+			b->status = status;
+		pthread_mutex_unlock(&b->lock);
+	}
+
+	return NULL;
+}
+
+static int cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(char**)a, *(char**)b);
+}
+
+/* adds every .p file in the directory to the list, in sorted order so that
+   diagnostics come out the same every time */
+static bool add_directory(vec_t *files, const char *dirname)
+{
+	struct dirent *ent;
+	unsigned first;
+	char path[4096];
+	size_t len;
+	DIR *dir;
+
+	if ((dir = opendir(dirname)) == NULL) {
+		perror(dirname);
+		return false;
+	}
+
+	first = files->size;
+
+	while ((ent = readdir(dir)) != NULL) {
+		len = strlen(ent->d_name);
+		if (len < 3 || strcmp(ent->d_name + len - 2, ".p"))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dirname, ent->d_name);
+		vec_append(files, mem_strdup(path));
+	}
+
+	closedir(dir);
+
+	qsort(files->v + first, files->size - first, sizeof(*files->v),
+	      cmp_names);
+
+	return true;
+}
+
+static int compile_batch(vec_t *files, unsigned jobs)
+{
+	struct batch b;
+	pthread_t *threads;
+	unsigned i;
+
+	b.files = files;
+	b.next = 0;
+	b.status = 0;
+	pthread_mutex_init(&b.lock, NULL);
+
+	if (jobs > files->size)
+		jobs = files->size;
+
+	if (jobs <= 1) {
+		batch_worker(&b);
+	} else {
+		threads = calloc(jobs, sizeof(*threads));
+
+		for (i=0; i<jobs; i++)
+			pthread_create(&threads[i], NULL, batch_worker, &b);
+		for (i=0; i<jobs; i++)
+			pthread_join(threads[i], NULL);
+
+		free(threads);
+	}
+
+	pthread_mutex_destroy(&b.lock);
+
+	return b.status;
+}
+
+int main(int argc, char *argv[])
+{
+	struct stat st;
+	vec_t *files;
+	unsigned jobs = 1;
+	int i, status;
+
+	files = vec_new(16);
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-fno-tail-calls")) {
+			cg_tail_calls = false;
+		} else if (!strcmp(argv[i], "-fno-dce")) {
+			cg_dce = false;
+		} else if (!strcmp(argv[i], "-fno-layout")) {
+			cg_layout = false;
+		} else if (!strcmp(argv[i], "-fno-peephole")) {
+			cg_peephole = false;
+		} else if (!strcmp(argv[i], "-fdelay-slots")) {
+			cg_delay_slots = true;
+		} else if (!strcmp(argv[i], "-ftime-report")) {
+			time_report = true;
+		} else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			jobs = atoi(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			if (!add_directory(files, argv[i]))
+				return 1;
+		} else {
+			vec_append(files, argv[i]);
 		}
+	}
 
-		fprintf(stderr, "Errors detected. Exiting.\n");
-		return 2;
+	if (files->size == 0) {
+		cg_jobs = jobs;
+		status = compile(stdin, stdout, NULL);
+		if (status != 0)
+			fprintf(stderr, "Errors detected. Exiting.\n");
+		else
+			fprintf(stderr, "\n");
+	} else {
+		/* the CFG dumps would be unreadable for more than one file */
+		cg_verbose = false;
+		status = compile_batch(files, jobs);
 	}
 
-	allocate_symbols(p);
-	mips_emit_program(p);
-	fprintf(stderr, "\n");
+	time_report_print();
 
-	return 0;
+	return status;
 }
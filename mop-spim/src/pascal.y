@@ -23,15 +23,23 @@
 #include "shared.h"
 #include "container.h"
 
-int yylex(void);
-void yyerror(const char *error);
+/* the parser and scanner are re-entrant, so that several programs can be
+   compiled by the same process. what used to be global (the line number,
+   the resulting program) lives in the parse_ctx_t attached to the scanner */
+extern parse_ctx_t *yyget_extra(void *scanner);
+extern char *yyget_text(void *scanner);
 
-extern char *yytext;          /* yacc text variable */
-extern int line_number;       /* Holds the current line number; specified
-                                 in the lexer */
-program_t *program;           /* points to our program */
+#define CTX (yyget_extra(scanner))
 %}
 
+%define api.pure full
+%param {void *scanner}
+
+%code provides {
+int yylex(YYSTYPE *lvalp, void *scanner);
+void yyerror(void *scanner, const char *error);
+}
+
 %token AND ARRAY ASSIGNMENT CLASS COLON COMMA DIGSEQ
 %token DO DOT DOTDOT ELSE END EQUAL EXTENDS FUNCTION
 %token GE GT IDENTIFIER IF LBRAC LE LPAREN LT MINUS MOD NEW NOT
@@ -137,29 +145,29 @@ program_t *program;           /* points to our program */
 
 program:
 	program_heading semicolon class_list DOT {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->ph = $1;
 		$$->classes = $3;
 
-		program = $$;
+		CTX->program = $$;
 	};
 
 program_heading:
 	PROGRAM identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_id_list = false;
 		$$->id = $2->id;
 		$$->id_list = NULL;
 		$$->line_no = $2->line_no;
-		free($2);
+		mem_free($2);
 	}
 	| PROGRAM identifier LPAREN identifier_list RPAREN {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_id_list = true;
 		$$->id = $2->id;
 		$$->id_list = $4;
 		$$->line_no = $2->line_no;
-		free($2);
+		mem_free($2);
 	};
 
 identifier_list:
@@ -174,7 +182,7 @@ identifier_list:
 
 class_list:
 	class_list class_identification PBEGIN class_block END {
-		class_definition_t *cd = malloc(sizeof(*cd));
+		class_definition_t *cd = mem_alloc(sizeof(*cd));
 		cd->cid = $2;
 		cd->body = $4;
 
@@ -182,7 +190,7 @@ class_list:
 		list_append($$, cd);
 	}
 	| class_identification PBEGIN class_block END {
-		class_definition_t *cd = malloc(sizeof(*cd));
+		class_definition_t *cd = mem_alloc(sizeof(*cd));
 		cd->cid = $1;
 		cd->body = $3;
 
@@ -192,55 +200,55 @@ class_list:
 
 class_identification:
 	CLASS identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_extends = false;
 		$$->id = $2->id;
 		$$->extends = NULL;
-		$$->line_no = line_number;
-		free($2);
+		$$->line_no = CTX->line_number;
+		mem_free($2);
 	}
 	| CLASS identifier EXTENDS identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_extends = true;
 		$$->id = $2->id;
 		$$->extends = $4;
-		$$->line_no = line_number;
-		free($2);
+		$$->line_no = CTX->line_number;
+		mem_free($2);
 	};
 
 class_block:
 	variable_declaration_part func_declaration_list {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->vd = $1;
 		$$->fd = $2;
 	};
 
 type_denoter:
 	array_type {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_array = true;
 		$$->a = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_array = false;
 		$$->id = $1->id;
 		$$->line_no = $1->line_no;
-		free($1);
+		mem_free($1);
 	};
 
 array_type:
 	ARRAY LBRAC range RBRAC OF type_denoter {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->r = $3;
 		$$->td = $6;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 range:
 	unsigned_integer DOTDOT unsigned_integer {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->low = $1;
 		$$->high = $3;
 	};
@@ -265,10 +273,10 @@ variable_declaration_list:
 
 variable_declaration:
 	identifier_list COLON type_denoter {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->id_list = $1;
 		$$->type = $3;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 func_declaration_list:
@@ -306,35 +314,35 @@ formal_parameter_section:
 
 value_parameter_specification:
 	identifier_list COLON identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_var = false;
 		$$->ids = $1;
 		$$->id = $3->id;
 		$$->line_no = $3->line_no;
-		free($3);
+		mem_free($3);
 	};
 
 variable_parameter_specification:
 	VAR identifier_list COLON identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_var = true;
 		$$->ids = $2;
 		$$->id = $4->id;
 		$$->line_no = $4->line_no;
-		free($4);
+		mem_free($4);
 	};
 
 function_declaration:
 	function_identification semicolon function_block {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_heading = false;
 		$$->id = $1->id;
 		$$->fb = $3;
 		$$->line_no = $1->line_no;
-		free($1);
+		mem_free($1);
 	}
 	| function_heading semicolon function_block {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_heading = true;
 		$$->fh = $1;
 		$$->fb = $3;
@@ -342,24 +350,24 @@ function_declaration:
 
 function_heading:
 	FUNCTION identifier COLON result_type {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_fpl = false;
 		$$->id = $2->id;
 		$$->fpl = list_new();
 		$$->result_type = $4->id;
 		$$->line_no = $2->line_no;
-		free($2);
-		free($4);
+		mem_free($2);
+		mem_free($4);
 	}
 	| FUNCTION identifier formal_parameter_list COLON result_type {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_fpl = true;
 		$$->id = $2->id;
 		$$->fpl = $3;
 		$$->result_type = $5->id;
 		$$->line_no = $2->line_no;
-		free($2);
-		free($5);
+		mem_free($2);
+		mem_free($5);
 	};
 
 result_type:
@@ -372,17 +380,17 @@ function_identification:
 
 function_block:
 	variable_declaration_part statement_part {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->vp = $1;
 		$$->sp = $2;
 	};
 
 statement_part:
 	compound_statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = ST_COMPOUND;
 		$$->cs = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 compound_statement:
@@ -402,46 +410,46 @@ statement_list:
 
 statement:
 	assignment_statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = ST_ASSIGNMENT;
 		$$->as = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| compound_statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = ST_COMPOUND;
 		$$->cs = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| if_statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = ST_IF;
 		$$->is = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| while_statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = ST_WHILE;
 		$$->ws = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| print_statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = ST_PRINT;
 		$$->va = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
         };
 
 while_statement:
 	WHILE boolean_expression DO statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->condition = $2;
 		$$->st = $4;
 	};
 
 if_statement:
 	IF boolean_expression THEN statement ELSE statement {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->condition = $2;
 		$$->tb = $4;
 		$$->eb = $6;
@@ -449,13 +457,13 @@ if_statement:
 
 assignment_statement:
 	variable_access ASSIGNMENT expression {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_new = false;
 		$$->va = $1;
 		$$->e = $3;
 	}
 	| variable_access ASSIGNMENT object_instantiation {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_new = true;
 		$$->va = $1;
 		$$->oi = $3;
@@ -463,20 +471,20 @@ assignment_statement:
 
 object_instantiation:
 	NEW identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_params = false;
 		$$->id = $2->id;
 		$$->params = list_new();
 		$$->line_no = $2->line_no;
-		free($2);
+		mem_free($2);
 	}
 	| NEW identifier params {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->has_params = true;
 		$$->id = $2->id;
 		$$->params = $3;
 		$$->line_no = $2->line_no;
-		free($2);
+		mem_free($2);
 	};
 
 print_statement:
@@ -484,37 +492,37 @@ print_statement:
 
 variable_access:
 	identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = VA_IDENTIFIER;
 		$$->id = $1->id;
 		$$->line_no = $1->line_no;
-		free($1);
+		mem_free($1);
 	}
 	| indexed_variable {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = VA_INDEXED;
 		$$->iv = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| attribute_designator {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = VA_ATTRIBUTE;
 		$$->ad = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| method_designator {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = VA_METHOD;
 		$$->md = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 indexed_variable:
 	variable_access LBRAC index_expression_list RBRAC {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->va = $1;
 		$$->idxs = $3;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 index_expression_list:
@@ -532,19 +540,19 @@ index_expression:
 
 attribute_designator:
 	variable_access DOT identifier {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->va = $1;
 		$$->id = $3->id;
 		$$->line_no = $3->line_no;
-		free($3);
+		mem_free($3);
 	};
 
 method_designator:
 	variable_access DOT function_designator {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->va = $1;
 		$$->fd = $3;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 
@@ -563,25 +571,25 @@ actual_parameter_list:
 
 actual_parameter:
 	expression {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->exp1 = $1;
 		$$->exp2 = NULL;
 		$$->exp3 = NULL;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| expression COLON expression {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->exp1 = $1;
 		$$->exp2 = $3;
 		$$->exp3 = NULL;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| expression COLON expression COLON expression {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->exp1 = $1;
 		$$->exp2 = $3;
 		$$->exp3 = $5;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 boolean_expression:
@@ -589,100 +597,100 @@ boolean_expression:
 
 expression:
 	simple_expression {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_one = true;
 		$$->e1 = $1;
 		$$->e2 = NULL;
 		$$->relop = -1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| simple_expression relop simple_expression {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_one = false;
 		$$->e1 = $1;
 		$$->e2 = $3;
 		$$->relop = $2;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 simple_expression:
 	term {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_term = true;
 		$$->t = $1;
 		$$->se = NULL;
 		$$->addop = -1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| simple_expression addop term {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_term = false;
 		$$->t = $3;
 		$$->se = $1;
 		$$->addop = $2;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 term:
 	factor {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_factor = true;
 		$$->f = $1;
 		$$->t = NULL;
 		$$->mulop = -1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| term mulop factor {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_factor = false;
 		$$->f = $3;
 		$$->t = $1;
 		$$->mulop = $2;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 factor:
 	sign factor {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_sign = true;
 		$$->sign = $1;
 		$$->f = $2;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| primary {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->is_sign = false;
 		$$->p = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	};
 
 primary:
 	variable_access {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = PR_VARIABLE_ACCESS;
 		$$->va = $1;
 		$$->line_no = $1->line_no;
 	}
 	| unsigned_constant {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = PR_UNSIGNED_CONSTANT;
 		$$->uc = $1;
-		$$->line_no = line_number;
+		$$->line_no = CTX->line_number;
 	}
 	| function_designator {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = PR_FUNCTION_DESIGNATOR;
 		$$->fd = $1;
 		$$->line_no = $1->line_no;
 	}
 	| LPAREN expression RPAREN {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = PR_EXPRESSION;
 		$$->e = $2;
 		$$->line_no = $2->line_no;
 	}
 	| NOT primary {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->tag = PR_NOT_PRIMARY;
 		$$->p = $2;
 		$$->line_no = $2->line_no;
@@ -696,17 +704,17 @@ unsigned_number:
 
 unsigned_integer:
 	DIGSEQ {
-		$$ = atoi(yytext);
+		$$ = atoi(yyget_text(scanner));
 	};
 
 /* functions with no params will be handled by plain identifier */
 function_designator:
 	identifier params {
-		$$ = malloc(sizeof(*$$));
+		$$ = mem_alloc(sizeof(*$$));
 		$$->id = $1->id;
 		$$->params = $2;
 		$$->line_no = $1->line_no;
-		free($1);
+		mem_free($1);
 	};
 
 sign:
@@ -734,9 +742,9 @@ relop:
 
 identifier:
 	IDENTIFIER {
-		$$ = malloc(sizeof(*$$));
-		$$->id = strdup(yytext);
-		$$->line_no = line_number;
+		$$ = mem_alloc(sizeof(*$$));
+		$$->id = mem_strdup(yyget_text(scanner));
+		$$->line_no = CTX->line_number;
 	};
 
 semicolon:
@@ -76,7 +76,7 @@ do { \
 
 symtab_t *symtab_new(symtab_t *parent, bool conceal)
 {
-	symtab_t *st = calloc(1, sizeof(*st));
+	symtab_t *st = mem_alloc(sizeof(*st));
 
 	st->parent = parent;
 	st->conceal = conceal;
@@ -130,7 +130,7 @@ void *symtab_get(symtab_t *st, char *k)
 
 static expr_t *make_expr(expr_op_t op, int line_no)
 {
-	expr_t *expr = calloc(1, sizeof(*expr));
+	expr_t *expr = mem_alloc(sizeof(*expr));
 	expr->op = op;
 	expr->line_no = line_no;
 	return expr;
@@ -240,7 +240,7 @@ const char *type_to_name(type_t *t)
 		snprintf(buf, 2048, "array of %d %s",
 			t->arr.high - t->arr.low + 1,
 			type_to_name(t->arr.of));
-		return strdup(buf);
+		return mem_strdup(buf);
 
 	case T_CLASS:
 		return t->cls->name;
@@ -268,10 +268,9 @@ static const char *display_name(expr_t *ex)
 	}
 }
 
-static char *lowercased(char *s)
+static char *lowercased(char *buf, size_t n, char *s)
 {
-	static char buf[512];
-	snprintf(buf, 512, "%s", s);
+	snprintf(buf, n, "%s", s);
 	for (s=buf; *s; s++)
 		*s = tolower(*s);
 	return buf;
@@ -366,6 +365,7 @@ static bool resolve_expr(prog_t *p, symtab_t *scope, expr_t *ex)
 	//list_node_t *cur;
 	expr_t *curex;
 	type_t *t;
+	char buf[512];
 
 	switch (ex->op) {
 	case OP_NONE:
@@ -373,7 +373,7 @@ static bool resolve_expr(prog_t *p, symtab_t *scope, expr_t *ex)
 		break;
 
 	case OP_IDENTIFIER:
-		curex = htab_get(p->builtins, lowercased(ex->id));
+		curex = htab_get(p->builtins, lowercased(buf, sizeof(buf), ex->id));
 		if (curex != NULL) {
 			memcpy(ex, curex, sizeof(*ex));
 			return true;
@@ -817,7 +817,7 @@ static expr_t* flatten_variable_access(prog_t *p, variable_access_t *va)
 
 static stmt_t* flatten_assignment_statement(prog_t *p, symtab_t *scope, assignment_statement_t *as)
 {
-	stmt_t *st = calloc(1, sizeof(*st));
+	stmt_t *st = mem_alloc(sizeof(*st));
 
 	st->type = STMT_ASSIGN;
 	st->assign.lhs = flatten_variable_access(p, as->va);
@@ -1155,7 +1155,7 @@ static void add_formal_parameters(prog_t *p, func_t *f,
 		return;
 
 	LIST_EACH(fps->ids, cur, id) {
-		sym = calloc(1, sizeof(*sym));
+		sym = mem_alloc(sizeof(*sym));
 
 		sym->tag = fps->is_var ?  SYM_REF_PARAMETER : SYM_VAL_PARAMETER;
 		sym->name = id->id;
@@ -1166,7 +1166,7 @@ static void add_formal_parameters(prog_t *p, func_t *f,
 			assert_error(p->errs, sym->line_declared,
 				"Parameter \"%s\" already declared at line %d",
 				old->name, old->line_declared);
-			free(sym);
+			mem_free(sym);
 			continue;
 		}
 
@@ -1187,7 +1187,7 @@ static void add_local_variables(prog_t *p, func_t *f,
 		return;
 
 	LIST_EACH(vd->id_list, cur, id) {
-		sym = calloc(1, sizeof(*sym));
+		sym = mem_alloc(sizeof(*sym));
 
 		sym->tag = SYM_FUNCTION_LOCAL;
 		sym->name = id->id;
@@ -1215,7 +1215,7 @@ static void add_local_variables(prog_t *p, func_t *f,
 static func_t* flatten_function_declaration(prog_t *p, class_t *parent,
                                              function_declaration_t *fd)
 {
-	func_t *f = calloc(1, sizeof(*f));
+	func_t *f = mem_alloc(sizeof(*f));
 	list_node_t *cur;
 	variable_declaration_t *vd;
 	symbol_t *tmp;
@@ -1242,7 +1242,7 @@ static func_t* flatten_function_declaration(prog_t *p, class_t *parent,
 		f->result = NULL;
 	}
 
-	tmp = calloc(1, sizeof(*tmp));
+	tmp = mem_alloc(sizeof(*tmp));
 	tmp->tag = SYM_THIS;
 	tmp->name = "this";
 	tmp->t = htab_get(p->types, parent->name);
@@ -1250,7 +1250,7 @@ static func_t* flatten_function_declaration(prog_t *p, class_t *parent,
 	symtab_set(f->local, tmp->name, tmp);
 
 	if (f->result != NULL) {
-		tmp = calloc(1, sizeof(*tmp));
+		tmp = mem_alloc(sizeof(*tmp));
 		tmp->tag = SYM_RETURN;
 		tmp->name = f->name;
 		tmp->t = f->result;
@@ -1279,7 +1279,7 @@ static void insert_class_fields(prog_t *p, class_t *c, variable_declaration_t *v
 		return;
 
 	LIST_EACH(vd->id_list, cur, id) {
-		sym = calloc(1, sizeof(*sym));
+		sym = mem_alloc(sizeof(*sym));
 
 		sym->tag = SYM_FIELD;
 		sym->name = id->id;
@@ -1290,7 +1290,7 @@ static void insert_class_fields(prog_t *p, class_t *c, variable_declaration_t *v
 			assert_error(p->errs, sym->line_declared,
 				"Variable \"%s\" already declared at line %d",
 				old->name, old->line_declared);
-			free(sym);
+			mem_free(sym);
 			continue;
 		}
 
@@ -1306,7 +1306,7 @@ static void insert_class_function(prog_t *p, class_t *c, function_declaration_t
 	if ((f = flatten_function_declaration(p, c, fd)) == NULL)
 		return;
 
-	sym = calloc(1, sizeof(*sym));
+	sym = mem_alloc(sizeof(*sym));
 	sym->tag = SYM_FUNCTION;
 	sym->name = f->name;
 	sym->t = f->result;
@@ -1343,13 +1343,13 @@ static prog_t* flatten_program(program_t *pin)
 
 	/* initialization: fill type table with builtin types */
 
-	type_t *t_builtin = calloc(2, sizeof(*t_builtin));
+	type_t *t_builtin = mem_alloc(2 * sizeof(*t_builtin));
 	t_builtin[0].tag = T_INTEGER;
 	t_builtin[1].tag = T_BOOLEAN;
 	htab_put(pout->types, "integer", t_builtin + 0);
 	htab_put(pout->types, "boolean", t_builtin + 1);
 
-	expr_t *e_builtin = calloc(2, sizeof(*e_builtin));
+	expr_t *e_builtin = mem_alloc(2 * sizeof(*e_builtin));
 	e_builtin[0].op = OP_BOOLEAN_CONSTANT;
 	e_builtin[1].op = OP_BOOLEAN_CONSTANT;
 	e_builtin[0].t = t_builtin + 1; /* boolean */
@@ -1375,12 +1375,12 @@ static prog_t* flatten_program(program_t *pin)
 			continue;
 		}
 
-		c = calloc(1, sizeof(*c));
+		c = mem_alloc(sizeof(*c));
 		c->name = cd->cid->id;
 		c->fields = list_new();
 		c->functions = list_new();
 
-		ct = calloc(1, sizeof(*ct));
+		ct = mem_alloc(sizeof(*ct));
 		ct->tag = T_CLASS;
 		ct->cls = c;
 		ct->line_no = cd->cid->line_no;
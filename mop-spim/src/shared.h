@@ -10,6 +10,7 @@
 #define __INC_SHARED_H__
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "container.h"
 
@@ -43,6 +44,7 @@ typedef struct class_definition class_definition_t;
 typedef struct class_identification class_identification_t;
 typedef struct program program_t;
 typedef struct program_heading program_heading_t;
+typedef struct parse_ctx parse_ctx_t;
 
 struct identifier {
 	char *id;
@@ -276,4 +278,18 @@ struct program_heading {
 	int line_no;
 };
 
+/* per-parse state, shared by the scanner and the parser */
+struct parse_ctx {
+	const char *filename; /* for messages, or NULL */
+	int line_number;
+	bool error_flag;
+	program_t *program;
+};
+
+/* == pascal.l == */
+
+/* parses a whole program from the given file, allocating the AST in the
+   current arena. returns NULL on a syntax error, after printing it */
+extern program_t *parse_program(FILE *in, const char *filename);
+
 #endif
@@ -0,0 +1,176 @@
+/*
+ * CSE 440, Project 3
+ * Mini Object Pascal Code Generation
+ *
+ * Alex Iadicicco
+ * shmibs
+ */
+
+/* -ftime-report. phases and passes are kept in small fixed tables in the
+   order they were first seen, which is also the order they're reported */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "timing.h"
+
+#define MAX_ENTRIES 32
+
+struct time_entry {
+	const char *name;
+	double secs;
+	unsigned runs;
+	long peak_kb;
+	unsigned long blocks_in, blocks_out;
+	unsigned long insts_in, insts_out;
+};
+
+bool time_report = false;
+
+static struct time_entry phases[MAX_ENTRIES];
+static unsigned num_phases = 0;
+
+static struct time_entry passes[MAX_ENTRIES];
+static unsigned num_passes = 0;
+
+/* batch mode may be compiling several programs at once */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* peak resident set size so far, in kilobytes */
+static long peak_kb(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		return 0;
+
+	return ru.ru_maxrss;
+}
+
+static struct time_entry *entry(struct time_entry *tab, unsigned *num,
+                                const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<*num; i++) {
+		if (!strcmp(tab[i].name, name))
+			return &tab[i];
+	}
+
+	if (*num == MAX_ENTRIES)
+		return NULL;
+
+	tab[*num].name = name;
+	return &tab[(*num)++];
+}
+
+double time_phase_begin(void)
+{
+	return time_report ? now() : 0.0;
+}
+
+void time_phase_end(const char *name, double start)
+{
+	struct time_entry *e;
+
+	if (!time_report)
+		return;
+
+	pthread_mutex_lock(&lock);
+	if ((e = entry(phases, &num_phases, name)) != NULL) {
+		e->secs += now() - start;
+		e->runs++;
+		e->peak_kb = peak_kb();
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void time_pass_begin(time_pass_t *t, unsigned long blocks,
+                     unsigned long insts)
+{
+	if (!time_report)
+		return;
+
+	t->blocks = blocks;
+	t->insts = insts;
+	t->start = now();
+}
+
+void time_pass_end(time_pass_t *t, const char *name,
+                   unsigned long blocks, unsigned long insts)
+{
+	struct time_entry *e;
+	double end;
+
+	if (!time_report)
+		return;
+
+	end = now();
+
+	pthread_mutex_lock(&lock);
+	if ((e = entry(passes, &num_passes, name)) != NULL) {
+		e->secs += end - t->start;
+		e->runs++;
+		e->blocks_in += t->blocks;
+		e->blocks_out += blocks;
+		e->insts_in += t->insts;
+		e->insts_out += insts;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void time_report_print(void)
+{
+	double total = 0.0;
+	unsigned i;
+
+	if (!time_report)
+		return;
+
+	for (i=0; i<num_phases; i++)
+		total += phases[i].secs;
+
+	fprintf(stderr, "\n\x1b[1mtime report:\x1b[0m\n");
+	fprintf(stderr, "  %-32s %10s %6s %10s\n",
+	        "phase", "wall (ms)", "%", "peak (kB)");
+	for (i=0; i<num_phases; i++) {
+		fprintf(stderr, "  %-32s %10.3f %5.1f%% %10ld\n",
+		        phases[i].name, phases[i].secs * 1e3,
+		        total > 0.0 ? 100.0 * phases[i].secs / total : 0.0,
+		        phases[i].peak_kb);
+	}
+	fprintf(stderr, "  %-32s %10.3f\n", "total", total * 1e3);
+
+	if (num_passes == 0)
+		return;
+
+	fprintf(stderr, "\n  %-32s %6s %10s %17s %19s\n",
+	        "pass", "runs", "wall (ms)", "blocks in -> out",
+	        "insts in -> out");
+	for (i=0; i<num_passes; i++) {
+		fprintf(stderr, "  %-32s %6u %10.3f ",
+		        passes[i].name, passes[i].runs, passes[i].secs * 1e3);
+
+		/* passes over the emitted assembly have no blocks */
+		if (passes[i].blocks_in || passes[i].blocks_out) {
+			fprintf(stderr, "%7lu -> %-7lu", passes[i].blocks_in,
+			        passes[i].blocks_out);
+		} else {
+			fprintf(stderr, "%7s    %-7s", "-", "");
+		}
+
+		fprintf(stderr, " %8lu -> %-8lu\n",
+		        passes[i].insts_in, passes[i].insts_out);
+	}
+}
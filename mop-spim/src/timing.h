@@ -0,0 +1,42 @@
+/*
+ * CSE 440, Project 3
+ * Mini Object Pascal Code Generation
+ *
+ * Alex Iadicicco
+ * shmibs
+ */
+
+/* -ftime-report support */
+
+#ifndef __INC_TIMING_H__
+#define __INC_TIMING_H__
+
+#include <stdbool.h>
+
+/* set from the command line. when this is false, none of the functions
+   below do any real work */
+extern bool time_report;
+
+/* a phase is one of the top-level steps in main(), timed from start to
+   finish. the peak memory use is sampled when it ends */
+extern double time_phase_begin(void);
+extern void time_phase_end(const char *name, double start);
+
+/* a pass is one run of some transformation over a single function. runs of
+   the same pass are added together, along with the size of the function
+   going in and coming out, so the report shows how much each pass costs
+   and how much it shrinks the program */
+typedef struct time_pass {
+	double start;
+	unsigned long blocks, insts;
+} time_pass_t;
+
+extern void time_pass_begin(time_pass_t*, unsigned long blocks,
+                            unsigned long insts);
+extern void time_pass_end(time_pass_t*, const char *name,
+                          unsigned long blocks, unsigned long insts);
+
+/* prints everything collected so far to stderr */
+extern void time_report_print(void);
+
+#endif
@@ -12,7 +12,7 @@ type_set_t *type_set_new(void)
 {
 	type_set_t *s;
 
-	s = calloc(1, sizeof(*s));
+	s = mem_alloc(sizeof(*s));
 
 	s->types = vec_new(8);
 	s->equiv = vec_new(8);
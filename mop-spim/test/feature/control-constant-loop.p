@@ -0,0 +1,30 @@
+program loop;
+
+class loop
+begin
+
+  { the test is always true, so after optimization the loop is a single
+    block that jumps back to itself. it is never run, but it still has to
+    be laid out and emitted }
+  function spin(x: integer): integer;
+  begin
+    if x > 10 then
+    begin
+      while 1 < 2 do
+        x := x + 1
+    end
+    else
+      x := x;
+    spin := x + 2
+  end;
+
+  function loop;
+  var a : integer;
+  begin
+    a := spin(5);
+    print a
+  end
+
+end
+
+.
@@ -0,0 +1,62 @@
+program method;
+
+{ this test case covers:
+    self-recursive tail calls
+    mutually recursive tail calls
+    recursion deep enough to need constant stack }
+
+class method
+begin
+
+  function sum(n, acc: integer): integer;
+  begin
+    if n = 0 then
+      sum := acc
+    else
+      sum := this.sum(n - 1, acc + n)
+  end;
+
+  function gcd(a, b: integer): integer;
+  begin
+    if b = 0 then
+      gcd := a
+    else
+      gcd := this.gcd(b, a MOD b)
+  end;
+
+  function isEven(n: integer): integer;
+  begin
+    if n = 0 then
+      isEven := 1
+    else
+      isEven := this.isOdd(n - 1)
+  end;
+
+  function isOdd(n: integer): integer;
+  begin
+    if n = 0 then
+      isOdd := 0
+    else
+      isOdd := this.isEven(n - 1)
+  end;
+
+  function method;
+  var x : integer;
+  begin
+    x := sum(10, 0);
+    print x;
+    x := sum(100000, 0);
+    print x;
+    x := gcd(1071, 462);
+    print x;
+    x := isEven(10);
+    print x;
+    x := isOdd(7);
+    print x;
+    x := isEven(100001);
+    print x
+  end
+
+end
+
+.
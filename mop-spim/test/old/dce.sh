@@ -0,0 +1,27 @@
+#!/bin/sh
+
+# Checks that dead code elimination shrinks the code generated for
+# 05-tons_o_branching.p, where every assignment after the loop is dead and
+# every branch after it is useless. Prints the number of instructions
+# emitted for the function with and without the pass.
+
+cd $(dirname $0)
+if [ ! -e ../../a.out ]; then
+	(cd ../.. && make) || exit 1
+fi
+
+count() {
+	../../a.out "$@" < 05-tons_o_branching.p 2>/dev/null |
+		sed -n '/^tonsOBranching_tonsOBranching:/,/_return:/p' |
+		grep -c '^	[^#]'
+}
+
+without=$(count -fno-dce)
+with=$(count)
+
+echo "05-tons_o_branching: $without instructions without dce, $with with"
+
+if [ "$with" -ge "$without" ]; then
+	echo "FAIL: dead code elimination removed nothing"
+	exit 1
+fi
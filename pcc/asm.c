@@ -0,0 +1,479 @@
+/* an assembler for the subset of AT&T syntax the code generator emits for
+   -m64, shared by --run and -c. only the handful of instructions and
+   addressing modes the code generator actually uses are understood.
+
+   every jump and call is encoded with a 32 bit displacement, so the size
+   of each instruction is known as soon as it is read, and references to
+   names are patched once all of them have been seen. names are interned
+   and kept in a symtab, since a large program has one for every function
+   and several for every conditional. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "lexer.h"
+#include "symtab.h"
+#include "asm.h"
+
+static void asm_error(const char *m, const char *line)
+{
+	fprintf(stderr, "asm error: %s: %s\n", m, line);
+	exit(6);
+}
+
+enum operand_kind { OPND_REG, OPND_IMM, OPND_MEM, OPND_RIP, OPND_LABEL };
+
+struct operand {
+	enum operand_kind kind;
+	int reg;   /* register, or base register of OPND_MEM */
+	long n;    /* immediate, or displacement of OPND_MEM */
+	int star;  /* indirect, as in call *%r11 */
+	char *sym; /* name of OPND_RIP or OPND_LABEL */
+};
+
+static const struct {
+	const char *name;
+	int n;
+} regs[] = {
+	{ "rax", 0 }, { "rcx", 1 }, { "rdx", 2 }, { "rbx", 3 },
+	{ "rsp", 4 }, { "rbp", 5 }, { "rsi", 6 }, { "rdi", 7 },
+	{ "r8", 8 }, { "r9", 9 }, { "r10", 10 }, { "r11", 11 },
+	{ "r12", 12 }, { "r13", 13 }, { "r14", 14 }, { "r15", 15 },
+	{ "eax", 0 }, { "ecx", 1 }, { "edx", 2 }, { "ebx", 3 },
+	{ "al", 0 }, { "cl", 1 }, { "dl", 2 }, { "bl", 3 }, { "r12b", 12 },
+};
+
+static const char *cond_codes[] = {
+	"o", "no", "b", "ae", "e", "ne", "be", "a",
+	"s", "ns", "p", "np", "l", "ge", "le", "g",
+};
+
+static int cond_code(const char *s)
+{
+	int i;
+
+	for (i=0; i<16; i++) {
+		if (!strcmp(s, cond_codes[i]))
+			return i;
+	}
+	return -1;
+}
+
+void asm_byte(struct asm_unit *u, int b)
+{
+	if (u->len == u->size) {
+		u->size = u->size ? u->size << 1 : 4096;
+		u->code = realloc(u->code, u->size);
+	}
+	u->code[u->len++] = b;
+}
+
+void asm_imm32(struct asm_unit *u, long n)
+{
+	int i;
+
+	for (i=0; i<4; i++)
+		asm_byte(u, (n >> (i * 8)) & 0xff);
+}
+
+static void fixup(struct asm_unit *u, enum asm_fixup_kind kind, char *name)
+{
+	struct asm_fixup *f = malloc(sizeof(*f));
+
+	f->kind = kind;
+	f->sym = asm_sym(u, name);
+	f->off = u->len;
+	f->next = u->fixups;
+	u->fixups = f;
+	asm_imm32(u, 0);
+}
+
+static int fits8(long n)
+{
+	return n >= -128 && n <= 127;
+}
+
+static int reg_number(struct asm_unit *u, const char *s)
+{
+	unsigned i;
+
+	for (i=0; i<sizeof(regs)/sizeof(*regs); i++) {
+		if (!strcmp(s, regs[i].name))
+			return regs[i].n;
+	}
+	asm_error("unknown register", u->line);
+	return -1;
+}
+
+static void parse_operand(struct asm_unit *u, char *s, struct operand *op)
+{
+	char *p;
+
+	memset(op, 0, sizeof(*op));
+
+	if (*s == '*') {
+		op->star = 1;
+		s++;
+	}
+
+	if (*s == '%') {
+		op->kind = OPND_REG;
+		op->reg = reg_number(u, s + 1);
+	} else if (*s == '$') {
+		op->kind = OPND_IMM;
+		op->n = strtol(s + 1, &p, 0);
+		if (*p != '\0')
+			asm_error("bad immediate", u->line);
+	} else if ((p = strchr(s, '(')) != NULL) {
+		*p = '\0';
+		if (!strcmp(p + 1, "%rip)")) {
+			op->kind = OPND_RIP;
+			op->sym = s;
+			return;
+		}
+		op->kind = OPND_MEM;
+		op->n = strtol(s, NULL, 0);
+		p[strlen(p + 1)] = '\0'; /* the ')' */
+		if (p[1] != '%')
+			asm_error("bad memory operand", u->line);
+		op->reg = reg_number(u, p + 2);
+	} else {
+		op->kind = OPND_LABEL;
+		op->sym = s;
+		if ((p = strchr(s, '@')) != NULL)
+			*p = '\0';
+	}
+}
+
+/* encodes opcode with a ModRM byte, with reg in the reg field and rm as
+   the register or memory operand. w selects 64 bit operands */
+static void modrm(struct asm_unit *u, int w, const char *opcode, int reg,
+                  struct operand *rm)
+{
+	int rex = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0);
+	int base = rm->reg, mod;
+
+	if (rm->kind == OPND_REG || rm->kind == OPND_MEM)
+		rex |= base & 8 ? 1 : 0;
+	if (rex != 0x40)
+		asm_byte(u, rex);
+
+	for (; *opcode; opcode++)
+		asm_byte(u, (unsigned char) *opcode);
+
+	switch (rm->kind) {
+	case OPND_REG:
+		asm_byte(u, 0xc0 | (reg & 7) << 3 | (base & 7));
+		return;
+
+	case OPND_RIP:
+		asm_byte(u, 0x05 | (reg & 7) << 3);
+		fixup(u, FIXUP_ADDRESS, rm->sym);
+		return;
+
+	case OPND_MEM:
+		/* %rbp and %r13 can't be used without a displacement, and
+		   %rsp and %r12 need a SIB byte */
+		if (rm->n == 0 && (base & 7) != 5)
+			mod = 0x00;
+		else if (fits8(rm->n))
+			mod = 0x40;
+		else
+			mod = 0x80;
+		asm_byte(u, mod | (reg & 7) << 3 | (base & 7));
+		if ((base & 7) == 4)
+			asm_byte(u, 0x24);
+		if (mod == 0x40)
+			asm_byte(u, rm->n & 0xff);
+		else if (mod == 0x80)
+			asm_imm32(u, rm->n);
+		return;
+
+	default:
+		asm_error("bad operand", u->line);
+	}
+}
+
+/* the arithmetic instructions sharing the 0x01/0x03/0x81/0x83 forms */
+static const struct {
+	const char *name;
+	int ext;
+} alu_ops[] = {
+	{ "add", 0 }, { "or", 1 }, { "and", 4 }, { "sub", 5 }, { "xor", 6 },
+	{ "cmp", 7 },
+};
+
+static int alu_op(const char *m)
+{
+	unsigned i;
+
+	for (i=0; i<sizeof(alu_ops)/sizeof(*alu_ops); i++) {
+		if (!strcmp(m, alu_ops[i].name))
+			return alu_ops[i].ext;
+	}
+	return -1;
+}
+
+static void encode(struct asm_unit *u, char *m, int nops, struct operand *src,
+                   struct operand *dst)
+{
+	char opc[4] = { 0 };
+	size_t len = strlen(m);
+	int w = 1, ext, cc;
+
+	if (!strcmp(m, "ret")) {
+		asm_byte(u, 0xc3);
+		return;
+	}
+
+	if (!strcmp(m, "jmp") || !strcmp(m, "call")) {
+		if (nops != 1)
+			asm_error("bad operands", u->line);
+		if (src->kind == OPND_LABEL) {
+			asm_byte(u, m[0] == 'j' ? 0xe9 : 0xe8);
+			fixup(u, FIXUP_BRANCH, src->sym);
+		} else {
+			modrm(u, 0, "\xff", m[0] == 'j' ? 4 : 2, src);
+		}
+		return;
+	}
+
+	if (m[0] == 'j' && (cc = cond_code(m + 1)) >= 0) {
+		asm_byte(u, 0x0f);
+		asm_byte(u, 0x80 + cc);
+		fixup(u, FIXUP_BRANCH, src->sym);
+		return;
+	}
+
+	if (!strncmp(m, "set", 3) && (cc = cond_code(m + 3)) >= 0) {
+		opc[0] = 0x0f;
+		opc[1] = 0x90 + cc;
+		modrm(u, 0, opc, 0, src);
+		return;
+	}
+
+	/* everything else has a size suffix */
+	if (len < 2 || (m[len - 1] != 'q' && m[len - 1] != 'l'))
+		asm_error("unknown instruction", u->line);
+	w = m[len - 1] == 'q';
+	m[len - 1] = '\0';
+
+	if (!strcmp(m, "push") || !strcmp(m, "pop")) {
+		if (src->kind == OPND_REG) {
+			if (src->reg & 8)
+				asm_byte(u, 0x41);
+			asm_byte(u, (m[1] == 'u' ? 0x50 : 0x58) + (src->reg & 7));
+		} else if (src->kind == OPND_IMM && m[1] == 'u') {
+			asm_byte(u, 0x68);
+			asm_imm32(u, src->n);
+		} else {
+			modrm(u, 0, m[1] == 'u' ? "\xff" : "\x8f",
+			      m[1] == 'u' ? 6 : 0, src);
+		}
+		return;
+	}
+
+	if (nops != 2)
+		asm_error("bad operands", u->line);
+
+	if (!strcmp(m, "mov")) {
+		if (src->kind == OPND_IMM && !w && dst->kind == OPND_REG) {
+			asm_byte(u, 0xb8 + (dst->reg & 7));
+			asm_imm32(u, src->n);
+		} else if (src->kind == OPND_IMM) {
+			modrm(u, w, "\xc7", 0, dst);
+			asm_imm32(u, src->n);
+		} else if (src->kind == OPND_REG) {
+			modrm(u, w, "\x89", src->reg, dst);
+		} else {
+			modrm(u, w, "\x8b", dst->reg, src);
+		}
+		return;
+	}
+
+	if (!strcmp(m, "lea")) {
+		modrm(u, w, "\x8d", dst->reg, src);
+		return;
+	}
+
+	if (!strcmp(m, "movzb")) {
+		modrm(u, w, "\x0f\xb6", dst->reg, src);
+		return;
+	}
+
+	if (!strcmp(m, "test")) {
+		modrm(u, w, "\x85", src->reg, dst);
+		return;
+	}
+
+	if (!strcmp(m, "shl") && src->kind == OPND_IMM) {
+		modrm(u, w, "\xc1", 4, dst);
+		asm_byte(u, src->n & 0xff);
+		return;
+	}
+
+	if (!strcmp(m, "imul")) {
+		if (src->kind == OPND_IMM) {
+			modrm(u, w, fits8(src->n) ? "\x6b" : "\x69", dst->reg,
+			      dst);
+			if (fits8(src->n))
+				asm_byte(u, src->n & 0xff);
+			else
+				asm_imm32(u, src->n);
+		} else {
+			modrm(u, w, "\x0f\xaf", dst->reg, src);
+		}
+		return;
+	}
+
+	if ((ext = alu_op(m)) >= 0) {
+		if (src->kind == OPND_IMM) {
+			modrm(u, w, fits8(src->n) ? "\x83" : "\x81", ext, dst);
+			if (fits8(src->n))
+				asm_byte(u, src->n & 0xff);
+			else
+				asm_imm32(u, src->n);
+		} else if (src->kind == OPND_REG) {
+			opc[0] = ext << 3 | 0x01;
+			modrm(u, w, opc, src->reg, dst);
+		} else {
+			opc[0] = ext << 3 | 0x03;
+			modrm(u, w, opc, dst->reg, src);
+		}
+		return;
+	}
+
+	asm_error("unknown instruction", u->line);
+}
+
+static void assemble_line(struct asm_unit *u, char *s)
+{
+	struct operand ops[2];
+	char *m, *p, *args[2];
+	int n = 0;
+
+	u->line = s;
+
+	while (isspace((unsigned char) *s))
+		s++;
+	if (!strncmp(s, ".globl", 6) && isspace((unsigned char) s[6])) {
+		for (s += 6; isspace((unsigned char) *s); s++);
+		asm_sym(u, s)->global = 1;
+		return;
+	}
+
+	if (*s == '\0' || (*s == '.' && strchr(s, ':') == NULL))
+		return; /* blank, or some other directive */
+
+	if ((p = strchr(s, ':')) != NULL && p[1] == '\0') {
+		*p = '\0';
+		asm_define(u, asm_sym(u, s));
+		return;
+	}
+
+	m = s;
+	for (; *s && !isspace((unsigned char) *s); s++);
+	if (*s != '\0') {
+		*s++ = '\0';
+		while (isspace((unsigned char) *s))
+			s++;
+		args[n++] = s;
+		if ((p = strstr(s, ", ")) != NULL) {
+			*p = '\0';
+			args[n++] = p + 2;
+		}
+	}
+
+	if (n > 0)
+		parse_operand(u, args[0], &ops[0]);
+	if (n > 1)
+		parse_operand(u, args[1], &ops[1]);
+
+	encode(u, m, n, &ops[0], &ops[1]);
+}
+
+void asm_init(struct asm_unit *u)
+{
+	memset(u, 0, sizeof(*u));
+	u->names = symtab_new(NULL);
+}
+
+/* assembles text, which is modified in the process, onto the end of the
+   code */
+void asm_text(struct asm_unit *u, char *text)
+{
+	char *line, *next;
+
+	for (line = text; line; line = next) {
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+		assemble_line(u, line);
+	}
+}
+
+struct asm_sym *asm_sym(struct asm_unit *u, const char *name)
+{
+	struct asm_sym *sym;
+	char *key = lx_intern(name);
+
+	if ((sym = symtab_get(u->names, key)) != NULL)
+		return sym;
+
+	sym = malloc(sizeof(*sym));
+	sym->name = key;
+	sym->off = -1;
+	sym->index = 0;
+	sym->global = 0;
+	sym->next = u->syms;
+	u->syms = sym;
+	symtab_set(u->names, key, sym);
+
+	return sym;
+}
+
+void asm_define(struct asm_unit *u, struct asm_sym *sym)
+{
+	if (sym->off >= 0)
+		asm_error("name defined twice", sym->name);
+	sym->off = u->len;
+}
+
+/* patches every reference to a name that has been defined, and leaves the
+   rest in u->fixups */
+void asm_resolve(struct asm_unit *u)
+{
+	struct asm_fixup *f, *next, *left = NULL;
+	int disp;
+
+	for (f = u->fixups; f; f = next) {
+		next = f->next;
+		if (f->sym->off < 0) {
+			f->next = left;
+			left = f;
+			continue;
+		}
+		disp = f->sym->off - (f->off + 4);
+		memcpy(u->code + f->off, &disp, 4);
+		free(f);
+	}
+
+	u->fixups = left;
+}
+
+void asm_free(struct asm_unit *u)
+{
+	struct asm_fixup *f, *fn;
+	struct asm_sym *s, *sn;
+
+	for (f = u->fixups; f; f = fn) {
+		fn = f->next;
+		free(f);
+	}
+	for (s = u->syms; s; s = sn) {
+		sn = s->next;
+		free(s);
+	}
+	symtab_free(u->names);
+	free(u->code);
+}
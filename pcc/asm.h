@@ -0,0 +1,43 @@
+/* machine code for the assembly the code generator emits */
+
+#ifndef __INC_ASM_H__
+#define __INC_ASM_H__
+
+/* a name in the code. off is -1 until the name is defined, and index is
+   the name's place in an object's symbol table */
+struct asm_sym {
+	char *name;
+	long off, index;
+	int global;
+	struct asm_sym *next;
+};
+
+enum asm_fixup_kind { FIXUP_BRANCH, FIXUP_ADDRESS };
+
+/* a 32 bit displacement at off, relative to the end of it, to name */
+struct asm_fixup {
+	enum asm_fixup_kind kind;
+	struct asm_sym *sym;
+	long off;
+	struct asm_fixup *next;
+};
+
+struct asm_unit {
+	unsigned char *code;
+	long len, size;
+	struct asm_sym *syms; /* in reverse order of first mention */
+	struct asm_fixup *fixups;
+	struct symtab *names;
+	const char *line;
+};
+
+extern void asm_init(struct asm_unit *u);
+extern void asm_text(struct asm_unit *u, char *text);
+extern void asm_byte(struct asm_unit *u, int b);
+extern void asm_imm32(struct asm_unit *u, long n);
+extern struct asm_sym *asm_sym(struct asm_unit *u, const char *name);
+extern void asm_define(struct asm_unit *u, struct asm_sym *sym);
+extern void asm_resolve(struct asm_unit *u);
+extern void asm_free(struct asm_unit *u);
+
+#endif
@@ -0,0 +1,92 @@
+/* in-process execution. the assembly the code generator emits for -m64 is
+   assembled into memory, instead of being written out for an external
+   assembler and linker, and called directly.
+
+   names that aren't defined by the program are looked up in the running
+   process, and are reached through a small table of indirect jumps placed
+   after the code, since they may be further away than a 32 bit
+   displacement reaches. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include "asm.h"
+#include "jit.h"
+
+/* adds an indirect jump for every name defined outside of the program,
+   and copies the code into executable memory */
+static unsigned char *jit_link(struct asm_unit *u)
+{
+	struct asm_fixup *f;
+	unsigned char *mem;
+	void *addr;
+
+	for (f = u->fixups; f; f = f->next) {
+		if (f->sym->off >= 0)
+			continue;
+		if ((addr = dlsym(RTLD_DEFAULT, f->sym->name)) == NULL) {
+			fprintf(stderr, "jit error: undefined symbol %s\n",
+			        f->sym->name);
+			exit(6);
+		}
+
+		/* jmp *0(%rip), followed by the address */
+		asm_define(u, f->sym);
+		asm_byte(u, 0xff);
+		asm_byte(u, 0x25);
+		asm_imm32(u, 0);
+		asm_imm32(u, (long) addr);
+		asm_imm32(u, (long) addr >> 32);
+	}
+
+	asm_resolve(u);
+
+	mem = mmap(NULL, u->len, PROT_READ | PROT_WRITE,
+	           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("jit: mmap");
+		exit(6);
+	}
+	memcpy(mem, u->code, u->len);
+	if (mprotect(mem, u->len, PROT_READ | PROT_EXEC) < 0) {
+		perror("jit: mprotect");
+		exit(6);
+	}
+
+	return mem;
+}
+
+long jit_run(char *text, const char *entry, int argc, long *argv)
+{
+	struct asm_unit u;
+	struct asm_sym *fn;
+	unsigned char *mem;
+	long args[6] = { 0 }, ret, len;
+	int i;
+
+	asm_init(&u);
+	asm_text(&u, text);
+
+	if ((fn = asm_sym(&u, entry))->off < 0) {
+		fprintf(stderr, "jit error: no fn %s\n", entry);
+		exit(6);
+	}
+
+	mem = jit_link(&u);
+	len = u.len;
+
+	for (i=0; i<argc && i<6; i++)
+		args[i] = argv[i];
+
+	ret = ((long (*)(long, long, long, long, long, long))
+	       (mem + fn->off))(args[0], args[1], args[2], args[3],
+	                          args[4], args[5]);
+
+	munmap(mem, len);
+	asm_free(&u);
+
+	return ret;
+}
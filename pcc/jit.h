@@ -0,0 +1,11 @@
+/* in-process execution of generated code */
+
+#ifndef __INC_JIT_H__
+#define __INC_JIT_H__
+
+/* encodes the 64 bit assembly in text, which is modified in the process,
+   into executable memory, and calls the fn entry with up to six arguments,
+   returning its result */
+extern long jit_run(char *text, const char *entry, int argc, long *argv);
+
+#endif
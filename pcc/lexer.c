@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "lexer.h"
 
 #define dfprintf(X...) do{}while(0)
@@ -12,6 +13,7 @@ void lx_error(const char *m)
 
 FILE *lx_file;
 char lx_tokstr[2048];
+char *lx_tokid; /* lx_tokstr, interned, when the token is T_ID */
 
 const char *lx_names[] = {
 	[T_INVALID] = "(invalid token)",
@@ -50,6 +52,71 @@ const char *lx_names[] = {
 
 static enum lx_token ungotten = T_INVALID;
 
+/* every distinct identifier is stored once, so that names can be compared
+   and hashed by address. this is a hash table of chains, doubled in size
+   whenever it gets as many names as it has buckets */
+struct lx_name {
+	struct lx_name *next;
+	char s[];
+};
+
+static struct lx_name **names;
+static unsigned names_size, names_count;
+
+static unsigned lx_hash(const char *s)
+{
+	unsigned h = 2166136261u;
+
+	for (; *s; s++)
+		h = (h ^ (unsigned char) *s) * 16777619u;
+	return h;
+}
+
+static void lx_grow_names(void)
+{
+	struct lx_name **old = names, *n, *next;
+	unsigned i, size = names_size, h;
+
+	names_size = names_size ? names_size << 1 : 256;
+	names = calloc(names_size, sizeof(*names));
+
+	for (i=0; i<size; i++) {
+		for (n = old[i]; n; n = next) {
+			next = n->next;
+			h = lx_hash(n->s) & (names_size - 1);
+			n->next = names[h];
+			names[h] = n;
+		}
+	}
+
+	free(old);
+}
+
+char *lx_intern(const char *s)
+{
+	struct lx_name *n;
+	unsigned h;
+	size_t len;
+
+	if (names_count >= names_size)
+		lx_grow_names();
+
+	h = lx_hash(s) & (names_size - 1);
+	for (n = names[h]; n; n = n->next) {
+		if (!strcmp(n->s, s))
+			return n->s;
+	}
+
+	len = strlen(s) + 1;
+	n = malloc(sizeof(*n) + len);
+	memcpy(n->s, s, len);
+	n->next = names[h];
+	names[h] = n;
+	names_count++;
+
+	return n->s;
+}
+
 static enum lx_token scan_id(void)
 {
 	char *s = lx_tokstr;
@@ -73,6 +140,8 @@ static enum lx_token scan_id(void)
 
 	dfprintf(stderr, "--- %s %s\n", lx_names[T_ID], lx_tokstr);
 
+	lx_tokid = lx_intern(lx_tokstr);
+
 	return T_ID;
 }
 
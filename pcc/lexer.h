@@ -41,6 +41,9 @@ enum lx_token
 
 extern const char *lx_names[];
 extern char lx_tokstr[];
+extern char *lx_tokid;
+
+extern char *lx_intern(const char *s);
 
 extern enum lx_token lx_token(void);
 extern void lx_unget(enum lx_token);
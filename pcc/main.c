@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 #include "lexer.h"
 #include "parse.h"
 #include "sem.h"
+#include "jit.h"
+#include "obj.h"
 
 static void ice(const char *m, ...)
 {
@@ -16,102 +19,524 @@ static void ice(const char *m, ...)
 	exit(5);
 }
 
+static FILE *out;
+
 static void emit(const char *m, ...)
 {
-	char buf[65536];
 	va_list va;
 	va_start(va, m);
-	vsnprintf(buf, 65536, m, va);
+	vfprintf(out, m, va);
 	va_end(va);
-	printf("%s\n", buf);
+	putc('\n', out);
+}
+
+/* expressions are compiled with Sethi-Ullman numbering. each expression is
+   labelled with the number of registers it needs, and the operand needing
+   more is evaluated first, so that the result of the other can be held in
+   a register while it is. only when both operands need every register is
+   anything spilled to the stack.
+
+   every code generator below is given a list of registers it may use, and
+   leaves its result in the first one. anything not on the list is holding
+   a value the caller still needs. */
+
+/* with -m64, code is generated for x86-64 and the System V calling
+   convention instead of 32 bit x86 and cdecl. values are then 64 bits
+   wide, and the first six arguments are passed in registers */
+static int m64;
+
+#define W (m64 ? 8 : 4)
+#define Q (m64 ? "q" : "l")
+#define SP (m64 ? "%rsp" : "%esp")
+#define BP (m64 ? "%rbp" : "%ebp")
+
+/* the first three are the same registers in both modes. the last two are
+   ones the callee has to preserve, which are different in each */
+enum reg { AX, CX, DX, S0, S1, NREGS };
+
+static const char *reg_names[2][NREGS] = {
+	{ "%eax", "%ecx", "%edx", "%esi", "%edi" },
+	{ "%rax", "%rcx", "%rdx", "%rbx", "%r12" },
+};
+static const char *reg_bytes[2][NREGS] = {
+	{ "%al", "%cl", "%dl", NULL, NULL },
+	{ "%al", "%cl", "%dl", "%bl", "%r12b" },
+};
+
+#define R(r) reg_names[m64][r]
+
+/* S0 and S1 are preserved across calls, and have to be saved by any
+   function which uses them */
+#define CALLER_SAVED ((1 << AX) | (1 << CX) | (1 << DX))
+#define CALLEE_SAVED ((1 << S0) | (1 << S1))
+
+static const char *arg_regs[] = { "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" };
+#define NARG_REGS 6
+
+/* an application clobbers every caller saved register, so it is treated
+   as needing more registers than there are */
+#define NEED_CALL (NREGS + 1)
+
+static int L = 1;
+static unsigned regs_used;
+
+/* the function being generated, the label just after its prologue, which
+   of the callee saved registers its prologue saves, and whether it makes
+   any tail calls to other functions */
+static struct s_fn_decl *cur_fn;
+static int body_label;
+static unsigned regs_saved;
+static int tail_exits;
+
+/* bytes pushed since the frame was set up, since calls in 64 bit code
+   need the stack aligned to 16 bytes */
+static int depth;
+
+static void emit_push(const char *src)
+{
+	emit("\tpush%s\t%s", Q, src);
+	depth += W;
+}
+
+static void emit_pop(const char *dst)
+{
+	emit("\tpop%s\t%s", Q, dst);
+	depth -= W;
+}
+
+/* 64 bit code copies the arguments passed in registers to the bottom of
+   the frame, so that all arguments can be used as memory operands */
+static int arg_offset(int n)
+{
+	if (!m64)
+		return 8 + (n << 2);
+	if (n < NARG_REGS)
+		return -8 * (n + 1);
+	return 16 + 8 * (n - NARG_REGS);
+}
+
+static void emit_expr(struct s_expr *ex, const enum reg *regs, int n);
+
+/* determines if ex can be used directly as the source operand of an
+   instruction, and formats it if so */
+static int operand(struct s_expr *ex, char *buf, size_t len)
+{
+	switch (ex->type) {
+	case S_EXPR_IMMEDIATE:
+		snprintf(buf, len, "$%d", ex->n);
+		return 1;
+
+	case S_EXPR_ARGUMENT:
+		snprintf(buf, len, "%d(%s)", arg_offset(ex->n), BP);
+		return 1;
+
+	case S_EXPR_LABEL:
+		/* addresses are loaded relative to %rip in 64 bit code */
+		if (m64)
+			return 0;
+		snprintf(buf, len, "$%s", ex->id);
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+static int max(int a, int b)
+{
+	return a > b ? a : b;
+}
+
+/* the Sethi-Ullman number of ex */
+static int need(struct s_expr *ex)
+{
+	char buf[64];
+	int l, r;
+
+	switch (ex->type) {
+	case S_EXPR_IMMEDIATE:
+	case S_EXPR_ARGUMENT:
+	case S_EXPR_LABEL:
+		return 1;
+
+	case S_EXPR_UNARY_OPERATION:
+		return need(ex->child[0]);
+
+	case S_EXPR_BINARY_OPERATION:
+		l = need(ex->child[0]);
+		if (ex->op == T_COMMA)
+			return max(l, need(ex->child[1]));
+		if (operand(ex->child[1], buf, sizeof buf))
+			return l;
+		r = need(ex->child[1]);
+		if (l >= NEED_CALL || r >= NEED_CALL)
+			return NEED_CALL;
+		return l == r ? l + 1 : max(l, r);
+
+	case S_EXPR_CONDITIONAL:
+		return max(need(ex->child[0]),
+		           max(need(ex->child[1]), need(ex->child[2])));
+
+	case S_EXPR_APPLICATION:
+		return NEED_CALL;
+
+	default:
+		ice("unexpected expression type");
+		return 0;
+	}
+}
+
+/* evaluates the operands of a binary operation. the left one is left in
+   the returned register, and the right one is written to rhs as a
+   register, an immediate, or a memory operand. if the right operand had to
+   be spilled, *spill is set, and the caller has to pop it off the stack
+   once it's been used */
+static enum reg emit_operands(struct s_expr *ex, const enum reg *regs, int n,
+                              char *rhs, size_t len, int *spill)
+{
+	struct s_expr *a = ex->child[0], *b = ex->child[1];
+	enum reg sub[NREGS];
+	int l, r, i, k;
+
+	*spill = 0;
+
+	if (operand(b, rhs, len)) {
+		emit_expr(a, regs, n);
+		return regs[0];
+	}
+
+	l = need(a);
+	r = need(b);
+
+	/* the right operand can be computed without the register holding
+	   the left one, either after it or, if the left one doesn't care, in
+	   a register of its own before it */
+	if (r < n && (l >= r || !s_is_pure(a))) {
+		emit_expr(a, regs, n);
+		emit_expr(b, regs + 1, n - 1);
+		snprintf(rhs, len, "%s", R(regs[1]));
+		return regs[0];
+	}
+
+	if (r < n) {
+		sub[0] = regs[1];
+		sub[1] = regs[0];
+		for (i=2; i<n; i++)
+			sub[i] = regs[i];
+		emit_expr(b, sub, n);
+		emit_expr(a, sub + 1, n - 1);
+		snprintf(rhs, len, "%s", R(regs[1]));
+		return regs[0];
+	}
+
+	/* the right operand needs everything. if it is a call, the left can
+	   be kept in a callee saved register for the duration */
+	for (k=1; k<n; k++) {
+		if ((1 << regs[k]) & CALLEE_SAVED)
+			break;
+	}
+
+	if (k < n && r >= NEED_CALL) {
+		sub[0] = regs[k];
+		for (i=0, r=1; i<n; i++) {
+			if (i != k)
+				sub[r++] = regs[i];
+		}
+		emit_expr(a, sub, n);
+		emit_expr(b, sub + 1, n - 1);
+		snprintf(rhs, len, "%s", R(regs[0]));
+		return regs[k];
+	}
+
+	/* otherwise, one of them goes on the stack */
+	if (n > 1) {
+		emit_expr(a, regs, n);
+		emit_push(R(regs[0]));
+		emit_expr(b, regs, n);
+		emit("\tmov%s\t%s, %s", Q, R(regs[0]), R(regs[1]));
+		emit_pop(R(regs[0]));
+		snprintf(rhs, len, "%s", R(regs[1]));
+		return regs[0];
+	}
+
+	emit_expr(b, regs, n);
+	emit_push(R(regs[0]));
+	emit_expr(a, regs, n);
+	snprintf(rhs, len, "(%s)", SP);
+	*spill = 1;
+	return regs[0];
+}
+
+/* lea doesn't touch the flags, so this can go between a comparison and
+   the instruction that uses its result */
+static void emit_unspill(int spill)
+{
+	if (spill) {
+		emit("\tlea%s\t%d(%s), %s", Q, W, SP, SP);
+		depth -= W;
+	}
+}
+
+static const char *cond_code(enum lx_token op)
+{
+	switch (op) {
+	case T_EQ: return "e";
+	case T_NE: return "ne";
+	case T_GT: return "g";
+	case T_LT: return "l";
+	default:   return NULL;
+	}
 }
 
-static void emit_expr(struct s_expr *ex);
+static const char *inverse_cond_code(const char *cc)
+{
+	switch (cc[0]) {
+	case 'e': return "ne";
+	case 'n': return "e";
+	case 'g': return "le";
+	case 'l': return "ge";
+	default:  return NULL;
+	}
+}
+
+/* sets r to 1 if the flags satisfy cc, or to 0 otherwise */
+static void emit_setcc(const char *cc, enum reg r)
+{
+	int skip;
+
+	if (reg_bytes[m64][r] != NULL) {
+		emit("\tset%s\t%s", cc, reg_bytes[m64][r]);
+		emit("\tmovzb%s\t%s, %s", Q, reg_bytes[m64][r], R(r));
+		return;
+	}
+
+	/* %esi and %edi have no byte registers */
+	skip = L++;
+	emit("\tmov%s\t$1, %s", Q, R(r));
+	emit("\tj%s\t.L%d", cc, skip);
+	emit("\tmov%s\t$0, %s", Q, R(r));
+	emit(".L%d:", skip);
+}
 
-static void emit_apply_args(struct s_apply_args *app)
+/* evaluates ex and jumps to label if it is false. comparisons branch on
+   the flags directly, without materializing a truth value */
+static void emit_branch_false(struct s_expr *ex, const enum reg *regs, int n,
+                              int label)
 {
+	const char *cc;
+	char rhs[64];
+	enum reg lhs;
+	int spill;
+
+	if (ex->type == S_EXPR_BINARY_OPERATION &&
+	    (cc = cond_code(ex->op)) != NULL) {
+		lhs = emit_operands(ex, regs, n, rhs, sizeof rhs, &spill);
+		emit("\tcmp%s\t%s, %s", Q, rhs, R(lhs));
+		emit_unspill(spill);
+		emit("\tj%s\t.L%d", inverse_cond_code(cc), label);
+		return;
+	}
+
+	emit_expr(ex, regs, n);
+	emit("\ttest%s\t%s, %s", Q, R(regs[0]), R(regs[0]));
+	emit("\tje\t.L%d", label);
+}
+
+/* pushes the arguments, last first. in 64 bit code, the ones passed in
+   registers are pushed too, and popped into place once every argument has
+   been computed, except for those which can be loaded directly */
+static void emit_apply_args(struct s_apply_args *app, int k,
+                            const enum reg *regs, int n)
+{
+	char buf[64];
+
 	if (app == NULL)
 		return;
 
-	emit_apply_args(app->next);
+	emit_apply_args(app->next, k + 1, regs, n);
 
-	emit_expr(app->ex);
-	emit("\tpushl\t%%eax");
+	if (operand(app->ex, buf, sizeof buf)) {
+		if (!m64 || k >= NARG_REGS)
+			emit_push(buf);
+	} else {
+		emit_expr(app->ex, regs, n);
+		emit_push(R(regs[0]));
+	}
 }
 
-static void emit_apply(struct s_apply *app)
+static void emit_arg_regs(struct s_apply_args *app)
 {
-	emit_apply_args(app->args);
+	struct s_apply_args *arg;
+	char buf[64];
+	int k;
+
+	for (arg=app, k=0; arg && k<NARG_REGS; arg=arg->next, k++) {
+		if (!operand(arg->ex, buf, sizeof buf))
+			emit_pop(arg_regs[k]);
+	}
+
+	for (arg=app, k=0; arg && k<NARG_REGS; arg=arg->next, k++) {
+		if (operand(arg->ex, buf, sizeof buf))
+			emit("\tmovq\t%s, %s", buf, arg_regs[k]);
+	}
+}
+
+/* the registers not in regs are holding values, and the call would clobber
+   the caller saved ones, so they are saved around it */
+static void emit_apply(struct s_apply *app, const enum reg *regs, int n)
+{
+	unsigned busy = CALLER_SAVED;
+	int i, nstack, pad = 0;
+
+	for (i=0; i<n; i++)
+		busy &= ~(1 << regs[i]);
+
+	for (i=0; i<NREGS; i++) {
+		if (busy & (1 << i))
+			emit_push(R(i));
+	}
+
+	nstack = app->nargs;
+	if (m64) {
+		nstack = nstack > NARG_REGS ? nstack - NARG_REGS : 0;
+		if ((depth + (nstack << 3)) % 16 != 0) {
+			pad = 8;
+			emit("\tsubq\t$%d, %%rsp", pad);
+			depth += pad;
+		}
+	}
+
+	emit_apply_args(app->args, 0, regs, n);
+
+	/* the argument registers include some of ours, so in 64 bit code the
+	   function is called through %r11, which is neither */
+	if (app->fn->type != S_EXPR_LABEL) {
+		emit_expr(app->fn, regs, n);
+		if (m64)
+			emit("\tmovq\t%s, %%r11", R(regs[0]));
+	}
+
+	if (m64) {
+		emit_arg_regs(app->args);
+		/* %al tells a variadic callee how many vector registers are
+		   used to pass arguments */
+		emit("\tmovl\t$0, %%eax");
+	}
 
 	switch (app->fn->type) {
 	case S_EXPR_LABEL:
-		emit("\tcall\t%s", app->fn->id);
+		emit("\tcall\t%s%s", app->fn->id, m64 ? "@PLT" : "");
 		break;
 	default:
-		emit_expr(app->fn);
-		emit("\tcall\t%%eax");
+		emit("\tcall\t*%s", m64 ? "%r11" : R(regs[0]));
 		break;
 	}
 
-	if (app->nargs > 0)
-		emit("\taddl\t$%d, %%esp", app->nargs << 2);
+	if (nstack * W + pad > 0) {
+		emit("\tadd%s\t$%d, %s", Q, nstack * W + pad, SP);
+		depth -= nstack * W + pad;
+	}
+
+	if (regs[0] != AX)
+		emit("\tmov%s\t%s, %s", Q, R(AX), R(regs[0]));
+
+	for (i=NREGS-1; i>=0; i--) {
+		if (busy & (1 << i))
+			emit_pop(R(i));
+	}
 }
 
-static void emit_expr(struct s_expr *ex)
+static void emit_binary(struct s_expr *ex, const enum reg *regs, int n)
+{
+	const char *cc, *insn = NULL;
+	char rhs[64];
+	enum reg lhs;
+	int spill;
+
+	if (ex->op == T_COMMA) {
+		emit_expr(ex->child[0], regs, n);
+		emit_expr(ex->child[1], regs, n);
+		return;
+	}
+
+	switch (ex->op) {
+	case T_ADD: insn = "add"; break;
+	case T_SUB: insn = "sub"; break;
+	case T_MUL: insn = "imul"; break;
+	case T_AND: insn = "and"; break;
+	case T_OR:  insn = "or"; break;
+	case T_XOR: insn = "xor"; break;
+	case T_LSH:
+		/* only ever by a constant, from folding a multiplication */
+		if (ex->child[1]->type != S_EXPR_IMMEDIATE)
+			ice("`%s' unimplemented", lx_names[ex->op]);
+		insn = "shl";
+		break;
+	default:
+		if ((cc = cond_code(ex->op)) == NULL)
+			ice("`%s' unimplemented", lx_names[ex->op]);
+		break;
+	}
+
+	lhs = emit_operands(ex, regs, n, rhs, sizeof rhs, &spill);
+
+	if (insn == NULL) {
+		emit("\tcmp%s\t%s, %s", Q, rhs, R(lhs));
+		emit_unspill(spill);
+		emit_setcc(cc, regs[0]);
+		return;
+	}
+
+	/* the left operand may have been kept in another register. when the
+	   operation commutes, the result can go straight into regs[0] */
+	if (lhs != regs[0] && ex->op != T_SUB) {
+		emit("\t%s%s\t%s, %s", insn, Q, R(lhs), R(regs[0]));
+		return;
+	}
+
+	emit("\t%s%s\t%s, %s", insn, Q, rhs, R(lhs));
+	emit_unspill(spill);
+
+	if (lhs != regs[0])
+		emit("\tmov%s\t%s, %s", Q, R(lhs), R(regs[0]));
+}
+
+/* evaluates ex into regs[0], using only the first n registers in regs */
+static void emit_expr(struct s_expr *ex, const enum reg *regs, int n)
 {
-	static int L = 1;
-	const char *cc = NULL;
 	int no, out; /* for cond. */
 
+	if (n < 1)
+		ice("out of registers");
+
+	regs_used |= 1 << regs[0];
+
 	switch (ex->type) {
 	case S_EXPR_IMMEDIATE:
-		emit("\tmovl\t$%d, %%eax", ex->n);
+		emit("\tmov%s\t$%d, %s", Q, ex->n, R(regs[0]));
 		break;
 
 	case S_EXPR_ARGUMENT:
-		emit("\tmovl\t%d(%%ebp), %%eax", 8 + (ex->n << 2));
+		emit("\tmov%s\t%d(%s), %s", Q, arg_offset(ex->n), BP,
+		     R(regs[0]));
 		break;
 
 	case S_EXPR_LABEL:
-		emit("\tmovl\t$%s, %%eax", ex->n);
+		if (m64)
+			emit("\tleaq\t%s(%%rip), %s", ex->id, R(regs[0]));
+		else
+			emit("\tmovl\t$%s, %s", ex->id, R(regs[0]));
 		break;
 
 	case S_EXPR_UNARY_OPERATION:
-		emit_expr(ex->child[0]);
+		emit_expr(ex->child[0], regs, n);
 		switch (ex->op) {
 		case T_LBRACK:
-			emit("\tmovl\t0(%%eax), %%eax");
+			emit("\tmov%s\t0(%s), %s", Q, R(regs[0]), R(regs[0]));
 			break;
 		case T_NEG:
-			ice("T_NEG unimplemented");
-			break;
-		}
-		break;
-
-	case S_EXPR_BINARY_OPERATION:
-		emit_expr(ex->child[0]);
-		emit("\tpushl\t%%eax");
-		emit_expr(ex->child[1]);
-		emit("\tmovl\t%%eax, %%ebx");
-		emit("\tpopl\t%%eax");
-
-		switch (ex->op) {
-		case T_ADD:
-			emit("\taddl\t%%ebx, %%eax");
-			break;
-		case T_SUB:
-			emit("\tsubl\t%%ebx, %%eax");
-			break;
-		case T_EQ: cc = cc ? cc : "z";
-		case T_NE: cc = cc ? cc : "nz";
-		case T_GT: cc = cc ? cc : "g";
-		case T_LT: cc = cc ? cc : "l";
-			emit("\tcmpl\t%%ebx, %%eax");
-			emit("\tset%s\t%%al", cc);
-			emit("\tmovzbl\t%%al, %%eax");
-			break;
-		case T_COMMA:
-			emit("\tmovl\t%%ebx, %%eax");
+			emit("\ttest%s\t%s, %s", Q, R(regs[0]), R(regs[0]));
+			emit_setcc("e", regs[0]);
 			break;
 		default:
 			ice("`%s' unimplemented", lx_names[ex->op]);
@@ -119,22 +544,24 @@ static void emit_expr(struct s_expr *ex)
 		}
 		break;
 
+	case S_EXPR_BINARY_OPERATION:
+		emit_binary(ex, regs, n);
+		break;
+
 	case S_EXPR_CONDITIONAL:
 		no = L++;
 		out = L++;
 
-		emit_expr(ex->child[0]);
-		emit("\tcmpl\t$0, %%eax");
-		emit("\tje\t.L%d", no);
-		emit_expr(ex->child[1]);
+		emit_branch_false(ex->child[0], regs, n, no);
+		emit_expr(ex->child[1], regs, n);
 		emit("\tjmp\t.L%d", out);
 		emit(".L%d:", no);
-		emit_expr(ex->child[2]);
+		emit_expr(ex->child[2], regs, n);
 		emit(".L%d:", out);
 		break;
 
 	case S_EXPR_APPLICATION:
-		emit_apply(ex->app);
+		emit_apply(ex->app, regs, n);
 		break;
 
 	default:
@@ -142,20 +569,291 @@ static void emit_expr(struct s_expr *ex)
 	}
 }
 
+/* in 64 bit code, the callee saved registers are kept in the frame after
+   the arguments passed in registers */
+static int frame_args(void)
+{
+	if (!m64)
+		return 0;
+	return cur_fn->nargs < NARG_REGS ? cur_fn->nargs : NARG_REGS;
+}
+
+static void emit_restore_regs(void)
+{
+	int i, k;
+
+	if (m64) {
+		for (i=0, k=frame_args(); i<NREGS; i++) {
+			if (regs_saved & (1 << i))
+				emit("\tmovq\t%d(%%rbp), %s", -8 * ++k, R(i));
+		}
+	} else {
+		for (i=NREGS-1; i>=0; i--) {
+			if (regs_saved & (1 << i))
+				emit("\tpopl\t%s", R(i));
+		}
+	}
+}
+
+/* where argument k of a tail call goes. a call to the function itself
+   reuses its own frame, where the arguments passed in registers have
+   been stored */
+static void tail_arg_dst(int self, int k, char *buf, size_t len)
+{
+	if (m64 && !self && k < NARG_REGS)
+		snprintf(buf, len, "%s", arg_regs[k]);
+	else
+		snprintf(buf, len, "%d(%s)", arg_offset(k), BP);
+}
+
+/* arguments which are constants, or which are in places that won't be
+   overwritten, are stored after the others have been computed, and a
+   function passing its own argument to itself in the same place doesn't
+   need to do anything with it */
+enum tail_arg { TAIL_ARG_VALUE, TAIL_ARG_CONST, TAIL_ARG_SAME };
+
+static enum tail_arg tail_arg_kind(int self, int k, struct s_expr *ex)
+{
+	char buf[64];
+
+	if (self && ex->type == S_EXPR_ARGUMENT && ex->n == k)
+		return TAIL_ARG_SAME;
+	if (ex->type == S_EXPR_ARGUMENT)
+		return m64 && !self && ex->n < NARG_REGS && k < NARG_REGS ?
+		       TAIL_ARG_CONST : TAIL_ARG_VALUE;
+	if (operand(ex, buf, sizeof buf))
+		return TAIL_ARG_CONST;
+	return TAIL_ARG_VALUE;
+}
+
+static void emit_tail_push(struct s_apply_args *arg, int self, int k,
+                           const enum reg *regs, int n)
+{
+	char buf[64];
+
+	if (arg == NULL)
+		return;
+
+	emit_tail_push(arg->next, self, k + 1, regs, n);
+
+	if (tail_arg_kind(self, k, arg->ex) != TAIL_ARG_VALUE)
+		return;
+
+	if (operand(arg->ex, buf, sizeof buf)) {
+		emit_push(buf);
+	} else {
+		emit_expr(arg->ex, regs, n);
+		emit_push(R(regs[0]));
+	}
+}
+
+/* a call in tail position doesn't need a frame of its own. the new
+   arguments are written over the old ones, and either the function jumps
+   back to its own start, or it tears down its frame and jumps to the
+   callee, which then returns straight to our caller. this needs the
+   callee to take no more arguments on the stack than we were given, since
+   our caller pops the arguments it pushed for us.
+
+   every argument is computed before any is stored, since they may read
+   the arguments being overwritten. where there are enough registers, the
+   values are held in them; otherwise they go on the stack. in 64 bit code,
+   the argument registers include some of ours, so calls to other functions
+   always take the second route. */
+static int emit_tail_apply(struct s_apply *app, const enum reg *regs, int n)
+{
+	struct s_apply_args *arg;
+	enum tail_arg kind;
+	char buf[64], dst[64];
+	int self, k, v, stack, cur_stack;
+
+	if (app->fn->type != S_EXPR_LABEL)
+		return 0;
+
+	self = !strcmp(app->fn->id, cur_fn->name);
+	stack = app->nargs;
+	cur_stack = cur_fn->nargs;
+	if (m64 && !self) {
+		stack = stack > NARG_REGS ? stack - NARG_REGS : 0;
+		cur_stack = cur_stack > NARG_REGS ? cur_stack - NARG_REGS : 0;
+	}
+
+	if (self ? app->nargs != cur_fn->nargs : stack > cur_stack)
+		return 0;
+
+	for (arg=app->args, k=0, v=0; arg; arg=arg->next, k++) {
+		if (tail_arg_kind(self, k, arg->ex) == TAIL_ARG_VALUE)
+			v++;
+	}
+
+	if (v <= n && (self || !m64)) {
+		for (arg=app->args, k=0, v=0; arg; arg=arg->next, k++) {
+			if (tail_arg_kind(self, k, arg->ex) == TAIL_ARG_VALUE) {
+				emit_expr(arg->ex, regs + v, n - v);
+				v++;
+			}
+		}
+		for (arg=app->args, k=0, v=0; arg; arg=arg->next, k++) {
+			if (tail_arg_kind(self, k, arg->ex) == TAIL_ARG_VALUE) {
+				tail_arg_dst(self, k, dst, sizeof dst);
+				emit("\tmov%s\t%s, %s", Q, R(regs[v++]), dst);
+			}
+		}
+	} else {
+		emit_tail_push(app->args, self, 0, regs, n);
+		for (arg=app->args, k=0; arg; arg=arg->next, k++) {
+			if (tail_arg_kind(self, k, arg->ex) == TAIL_ARG_VALUE) {
+				tail_arg_dst(self, k, dst, sizeof dst);
+				emit_pop(dst);
+			}
+		}
+	}
+
+	for (arg=app->args, k=0; arg; arg=arg->next, k++) {
+		kind = tail_arg_kind(self, k, arg->ex);
+		if (kind == TAIL_ARG_CONST) {
+			operand(arg->ex, buf, sizeof buf);
+			tail_arg_dst(self, k, dst, sizeof dst);
+			emit("\tmov%s\t%s, %s", Q, buf, dst);
+		}
+	}
+
+	if (self) {
+		emit("\tjmp\t.L%d", body_label);
+		return 1;
+	}
+
+	emit_restore_regs();
+	emit("\tmov%s\t%s, %s", Q, BP, SP);
+	emit("\tpop%s\t%s", Q, BP);
+	if (m64)
+		emit("\tmovl\t$0, %%eax");
+	emit("\tjmp\t%s%s", app->fn->id, m64 ? "@PLT" : "");
+	tail_exits = 1;
+
+	return 1;
+}
+
+/* evaluates ex, whose value is to be returned, into regs[0]. returns
+   nonzero if control never comes back, because ex ends in a tail call */
+static int emit_tail(struct s_expr *ex, const enum reg *regs, int n)
+{
+	int no, out, gone; /* for cond. */
+
+	switch (ex->type) {
+	case S_EXPR_CONDITIONAL:
+		no = L++;
+		out = L++;
+
+		regs_used |= 1 << regs[0];
+		emit_branch_false(ex->child[0], regs, n, no);
+		gone = emit_tail(ex->child[1], regs, n);
+		if (!gone)
+			emit("\tjmp\t.L%d", out);
+		emit(".L%d:", no);
+		gone = emit_tail(ex->child[2], regs, n) && gone;
+		emit(".L%d:", out);
+		return gone;
+
+	case S_EXPR_BINARY_OPERATION:
+		if (ex->op != T_COMMA)
+			break;
+		emit_expr(ex->child[0], regs, n);
+		return emit_tail(ex->child[1], regs, n);
+
+	case S_EXPR_APPLICATION:
+		regs_used |= 1 << regs[0];
+		if (emit_tail_apply(ex->app, regs, n))
+			return 1;
+		break;
+
+	default:
+		break;
+	}
+
+	emit_expr(ex, regs, n);
+	return 0;
+}
+
+static char *emit_body(struct s_fn_decl *fn)
+{
+	static const enum reg regs[NREGS] = { AX, CX, DX, S0, S1 };
+	FILE *file = out;
+	char *body;
+	size_t len;
+
+	regs_used = 0;
+	depth = 0;
+	tail_exits = 0;
+	if ((out = open_memstream(&body, &len)) == NULL)
+		ice("could not buffer function body");
+	emit_tail(fn->body, regs, NREGS);
+	fclose(out);
+	out = file;
+
+	return body;
+}
+
+/* the body is generated first, into a buffer, since which of the callee
+   saved registers need saving isn't known until it has been. a tail call
+   to another function has to restore them, so if there are any, the body
+   is generated again once it is known which they are. in 64 bit code, they
+   are saved in the frame after the arguments passed in registers, and the
+   frame is padded to keep the stack aligned */
 static void emit_fn_decl(struct s_fn_decl *fn)
 {
+	char *body;
+	int i, k, first = L, frame;
+
+	cur_fn = fn;
+	body_label = L++;
+	regs_saved = 0;
+	body = emit_body(fn);
+
+	if (tail_exits && (regs_used & CALLEE_SAVED)) {
+		free(body);
+		L = first + 1;
+		regs_saved = regs_used & CALLEE_SAVED;
+		body = emit_body(fn);
+	}
+
+	regs_saved = regs_used & CALLEE_SAVED;
+
 	emit("\n\t.globl %s", fn->name);
 	emit("%s:", fn->name);
 
-	emit("\tpushl\t%%ebp");
-	emit("\tmovl\t%%esp, %%ebp");
-	emit("");
+	emit("\tpush%s\t%s", Q, BP);
+	emit("\tmov%s\t%s, %s", Q, SP, BP);
 
-	emit_expr(fn->body);
+	if (m64) {
+		frame = frame_args();
+		for (i=0; i<NREGS; i++) {
+			if (regs_saved & (1 << i))
+				frame++;
+		}
+		frame = ((frame << 3) + 15) & ~15;
+		if (frame > 0)
+			emit("\tsubq\t$%d, %%rsp", frame);
+		for (k=0; k<frame_args(); k++)
+			emit("\tmovq\t%s, %d(%%rbp)", arg_regs[k], arg_offset(k));
+	}
+
+	for (i=0, k=frame_args(); i<NREGS; i++) {
+		if (!(regs_saved & (1 << i)))
+			continue;
+		if (m64)
+			emit("\tmovq\t%s, %d(%%rbp)", R(i), -8 * ++k);
+		else
+			emit("\tpushl\t%s", R(i));
+	}
+	emit(".L%d:", body_label);
+
+	fputs(body, out);
+	free(body);
 
 	emit("");
-	emit("\tmovl\t%%ebp, %%esp");
-	emit("\tpopl\t%%ebp");
+	emit_restore_regs();
+	emit("\tmov%s\t%s, %s", Q, BP, SP);
+	emit("\tpop%s\t%s", Q, BP);
 	emit("\tret");
 }
 
@@ -175,17 +873,110 @@ static void emit_decls(struct s_decls *decl)
 static void emit_program(struct s_program *prog)
 {
 	emit_decls(prog->decls);
+
+	/* without this, linkers assume the stack needs to be executable */
+	if (m64)
+		emit("\n\t.section .note.GNU-stack,\"\",@progbits");
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-m32|-m64] < input.p > output.s\n", argv0);
+	fprintf(stderr, "       %s -c input.p\n", argv0);
+	fprintf(stderr, "       %s --run [args...] < input.p\n", argv0);
+	exit(1);
+}
+
+/* input.p becomes input.o, and anything else gets .o added */
+static char *object_name(const char *src)
+{
+	size_t len = strlen(src);
+	char *obj = malloc(len + 3);
+
+	strcpy(obj, src);
+	if (len > 2 && !strcmp(src + len - 2, ".p"))
+		len -= 2;
+	strcpy(obj + len, ".o");
+
+	return obj;
+}
+
+/* the assembler behind -c and --run only understands 64 bit code */
+static char *emit_text(struct s_program *prog)
+{
+	char *text;
+	size_t len;
+
+	m64 = 1;
+	if ((out = open_memstream(&text, &len)) == NULL)
+		ice("could not buffer program");
+	emit_program(prog);
+	fclose(out);
+
+	return text;
 }
 
 int main(int argc, char *argv[])
 {
 	struct p_program *p_prog;
 	struct s_program *s_prog;
+	char *src = NULL, *obj;
+	FILE *f;
+	long args[6];
+	int i, run = 0, nargs = 0;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-m32"))
+			m64 = 0;
+		else if (!strcmp(argv[i], "-m64"))
+			m64 = 1;
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc && !src)
+			src = argv[++i];
+		else if (!strcmp(argv[i], "--run") && !src)
+			run = 1;
+		else
+			usage(argv[0]);
+
+		/* everything after --run is passed to main */
+		if (run)
+			break;
+	}
+
+	for (i++; run && i<argc; i++) {
+		if (nargs == 6)
+			usage(argv[0]);
+		args[nargs++] = strtol(argv[i], NULL, 0);
+	}
 
+	if (src && freopen(src, "r", stdin) == NULL) {
+		perror(src);
+		exit(1);
+	}
+
+	out = stdout;
 	lx_init();
 
 	p_prog = p_program();
 	s_prog = s_program(p_prog);
 
-	emit_program(s_prog);
+	if (run)
+		return jit_run(emit_text(s_prog), "main", nargs, args);
+
+	if (!src) {
+		emit_program(s_prog);
+		return 0;
+	}
+
+	obj = object_name(src);
+	if ((f = fopen(obj, "wb")) == NULL) {
+		perror(obj);
+		exit(1);
+	}
+	obj_write(emit_text(s_prog), f);
+	if (fclose(f) != 0) {
+		perror(obj);
+		exit(1);
+	}
+
+	return 0;
 }
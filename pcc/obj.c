@@ -0,0 +1,243 @@
+/* relocatable object output. the assembly the code generator emits for
+   -m64 is assembled in memory and written out as an ELF object with the
+   same sections, symbols and relocations as would give it, so that
+   -c doesn't need to run an external assembler.
+
+   references to names defined in the object are patched by the assembler,
+   and only calls to, and addresses of, names from elsewhere need
+   relocations. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "asm.h"
+#include "obj.h"
+
+enum {
+	SEC_NULL,
+	SEC_TEXT,
+	SEC_RELA_TEXT,
+	SEC_NOTE_GNU_STACK,
+	SEC_SYMTAB,
+	SEC_STRTAB,
+	SEC_SHSTRTAB,
+	NSECTIONS
+};
+
+static const char shstrtab[] =
+	"\0.text\0.rela.text\0.note.GNU-stack\0.symtab\0.strtab\0.shstrtab";
+
+struct strtab {
+	char *s;
+	size_t len, size;
+};
+
+static Elf64_Word str(struct strtab *t, const char *s)
+{
+	size_t n = strlen(s) + 1, at = t->len;
+
+	while (t->len + n > t->size) {
+		t->size = t->size ? t->size << 1 : 4096;
+		t->s = realloc(t->s, t->size);
+	}
+	memcpy(t->s + t->len, s, n);
+	t->len += n;
+
+	return at;
+}
+
+static Elf64_Word shstr(const char *name)
+{
+	const char *p;
+
+	for (p = shstrtab + 1; *p; p += strlen(p) + 1) {
+		if (!strcmp(p, name))
+			return p - shstrtab;
+	}
+	return 0;
+}
+
+/* the symbols in the order they were first mentioned, with the .L labels
+   left out since nothing outside of the object refers to them. locals have
+   to come before globals in the table. each symbol's index is left in
+   sym->index for the relocations */
+static struct asm_sym **symbols(struct asm_unit *u, long *n, long *nlocal)
+{
+	struct asm_sym *s, **all, **syms;
+	long count = 0, i, k = 0;
+	int pass;
+
+	for (s = u->syms; s; s = s->next)
+		count++;
+	all = malloc(count * sizeof(*all));
+	syms = malloc(count * sizeof(*syms));
+
+	for (s = u->syms, i = count; s; s = s->next)
+		all[--i] = s;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (i=0; i<count; i++) {
+			s = all[i];
+			if (!strncmp(s->name, ".L", 2))
+				continue;
+			if ((s->global || s->off < 0) != pass)
+				continue;
+			s->index = k + 1;
+			syms[k++] = s;
+		}
+		if (pass == 0)
+			*nlocal = k;
+	}
+
+	free(all);
+	*n = k;
+	return syms;
+}
+
+static void pad(FILE *f, long *at, long align)
+{
+	while (*at % align) {
+		putc(0, f);
+		(*at)++;
+	}
+}
+
+void obj_write(char *text, FILE *f)
+{
+	struct asm_unit u;
+	struct asm_sym **syms;
+	struct asm_fixup *fx;
+	struct strtab strs = { 0 };
+	Elf64_Ehdr eh;
+	Elf64_Shdr sh[NSECTIONS];
+	Elf64_Sym *symtab;
+	Elf64_Rela *rela;
+	long nsyms, nlocal, nrela = 0, i, at;
+
+	asm_init(&u);
+	asm_text(&u, text);
+	asm_resolve(&u);
+
+	syms = symbols(&u, &nsyms, &nlocal);
+
+	str(&strs, "");
+	symtab = calloc(nsyms + 1, sizeof(*symtab));
+	for (i=0; i<nsyms; i++) {
+		symtab[i + 1].st_name = str(&strs, syms[i]->name);
+		if (syms[i]->off >= 0) {
+			symtab[i + 1].st_info = ELF64_ST_INFO(syms[i]->global ?
+			                        STB_GLOBAL : STB_LOCAL, STT_FUNC);
+			symtab[i + 1].st_shndx = SEC_TEXT;
+			symtab[i + 1].st_value = syms[i]->off;
+		} else {
+			symtab[i + 1].st_info = ELF64_ST_INFO(STB_GLOBAL,
+			                                      STT_NOTYPE);
+			symtab[i + 1].st_shndx = SHN_UNDEF;
+		}
+	}
+
+	for (fx = u.fixups; fx; fx = fx->next)
+		nrela++;
+	rela = calloc(nrela ? nrela : 1, sizeof(*rela));
+	for (fx = u.fixups, i = nrela; fx; fx = fx->next) {
+		rela[--i].r_offset = fx->off;
+		rela[i].r_info = ELF64_R_INFO(fx->sym->index,
+		                              fx->kind == FIXUP_BRANCH ?
+		                              R_X86_64_PLT32 : R_X86_64_PC32);
+		rela[i].r_addend = -4;
+	}
+
+	memset(sh, 0, sizeof(sh));
+	at = sizeof(eh);
+
+	at = (at + 15) & ~15;
+	sh[SEC_TEXT].sh_type = SHT_PROGBITS;
+	sh[SEC_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+	sh[SEC_TEXT].sh_offset = at;
+	sh[SEC_TEXT].sh_size = u.len;
+	sh[SEC_TEXT].sh_addralign = 16;
+	at += u.len;
+
+	at = (at + 7) & ~7;
+	sh[SEC_RELA_TEXT].sh_type = SHT_RELA;
+	sh[SEC_RELA_TEXT].sh_flags = SHF_INFO_LINK;
+	sh[SEC_RELA_TEXT].sh_offset = at;
+	sh[SEC_RELA_TEXT].sh_size = nrela * sizeof(*rela);
+	sh[SEC_RELA_TEXT].sh_link = SEC_SYMTAB;
+	sh[SEC_RELA_TEXT].sh_info = SEC_TEXT;
+	sh[SEC_RELA_TEXT].sh_addralign = 8;
+	sh[SEC_RELA_TEXT].sh_entsize = sizeof(*rela);
+	at += nrela * sizeof(*rela);
+
+	sh[SEC_NOTE_GNU_STACK].sh_type = SHT_PROGBITS;
+	sh[SEC_NOTE_GNU_STACK].sh_offset = at;
+	sh[SEC_NOTE_GNU_STACK].sh_addralign = 1;
+
+	sh[SEC_SYMTAB].sh_type = SHT_SYMTAB;
+	sh[SEC_SYMTAB].sh_offset = at;
+	sh[SEC_SYMTAB].sh_size = (nsyms + 1) * sizeof(*symtab);
+	sh[SEC_SYMTAB].sh_link = SEC_STRTAB;
+	sh[SEC_SYMTAB].sh_info = nlocal + 1;
+	sh[SEC_SYMTAB].sh_addralign = 8;
+	sh[SEC_SYMTAB].sh_entsize = sizeof(*symtab);
+	at += (nsyms + 1) * sizeof(*symtab);
+
+	sh[SEC_STRTAB].sh_type = SHT_STRTAB;
+	sh[SEC_STRTAB].sh_offset = at;
+	sh[SEC_STRTAB].sh_size = strs.len;
+	sh[SEC_STRTAB].sh_addralign = 1;
+	at += strs.len;
+
+	sh[SEC_SHSTRTAB].sh_type = SHT_STRTAB;
+	sh[SEC_SHSTRTAB].sh_offset = at;
+	sh[SEC_SHSTRTAB].sh_size = sizeof(shstrtab);
+	sh[SEC_SHSTRTAB].sh_addralign = 1;
+	at += sizeof(shstrtab);
+
+	sh[SEC_TEXT].sh_name = shstr(".text");
+	sh[SEC_RELA_TEXT].sh_name = shstr(".rela.text");
+	sh[SEC_NOTE_GNU_STACK].sh_name = shstr(".note.GNU-stack");
+	sh[SEC_SYMTAB].sh_name = shstr(".symtab");
+	sh[SEC_STRTAB].sh_name = shstr(".strtab");
+	sh[SEC_SHSTRTAB].sh_name = shstr(".shstrtab");
+
+	at = (at + 7) & ~7;
+
+	memset(&eh, 0, sizeof(eh));
+	memcpy(eh.e_ident, ELFMAG, SELFMAG);
+	eh.e_ident[EI_CLASS] = ELFCLASS64;
+	eh.e_ident[EI_DATA] = ELFDATA2LSB;
+	eh.e_ident[EI_VERSION] = EV_CURRENT;
+	eh.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	eh.e_type = ET_REL;
+	eh.e_machine = EM_X86_64;
+	eh.e_version = EV_CURRENT;
+	eh.e_shoff = at;
+	eh.e_ehsize = sizeof(eh);
+	eh.e_shentsize = sizeof(*sh);
+	eh.e_shnum = NSECTIONS;
+	eh.e_shstrndx = SEC_SHSTRTAB;
+
+	at = 0;
+	fwrite(&eh, sizeof(eh), 1, f);
+	at += sizeof(eh);
+	pad(f, &at, 16);
+	fwrite(u.code, 1, u.len, f);
+	at += u.len;
+	pad(f, &at, 8);
+	fwrite(rela, sizeof(*rela), nrela, f);
+	fwrite(symtab, sizeof(*symtab), nsyms + 1, f);
+	fwrite(strs.s, 1, strs.len, f);
+	fwrite(shstrtab, 1, sizeof(shstrtab), f);
+	at += nrela * sizeof(*rela) + (nsyms + 1) * sizeof(*symtab) +
+	      strs.len + sizeof(shstrtab);
+	pad(f, &at, 8);
+	fwrite(sh, sizeof(*sh), NSECTIONS, f);
+
+	free(strs.s);
+	free(symtab);
+	free(rela);
+	free(syms);
+	asm_free(&u);
+}
@@ -0,0 +1,12 @@
+/* relocatable ELF object output */
+
+#ifndef __INC_OBJ_H__
+#define __INC_OBJ_H__
+
+#include <stdio.h>
+
+/* assembles the 64 bit assembly in text, which is modified in the
+   process, and writes it to f as an x86-64 relocatable object */
+extern void obj_write(char *text, FILE *f);
+
+#endif
@@ -140,7 +140,7 @@ struct p_expr *p_ex_p(void)
 	switch (t) {
 	case T_ID:
 		ex->type = T_ID;
-		ex->id = strdup(lx_tokstr);
+		ex->id = lx_tokid;
 		break;
 	case T_INT:
 		ex->type = T_INT;
@@ -433,13 +433,11 @@ void p_fn_name(struct p_fn_decl *fn)
 	snprintf(buf, 48, "<fn-%d>", ++n);
 
 	t = lx_token();
-	fn->name = lx_tokstr;
+	fn->name = lx_tokid;
 	if (t != T_ID) {
-		fn->name = buf;
+		fn->name = lx_intern(buf);
 		lx_unget(t);
 	}
-
-	fn->name = strdup(fn->name);
 }
 
 void p_fn_def(struct p_fn_decl *fn)
@@ -458,7 +456,7 @@ struct p_arg_list *p_arg_list(void)
 	t = lx_token();
 	if (t == T_ID) {
 		args = malloc(sizeof(*args));
-		args->id = strdup(lx_tokstr);
+		args->id = lx_tokid;
 		args->next = p_arg_list(); /* not ..._list2 */
 	} else {
 		lx_unget(t);
@@ -480,35 +478,34 @@ struct p_arg_list *p_arg_list2(void)
 
 	expect(T_ID);
 	args = malloc(sizeof(*args));
-	args->id = strdup(lx_tokstr);
+	args->id = lx_tokid;
 	args->next = p_arg_list2();
 
 	return args;
 }
 
+/* a loop rather than recursion, since generated programs can have more
+   declarations than there is stack to recurse over */
 struct p_decls *p_decls(void)
 {
-	struct p_decls *decls;
+	struct p_decls *head = NULL, **tail = &head, *decls;
 	enum lx_token t;
 
-	decls = malloc(sizeof(*decls));
+	for (;;) {
+		t = lx_token();
+		lx_unget(t);
 
-	t = lx_token();
-	lx_unget(t);
+		if (t != T_FN)
+			return head;
 
-	switch (t) {
-	case T_FN:
+		decls = malloc(sizeof(*decls));
 		decls->type = T_FN;
 		decls->fn = p_fn_decl();
-		break;
-	default:
-		free(decls);
-		return NULL;
-	}
+		decls->next = NULL;
 
-	/* we only make it this far if not default */
-	decls->next = p_decls();
-	return decls;
+		*tail = decls;
+		tail = &decls->next;
+	}
 }
 
 struct p_program *p_program(void)
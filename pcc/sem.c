@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
 #include "symtab.h"
 #include "lexer.h"
 #include "parse.h"
@@ -62,6 +63,189 @@ static struct s_apply *s_apply(struct symtab *tab, struct p_ex_fn *fn)
 	return app;
 }
 
+/* constant folding. operations on immediates are evaluated here rather
+   than at run time, as are conditionals whose condition is known, and
+   operations with an identity on one side are replaced by the other side.
+   multiplications by powers of two become shifts, and constants are moved
+   to the right of commutative operations, where the code generator can
+   use them as immediate operands.
+
+   values are 32 bits wide on some targets and 64 on others, so a constant
+   is only folded when the exact result fits in 32 bits, and so is the same
+   on all of them. */
+
+static int is_imm(struct s_expr *ex, long long n)
+{
+	return ex->type == S_EXPR_IMMEDIATE && ex->n == n;
+}
+
+/* determines if ex can be thrown away or evaluated out of order, that is,
+   if it doesn't read memory or call anything */
+int s_is_pure(struct s_expr *ex)
+{
+	switch (ex->type) {
+	case S_EXPR_IMMEDIATE:
+	case S_EXPR_ARGUMENT:
+	case S_EXPR_LABEL:
+		return 1;
+
+	case S_EXPR_UNARY_OPERATION:
+		return ex->op != T_LBRACK && s_is_pure(ex->child[0]);
+
+	case S_EXPR_BINARY_OPERATION:
+		return s_is_pure(ex->child[0]) && s_is_pure(ex->child[1]);
+
+	case S_EXPR_CONDITIONAL:
+		return s_is_pure(ex->child[0]) && s_is_pure(ex->child[1]) &&
+		       s_is_pure(ex->child[2]);
+
+	default:
+		return 0;
+	}
+}
+
+static int log2_exact(int n)
+{
+	int k;
+
+	if (n <= 0 || (n & (n - 1)) != 0)
+		return -1;
+	for (k=0; (1 << k) != n; k++);
+	return k;
+}
+
+static int s_fold_op(enum lx_token op, long long a, long long b,
+                     long long *n)
+{
+	switch (op) {
+	case T_ADD: *n = a + b; break;
+	case T_SUB: *n = a - b; break;
+	case T_MUL: *n = a * b; break;
+	case T_AND: *n = a & b; break;
+	case T_OR:  *n = a | b; break;
+	case T_XOR: *n = a ^ b; break;
+	case T_EQ:  *n = a == b; break;
+	case T_NE:  *n = a != b; break;
+	case T_GT:  *n = a > b; break;
+	case T_LT:  *n = a < b; break;
+	default:
+		return 0;
+	}
+
+	return *n >= INT_MIN && *n <= INT_MAX;
+}
+
+/* replaces ex with one of its children, or with a new immediate */
+static struct s_expr *s_fold_to(struct s_expr *ex, struct s_expr *by)
+{
+	free(ex);
+	return by;
+}
+
+static struct s_expr *s_fold_to_imm(struct s_expr *ex, long long n)
+{
+	ex->type = S_EXPR_IMMEDIATE;
+	ex->n = n;
+	return ex;
+}
+
+static struct s_expr *s_fold(struct s_expr *ex)
+{
+	struct s_expr *a, *b, *t;
+	long long n;
+	int k;
+
+	switch (ex->type) {
+	case S_EXPR_UNARY_OPERATION:
+		a = ex->child[0];
+		if (ex->op == T_NEG && a->type == S_EXPR_IMMEDIATE)
+			return s_fold_to_imm(ex, !a->n);
+		return ex;
+
+	case S_EXPR_CONDITIONAL:
+		a = ex->child[0];
+		if (a->type != S_EXPR_IMMEDIATE)
+			return ex;
+		return s_fold_to(ex, a->n ? ex->child[1] : ex->child[2]);
+
+	case S_EXPR_BINARY_OPERATION:
+		break;
+
+	default:
+		return ex;
+	}
+
+	a = ex->child[0];
+	b = ex->child[1];
+
+	if (ex->op == T_COMMA)
+		return s_is_pure(a) ? s_fold_to(ex, b) : ex;
+
+	if (a->type == S_EXPR_IMMEDIATE && b->type == S_EXPR_IMMEDIATE &&
+	    s_fold_op(ex->op, a->n, b->n, &n))
+		return s_fold_to_imm(ex, n);
+
+	/* constants go on the right */
+	if (a->type == S_EXPR_IMMEDIATE && b->type != S_EXPR_IMMEDIATE) {
+		switch (ex->op) {
+		case T_GT:
+			ex->op = T_LT;
+			goto swap;
+		case T_LT:
+			ex->op = T_GT;
+			goto swap;
+		case T_ADD:
+		case T_MUL:
+		case T_AND:
+		case T_OR:
+		case T_XOR:
+		case T_EQ:
+		case T_NE:
+		swap:
+			t = a;
+			a = ex->child[0] = b;
+			b = ex->child[1] = t;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (b->type != S_EXPR_IMMEDIATE)
+		return ex;
+
+	switch (ex->op) {
+	case T_ADD:
+	case T_SUB:
+	case T_OR:
+	case T_XOR:
+		if (b->n == 0)
+			return s_fold_to(ex, a);
+		break;
+
+	case T_MUL:
+		if (is_imm(b, 1))
+			return s_fold_to(ex, a);
+		if (b->n == 0 && s_is_pure(a))
+			return s_fold_to_imm(ex, 0);
+		if ((k = log2_exact(b->n)) > 0) {
+			ex->op = T_LSH;
+			b->n = k;
+		}
+		break;
+
+	case T_AND:
+		if (b->n == 0 && s_is_pure(a))
+			return s_fold_to_imm(ex, 0);
+		break;
+
+	default:
+		break;
+	}
+
+	return ex;
+}
+
 static struct s_expr *s_expr(struct symtab *tab, struct p_expr *p)
 {
 	struct s_expr *ex, *s;
@@ -131,20 +315,22 @@ static struct s_expr *s_expr(struct symtab *tab, struct p_expr *p)
 		}
 		for (i=0; i<children; i++)
 			ex->child[i] = s_expr(tab, p->child[i]);
+
+		ex = s_fold(ex);
 	}
 
 	return ex;
 }
 
-static void s_arg_list(struct symtab *tab, char *fn, struct p_arg_list *args)
+static int s_arg_list(struct symtab *tab, char *fn, struct p_arg_list *args)
 {
 	struct s_expr *ex;
 	int n = 0;
 
 	for (; args; args = args->next) {
-		if (symtab_get(tab, args->id) != NULL) {
-			error("%s declared twice in %s argument list",
-			      args->id, fn);
+		if (symtab_get_local(tab, args->id) != NULL) {
+			err("%s declared twice in %s argument list",
+			    args->id, fn);
 		}
 
 		ex = malloc(sizeof(*ex));
@@ -152,18 +338,21 @@ static void s_arg_list(struct symtab *tab, char *fn, struct p_arg_list *args)
 		ex->n = n++;
 		symtab_set(tab, args->id, ex);
 	}
+
+	return n;
 }
 
-static struct s_fn_decl *s_fn_decl(struct p_fn_decl *p)
+static struct s_fn_decl *s_fn_decl(struct symtab *globals,
+                                    struct p_fn_decl *p)
 {
 	struct s_fn_decl *s;
 	struct symtab *tab;
 
-	tab = symtab_new(NULL);
+	tab = symtab_new(globals);
 
 	s = malloc(sizeof(*s));
 	s->name = p->name;
-	s_arg_list(tab, s->name, p->args);
+	s->nargs = s_arg_list(tab, s->name, p->args);
 	s->body = s_expr(tab, p->body);
 
 	symtab_free(tab);
@@ -171,34 +360,65 @@ static struct s_fn_decl *s_fn_decl(struct p_fn_decl *p)
 	return s;
 }
 
-static struct s_decls *s_decls(struct p_decls *p)
+/* every function is declared in the global scope before any body is
+   analyzed, so that functions can refer to ones declared after them.
+   names found in no scope are assumed to be defined elsewhere */
+static void s_declare(struct symtab *globals, struct p_decls *p)
 {
-	struct s_decls *s;
-
-	if (p == NULL)
-		return NULL;
+	struct s_expr *ex;
 
-	s = malloc(sizeof(*s));
+	for (; p; p = p->next) {
+		if (p->type != T_FN)
+			continue;
 
-	switch (p->type) {
-	case T_FN:
-		s->type = T_FN;
-		s->fn = s_fn_decl(p->fn);
-		break;
+		if (symtab_get_local(globals, p->fn->name) != NULL)
+			err("fn %s defined twice", p->fn->name);
 
-	default:
-		ice("unknown declaration type `%s'", lx_names[p->type]);
+		ex = malloc(sizeof(*ex));
+		ex->type = S_EXPR_LABEL;
+		ex->id = p->fn->name;
+		symtab_set(globals, p->fn->name, ex);
 	}
+}
 
-	s->next = s_decls(p->next);
+static struct s_decls *s_decls(struct symtab *globals, struct p_decls *p)
+{
+	struct s_decls *head = NULL, **tail = &head, *s;
 
-	return s;
+	for (; p; p = p->next) {
+		s = malloc(sizeof(*s));
+
+		switch (p->type) {
+		case T_FN:
+			s->type = T_FN;
+			s->fn = s_fn_decl(globals, p->fn);
+			break;
+
+		default:
+			ice("unknown declaration type `%s'",
+			    lx_names[p->type]);
+		}
+
+		s->next = NULL;
+		*tail = s;
+		tail = &s->next;
+	}
+
+	return head;
 }
 
 struct s_program *s_program(struct p_program *p)
 {
 	struct s_program *s;
+	struct symtab *globals;
+
+	globals = symtab_new(NULL);
+	s_declare(globals, p->decls);
+
 	s = malloc(sizeof(*s));
-	s->decls = s_decls(p->decls);
+	s->decls = s_decls(globals, p->decls);
+
+	symtab_free(globals);
+
 	return s;
 }
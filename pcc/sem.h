@@ -44,6 +44,7 @@ struct s_expr {
 
 struct s_fn_decl {
 	char *name;
+	int nargs;
 	struct s_expr *body;
 };
 
@@ -61,4 +62,8 @@ struct s_program {
 
 extern struct s_program *s_program(struct p_program *prog);
 
+/* determines if ex can be thrown away or evaluated out of order, that is,
+   if it doesn't read memory or call anything */
+extern int s_is_pure(struct s_expr *ex);
+
 #endif
@@ -1,5 +1,6 @@
 #include <stdlib.h>
-#include <string.h>
+#include <stdint.h>
+#include "symtab.h"
 
 struct symtab_n {
 	char *k;
@@ -7,26 +8,64 @@ struct symtab_n {
 	struct symtab_n *next;
 };
 
+/* a hash table of chains, doubled in size when it gets as many entries as
+   it has buckets. most scopes only hold a function's arguments, so they
+   start out small */
 struct symtab {
-	struct symtab_n *head;
+	struct symtab_n **buckets;
+	unsigned size, count;
 	struct symtab *up;
 };
 
-struct symtab_n *find(struct symtab_n *n, char *k)
+#define SYMTAB_INITIAL_SIZE 8
+
+static unsigned hash(struct symtab *tab, char *k)
+{
+	uintptr_t h = (uintptr_t) k;
+
+	h ^= h >> 17;
+	h *= 0x9e3779b1u;
+	return (h ^ (h >> 15)) & (tab->size - 1);
+}
+
+static struct symtab_n *find(struct symtab *tab, char *k)
 {
-	for (; n; n = n->next) {
-		if (!strcmp(n->k, k))
+	struct symtab_n *n;
+
+	for (n = tab->buckets[hash(tab, k)]; n; n = n->next) {
+		if (n->k == k)
 			return n;
 	}
 	return NULL;
 }
 
+static void grow(struct symtab *tab)
+{
+	struct symtab_n **old = tab->buckets, *n, *next;
+	unsigned i, size = tab->size;
+
+	tab->size <<= 1;
+	tab->buckets = calloc(tab->size, sizeof(*tab->buckets));
+
+	for (i=0; i<size; i++) {
+		for (n = old[i]; n; n = next) {
+			next = n->next;
+			n->next = tab->buckets[hash(tab, n->k)];
+			tab->buckets[hash(tab, n->k)] = n;
+		}
+	}
+
+	free(old);
+}
+
 struct symtab *symtab_new(struct symtab *up)
 {
 	struct symtab *tab;
 
 	tab = malloc(sizeof(*tab));
-	tab->head = NULL;
+	tab->size = SYMTAB_INITIAL_SIZE;
+	tab->count = 0;
+	tab->buckets = calloc(tab->size, sizeof(*tab->buckets));
 	tab->up = up;
 
 	return tab;
@@ -35,32 +74,52 @@ struct symtab *symtab_new(struct symtab *up)
 void symtab_set(struct symtab *tab, char *key, void *val)
 {
 	struct symtab_n *n;
+	unsigned h;
+
+	if (tab->count >= tab->size)
+		grow(tab);
 
 	n = malloc(sizeof(*n));
-	n->k = strdup(key);
+	n->k = key;
 	n->v = val;
 
-	n->next = tab->head;
-	tab->head = n;
+	h = hash(tab, key);
+	n->next = tab->buckets[h];
+	tab->buckets[h] = n;
+	tab->count++;
+}
+
+void *symtab_get_local(struct symtab *tab, char *key)
+{
+	struct symtab_n *n = find(tab, key);
+
+	return n ? n->v : NULL;
 }
 
 void *symtab_get(struct symtab *tab, char *key)
 {
+	void *v;
+
 	for (; tab; tab = tab->up) {
-		struct symtab_n *n = find(tab->head, key);
-		if (n != NULL)
-			return n->v;
+		if ((v = symtab_get_local(tab, key)) != NULL)
+			return v;
 	}
+
+	return NULL;
 }
 
 void symtab_free(struct symtab *tab)
 {
-	struct symtab_n *n;
+	struct symtab_n *n, *next;
+	unsigned i;
 
-	for (n = tab->head; n; n = n->next) {
-		free(n->k);
-		free(n);
+	for (i=0; i<tab->size; i++) {
+		for (n = tab->buckets[i]; n; n = next) {
+			next = n->next;
+			free(n);
+		}
 	}
 
+	free(tab->buckets);
 	free(tab);
 }
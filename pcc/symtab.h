@@ -1,11 +1,16 @@
 #ifndef __INC_SYMTAB_H__
 #define __INC_SYMTAB_H__
 
+/* scoped symbol tables. each table is one scope, and lookups that miss in
+   it continue in the scope above. keys are compared by address, so they
+   must be interned with lx_intern */
+
 struct symtab;
 
 extern struct symtab *symtab_new(struct symtab *up);
 extern void symtab_set(struct symtab *tab, char *key, void *val);
 extern void *symtab_get(struct symtab *tab, char *key);
+extern void *symtab_get_local(struct symtab *tab, char *key);
 extern void symtab_free(struct symtab *tab);
 
 #endif
@@ -1,18 +1,20 @@
 #include <stdio.h>
+#include <stdlib.h>
 
-extern int fib(int n);
-extern int fib2(int n);
+/* P values are the size of a pointer */
+extern long fib(long n);
+extern long fib2(long n);
 
 int main(int argc, char *argv[])
 {
-	int n;
+	long n;
 
 	if (argc < 2) {
 		fprintf(stderr, "usage: %s N\n", argv[0]);
 		return 1;
 	}
 
-	n = atoi(argv[1]);
-	printf("fib2(%d) = %d\n", n, fib2(n));
-	printf("fib(%d) = %d\n", n, fib(n));
+	n = atol(argv[1]);
+	printf("fib2(%ld) = %ld\n", n, fib2(n));
+	printf("fib(%ld) = %ld\n", n, fib(n));
 }
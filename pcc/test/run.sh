@@ -0,0 +1,40 @@
+#!/bin/sh
+# checks the two ways pcc builds code without an external assembler. test/fib.p
+# is compiled with -c and linked against test/fib.c, and is run with --run,
+# and both have to agree with the same program assembled by as:
+#
+#   make check
+
+PCC=${PCC:-./pcc}
+T=$(mktemp -d) || exit 1
+trap 'rm -rf "$T"' EXIT
+fail=0
+
+check() {
+	if [ "$2" = "$3" ]; then
+		echo "ok   $1"
+	else
+		echo "FAIL $1: expected '$3', got '$2'"
+		fail=1
+	fi
+}
+
+# the reference, through the assembler
+$PCC -m64 < test/fib.p > "$T/fib.s" || exit 1
+cc -o "$T/fib-as" test/fib.c "$T/fib.s" || exit 1
+expect=$("$T/fib-as" 20)
+
+# -c
+cp test/fib.p "$T/fib.p"
+$PCC -c "$T/fib.p" || exit 1
+cc -o "$T/fib-c" test/fib.c "$T/fib.o" || exit 1
+check "-c fib.o" "$("$T/fib-c" 20)" "$expect"
+
+# --run returns main's result as the exit status
+{ cat test/fib.p; echo "fn main (n) fib (n) + fib2 (n + 1)"; } > "$T/main.p"
+$PCC --run 10 < "$T/main.p"
+check "--run fib.p" "$?" 144
+$PCC --run < test/appl.p
+check "--run appl.p" "$?" 7
+
+exit $fail
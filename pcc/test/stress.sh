@@ -0,0 +1,13 @@
+#!/bin/sh
+# generates a P program with N functions (50000 by default), each calling
+# the two declared before it, for timing the compiler on large inputs:
+#
+#   sh test/stress.sh 50000 | time ./pcc > /dev/null
+
+awk -v n="${1:-50000}" 'BEGIN {
+	print "fn f0 (a b c d) a + b"
+	print "fn f1 (a b c d) c - d"
+	for (i = 2; i < n; i++)
+		printf "fn f%d (a b c d) (a < b) ? f%d (a + 1 b c d) : " \
+		       "f%d (d c b a) + c * 2\n", i, i - 1, i - 2
+}'
@@ -0,0 +1,375 @@
+/* benchmarks
+
+   Each patch is built and rendered in a process of its own, since the
+   module manager keeps a single graph for the life of the process. A patch
+   is rendered once as it would be played, for the realtime factor, and
+   once more with every module's update timed separately.
+
+   Allocations made by the synthesizer are counted by linking with
+   --wrap=malloc,--wrap=calloc,--wrap=realloc. The first block builds the
+   schedule, so allocations are counted separately after it, where there
+   should be none. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "modular.h"
+#include "kctl.h"
+#include "patch.h"
+
+#define SAMPLE_RATE (48000)
+#define BENCH_MAX_MODULES 64
+
+static unsigned long allocations = 0;
+
+extern void *__real_malloc(size_t);
+extern void *__real_calloc(size_t, size_t);
+extern void *__real_realloc(void*, size_t);
+
+void *__wrap_malloc(size_t n) {
+	allocations++;
+	return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	allocations++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+	allocations++;
+	return __real_realloc(p, n);
+}
+
+static double Now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* TIMED UPDATES */
+
+static ModuleSpec *specs[] = {
+	&ModFilter, &ModMatrix, &ModADSR, &ModOscillator, &ModMixer,
+	&ModLimiter,
+};
+#define NSPECS (sizeof(specs) / sizeof(*specs))
+
+static void (*spec_update[NSPECS]) (ModularContext*, Module*);
+
+static struct {
+	Module         *m;
+	double          time;
+} timed[BENCH_MAX_MODULES];
+static unsigned ntimed = 0;
+
+static void TimedUpdate(ModularContext *ctx, Module *m) {
+	unsigned i, s;
+	double start;
+
+	for (s=0; specs[s] != m->spec; s++)
+		;
+	for (i=0; i<ntimed && timed[i].m != m; i++)
+		;
+	if (i == ntimed) {
+		if (ntimed == BENCH_MAX_MODULES)
+			Abort("too many modules to time");
+		timed[ntimed++].m = m;
+	}
+
+	start = Now();
+	spec_update[s](ctx, m);
+	timed[i].time += Now() - start;
+}
+
+static void TimeUpdates(bool on) {
+	unsigned s;
+
+	for (s=0; s<NSPECS; s++) {
+		if (on) {
+			spec_update[s] = specs[s]->update;
+			specs[s]->update = TimedUpdate;
+		} else {
+			specs[s]->update = spec_update[s];
+		}
+	}
+}
+
+/* PATCHES */
+
+static Module *BenchOscillator(ModularContext *ctx,
+                               Signal (*waveform)(Oscillator*, Signal,
+                                                  Signal)) {
+	Module *osc = NewModule(ctx, &ModOscillator);
+
+	OscillatorGet(osc)->waveform = waveform;
+	SignalSet(OscillatorGet(osc)->freq, 440.0);
+	MixerAddSlot(ctx, ModularMaster(ctx), osc, 0.3, 0.0);
+
+	return osc;
+}
+
+static void *PatchSine(ModularContext *ctx) {
+	return BenchOscillator(ctx, OscSine);
+}
+
+static void *PatchTriangle(ModularContext *ctx) {
+	return BenchOscillator(ctx, OscTriangle);
+}
+
+static void *PatchSquare(ModularContext *ctx) {
+	return BenchOscillator(ctx, OscSquare);
+}
+
+static void *PatchSawtooth(ModularContext *ctx) {
+	return BenchOscillator(ctx, OscSawtooth);
+}
+
+static void *PatchBandlimitedSquare(ModularContext *ctx) {
+	return BenchOscillator(ctx, OscBandlimitedSquare);
+}
+
+static void *PatchBandlimitedSaw(ModularContext *ctx) {
+	return BenchOscillator(ctx, OscBandlimitedSaw);
+}
+
+/* a saw through a resonant lowpass, its cutoff swept between 100 Hz and
+   8 kHz twice a second, so the coefficients change on every sample */
+static void *PatchFilterSweep(ModularContext *ctx) {
+	Module *osc = NewModule(ctx, &ModOscillator);
+	Module *lfo = NewModule(ctx, &ModOscillator);
+	Module *lfo2cutoff = NewModule(ctx, &ModMatrix);
+	Module *filt = NewModule(ctx, &ModFilter);
+
+	OscillatorGet(osc)->waveform = OscBandlimitedSaw;
+	SignalSet(OscillatorGet(osc)->freq, 110.0);
+
+	OscillatorGet(lfo)->waveform = OscSine;
+	SignalSet(OscillatorGet(lfo)->freq, 2.0);
+
+	/* [-1, 1] to [100, 8000] */
+	MatrixSetInput(ctx, lfo2cutoff, lfo);
+	SignalSet(MatrixGet(lfo2cutoff)->LL, 3950.0);
+	SignalSet(MatrixGet(lfo2cutoff)->RR, 3950.0);
+	SignalSet(MatrixGet(lfo2cutoff)->Loffs, 4050.0);
+	SignalSet(MatrixGet(lfo2cutoff)->Roffs, 4050.0);
+
+	FilterGet(filt)->type = FILTER_LOWPASS_TWO;
+	FilterGet(filt)->cutoff = lfo2cutoff->out;
+	SignalSet(FilterGet(filt)->reso, 0.7);
+	FilterSetInput(ctx, filt, osc);
+	AddDependency(ctx, filt, lfo2cutoff);
+
+	MixerAddSlot(ctx, ModularMaster(ctx), filt, 0.3, 0.0);
+
+	return filt;
+}
+
+static void *PatchDemo(ModularContext *ctx) {
+	return NewDemoPatch(ctx);
+}
+
+static void BlockDemo(void *patch, long timer) {
+	DemoPatchSequence(patch, timer, timer + MODULAR_BLOCK_SIZE);
+	DemoPatchBlock(patch, timer);
+}
+
+/* a PolySynth of four voices, each a saw, envelope and filter. Every two
+   seconds it plays a chord that takes every voice, then a note that has
+   to steal the longest held one, then releases two notes and plays one
+   that has to take the quieter of them. Everything is released well
+   before the next chord, so the voices go idle and are skipped. Each of
+   these is checked as it happens */
+#define POLY_VOICES 4
+#define POLY_CYCLE  (2 * SAMPLE_RATE)
+
+static void PolyBuildVoice(ModularContext *ctx, PolyVoice *v, void *user) {
+	Module *osc = NewModule(ctx, &ModOscillator);
+	Module *env = NewModule(ctx, &ModADSR);
+	Module *filt = NewModule(ctx, &ModFilter);
+
+	OscillatorGet(osc)->waveform = OscBandlimitedSaw;
+	OscillatorGet(osc)->freq = v->freq;
+	OscillatorGet(osc)->gain = env->out;
+	AddDependency(ctx, osc, env);
+
+	ADSRGet(env)->trig = v->trig;
+	SignalSet(ADSRGet(env)->A, 0.01);
+	SignalSet(ADSRGet(env)->D, 0.3);
+	SignalSet(ADSRGet(env)->S, 0.5);
+	SignalSet(ADSRGet(env)->R, 0.5);
+
+	FilterSetInput(ctx, filt, osc);
+
+	v->out = filt;
+	v->env = env;
+}
+
+static void *PatchPoly(ModularContext *ctx) {
+	KeyController *kc = NewPolySynth(ctx, POLY_VOICES, PolyBuildVoice,
+	                                 NULL);
+
+	MixerAddSlot(ctx, ModularMaster(ctx), PolySynthGet(kc)->out, 0.2, 0.0);
+
+	return kc;
+}
+
+static void PolyExpect(KeyController *kc, unsigned voice, int key) {
+	if (PolySynthGet(kc)->voices[voice].freq[0] != MidiNoteTo440Freq(key))
+		Abort("poly: key %d should be on voice %u", key, voice);
+}
+
+static void BlockPoly(void *patch, long timer) {
+	KeyController *kc = patch;
+	PolySynth *ps = PolySynthGet(kc);
+	static const int chord[POLY_VOICES] = { 60, 64, 67, 71 };
+	long t;
+	unsigned i;
+
+	for (t=timer; t<timer+MODULAR_BLOCK_SIZE; t++) {
+		switch (t % POLY_CYCLE) {
+		case 0:
+			/* the voices are all idle, and taken in order */
+			for (i=0; i<POLY_VOICES; i++) {
+				KeyControllerKeyDown(kc, chord[i], 100);
+				PolyExpect(kc, i, chord[i]);
+			}
+			break;
+
+		case 6000:
+			/* every voice is held, so the oldest is stolen */
+			KeyControllerKeyDown(kc, 74, 100);
+			PolyExpect(kc, 0, 74);
+			break;
+
+		case 12000:
+			KeyControllerKeyUp(kc, chord[1]);
+			break;
+
+		case 18000:
+			KeyControllerKeyUp(kc, chord[2]);
+			break;
+
+		case 24000:
+			/* both are still releasing, and the first is quieter */
+			KeyControllerKeyDown(kc, 76, 100);
+			PolyExpect(kc, 1, 76);
+			break;
+
+		case 30000:
+			KeyControllerKeyUp(kc, 74);
+			KeyControllerKeyUp(kc, 76);
+			KeyControllerKeyUp(kc, chord[3]);
+			break;
+
+		case POLY_CYCLE - 1:
+			for (i=0; i<POLY_VOICES; i++) {
+				if (*ps->voices[i].env->active)
+					Abort("poly: voice %u is not idle", i);
+			}
+			break;
+		}
+	}
+
+	KeyControllerUpdate(kc);
+}
+
+static struct {
+	char           *name;
+	void         *(*build) (ModularContext*);
+	void          (*block) (void*, long timer);
+} patches[] = {
+	{ "sine",              PatchSine,              NULL      },
+	{ "triangle",          PatchTriangle,          NULL      },
+	{ "square",            PatchSquare,            NULL      },
+	{ "sawtooth",          PatchSawtooth,          NULL      },
+	{ "bandlimited-square", PatchBandlimitedSquare, NULL     },
+	{ "bandlimited-saw",   PatchBandlimitedSaw,    NULL      },
+	{ "filter-sweep",      PatchFilterSweep,       NULL      },
+	{ "poly",              PatchPoly,              BlockPoly },
+	{ "demo",              PatchDemo,              BlockDemo },
+};
+#define NPATCHES (sizeof(patches) / sizeof(*patches))
+
+static unsigned long first_block;
+
+static double Render(ModularContext *ctx, unsigned p, void *patch,
+                     long frames) {
+	double start = Now();
+	long timer;
+
+	for (timer=0; timer<frames; timer+=MODULAR_BLOCK_SIZE) {
+		if (patches[p].block)
+			patches[p].block(patch, timer);
+		ModularStep(ctx);
+
+		if (timer == 0)
+			first_block = allocations;
+	}
+
+	return Now() - start;
+}
+
+static void Bench(unsigned p, double seconds) {
+	ModularContext mctx;
+	unsigned long setup;
+	long frames = seconds * SAMPLE_RATE;
+	double took;
+	void *patch;
+	unsigned i;
+
+	srand(0);
+
+	mctx.rate = SAMPLE_RATE;
+
+	ModularInitialize(&mctx);
+	patch = patches[p].build(&mctx);
+
+	setup = allocations;
+	took = Render(&mctx, p, patch, frames);
+
+	printf("%s: %.2f s in %.3f s, %.1fx realtime\n", patches[p].name,
+	       seconds, took, seconds / took);
+	printf("    %lu allocations building, %lu in the first block, "
+	       "%lu after\n", setup, first_block - setup,
+	       allocations - first_block);
+
+	TimeUpdates(true);
+	Render(&mctx, p, patch, frames);
+	TimeUpdates(false);
+
+	for (i=0; i<ntimed; i++) {
+		printf("    %2u %-12s %8.2f ns/sample\n", i,
+		       timed[i].m->spec->name, timed[i].time * 1e9 / frames);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	double seconds = 10.0;
+	unsigned p;
+	int status;
+
+	if (argc > 1)
+		seconds = atof(argv[1]);
+
+	for (p=0; p<NPATCHES; p++) {
+		fflush(stdout);
+
+		if (fork() == 0) {
+			Bench(p, seconds);
+			return 0;
+		}
+
+		wait(&status);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			Abort("%s benchmark failed", patches[p].name);
+	}
+
+	return 0;
+}
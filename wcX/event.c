@@ -0,0 +1,130 @@
+/* timed events */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include "common.h"
+#include "event.h"
+
+/* head is only written by the render thread and tail by the control
+   thread, so they are kept on cache lines of their own, along with the
+   other side's index as last seen, so that the shared lines are only
+   read when the queue looks empty or full */
+struct EventQueue {
+	unsigned        size;
+	Event          *events;
+
+	struct {
+		atomic_uint     head;
+		unsigned        tail;
+	} __attribute__((aligned(64))) render;
+
+	struct {
+		atomic_uint     tail;
+		unsigned        head;
+		atomic_ulong    horizon;
+	} __attribute__((aligned(64))) control;
+
+	PartialSignals  partial;
+};
+
+EventQueue *NewEventQueue(unsigned size) {
+	EventQueue *q = aligned_alloc(64, sizeof(*q));
+	unsigned n;
+
+	/* a power of two, so the indices can wrap around freely */
+	for (n=1; n<size; n*=2)
+		;
+
+	q->size = n;
+	q->events = calloc(n, sizeof(*q->events));
+	atomic_init(&q->render.head, 0);
+	q->render.tail = 0;
+	atomic_init(&q->control.tail, 0);
+	q->control.head = 0;
+	atomic_init(&q->control.horizon, 0);
+	q->partial.len = q->partial.cap = 0;
+	q->partial.sigs = NULL;
+	PartialSignalsReserve(&q->partial, 8);
+
+	return q;
+}
+
+bool EventQueuePush(EventQueue *q, const Event *e) {
+	unsigned tail = atomic_load_explicit(&q->control.tail,
+	                                     memory_order_relaxed);
+
+	if (tail - q->control.head == q->size) {
+		q->control.head = atomic_load_explicit(&q->render.head,
+		                                       memory_order_acquire);
+		if (tail - q->control.head == q->size)
+			return false;
+	}
+
+	q->events[tail & (q->size - 1)] = *e;
+	atomic_store_explicit(&q->control.tail, tail + 1,
+	                      memory_order_release);
+
+	return true;
+}
+
+void EventQueueAdvance(EventQueue *q, unsigned long time) {
+	atomic_store_explicit(&q->control.horizon, time, memory_order_release);
+}
+
+static void EventApply(EventQueue *q, Event *e, unsigned offset) {
+	switch (e->type) {
+	case EVENT_KEYDOWN:
+		e->kc->offset = offset;
+		KeyControllerKeyDown(e->kc, e->key, e->vel);
+		e->kc->offset = 0;
+		break;
+
+	case EVENT_KEYUP:
+		e->kc->offset = offset;
+		KeyControllerKeyUp(e->kc, e->key);
+		e->kc->offset = 0;
+		break;
+
+	case EVENT_SET:
+		SignalSetFrom(&q->partial, e->sig, e->value, offset);
+		break;
+
+	default:
+		Abort("unknown event type %d", e->type);
+	}
+}
+
+void EventQueueRun(EventQueue *q, unsigned long timer) {
+	unsigned head = atomic_load_explicit(&q->render.head,
+	                                     memory_order_relaxed);
+	Event *e;
+
+	/* the last block has been rendered */
+	PartialSignalsSettle(&q->partial);
+
+	for (;;) {
+		if (head == q->render.tail) {
+			q->render.tail = atomic_load_explicit(&q->control.tail,
+			                                      memory_order_acquire);
+			if (head == q->render.tail)
+				break;
+		}
+
+		e = &q->events[head & (q->size - 1)];
+		if (e->time >= timer + MODULAR_BLOCK_SIZE)
+			break;
+
+		EventApply(q, e, e->time > timer ? e->time - timer : 0);
+		head++;
+	}
+
+	atomic_store_explicit(&q->render.head, head, memory_order_release);
+}
+
+void EventQueueWait(EventQueue *q, unsigned long time) {
+	while (atomic_load_explicit(&q->control.horizon,
+	                            memory_order_acquire) < time)
+		sched_yield();
+}
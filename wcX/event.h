@@ -0,0 +1,50 @@
+/* timed events */
+
+#ifndef __INC_EVENT_H__
+#define __INC_EVENT_H__
+
+#include <stdbool.h>
+
+typedef struct Event           Event;
+typedef struct EventQueue      EventQueue;
+
+#include "modular.h"
+#include "kctl.h"
+
+struct Event {
+	/* the frame the event takes effect at, counted from the start */
+	unsigned long   time;
+
+	enum {
+		EVENT_KEYDOWN,
+		EVENT_KEYUP,
+		EVENT_SET,
+	} type;
+
+	KeyController  *kc;
+	int             key, vel;
+
+	Signal         *sig;
+	double          value;
+};
+
+/* A queue of events from one control thread to the render thread, which
+   takes no locks on either side. The render thread applies the events at
+   the start of each block, each at its own frame within the block.
+   Events have to be pushed in time order, and any that arrive after
+   their block has been rendered take effect at the start of the next */
+extern EventQueue      *NewEventQueue(unsigned size);
+
+/* control thread. false if the queue is full */
+extern bool             EventQueuePush(EventQueue*, const Event*);
+/* control thread. there will be no more events before time */
+extern void             EventQueueAdvance(EventQueue*, unsigned long time);
+
+/* render thread. applies the events of the block starting at frame
+   timer. call it before the key controllers are updated for the block */
+extern void             EventQueueRun(EventQueue*, unsigned long timer);
+/* render thread. waits until the control thread has advanced to time,
+   for when it is a sequencer rather than something played live */
+extern void             EventQueueWait(EventQueue*, unsigned long time);
+
+#endif
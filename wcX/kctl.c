@@ -1,8 +1,10 @@
 /* key controller */
 
 #include <stdlib.h>
+#include <stdbool.h>
 #include <math.h>
 
+#include "common.h"
 #include "kctl.h"
 #include "modular.h"
 
@@ -15,22 +17,38 @@ double MidiNoteTo440Freq(double n) {
 	return exp(LOG_440 + (n - 69.0) * MAGIC);
 }
 
+void KeyControllerSettle(KeyController *kc) {
+	if (kc->settle) {
+		PartialSignalsSettle(&kc->partial);
+		kc->settle = false;
+	}
+}
+
+void KeyControllerSet(KeyController *kc, Signal *s, double v) {
+	KeyControllerSettle(kc);
+	SignalSetFrom(&kc->partial, s, v, kc->offset);
+}
+
 struct MonoSynthPrivate {
 	MonoSynth      ms;
-	double         target;
+	double         freq;
+	Signal        *target;
 	double         alpha;
 	int            key;
+	/* the frame of the block the frequency jumps to the target at,
+	   rather than gliding, or -1 */
+	int            snap;
 };
 
 static void MonoSynthKeyDown(KeyController *kc, int k, int v) {
 	struct MonoSynthPrivate *ms = kc->priv;
 
-	*ms->ms.vel = v / 127.0;
-	*ms->ms.trig = 1.0;
-	ms->target = MidiNoteTo440Freq(k);
+	KeyControllerSet(kc, ms->ms.vel, v / 127.0);
+	KeyControllerSet(kc, ms->ms.trig, 1.0);
+	KeyControllerSet(kc, ms->target, MidiNoteTo440Freq(k));
 
 	if (ms->key == -1)
-		*ms->ms.freq = ms->target;
+		ms->snap = kc->offset;
 
 	ms->key = k;
 }
@@ -42,14 +60,22 @@ static void MonoSynthKeyUp(KeyController *kc, int k) {
 		return;
 
 	ms->key = -1;
-	*ms->ms.trig = 0.0;
+	KeyControllerSet(kc, ms->ms.trig, 0.0);
 }
 
 static void MonoSynthUpdate(KeyController *kc) {
 	struct MonoSynthPrivate *ms = kc->priv;
+	int i;
 
 	ms->alpha = 0.9993; /* TODO: factor in ms->ms.porta */
-	*ms->ms.freq = (*ms->ms.freq * ms->alpha) + ms->target * (1.0 - ms->alpha);
+	for (i=0; i<MODULAR_BLOCK_SIZE; i++) {
+		if (i == ms->snap)
+			ms->freq = ms->target[i];
+		ms->freq = (ms->freq * ms->alpha) +
+		           ms->target[i] * (1.0 - ms->alpha);
+		ms->ms.freq[i] = ms->freq;
+	}
+	ms->snap = -1;
 }
 
 KeyController *NewMonoSynth(void) {
@@ -65,8 +91,12 @@ KeyController *NewMonoSynth(void) {
 	ms->ms.vel      = NewSignal(0.0);
 	ms->ms.trig     = NewSignal(0.0);
 	ms->ms.porta    = NewSignal(0.0);
+	ms->target      = NewSignal(0.0);
 
 	ms->key         = -1;
+	ms->snap        = -1;
+
+	PartialSignalsReserve(&kc->partial, 3);
 
 	return kc;
 }
@@ -74,3 +104,154 @@ KeyController *NewMonoSynth(void) {
 MonoSynth *MonoSynthGet(KeyController *kc) {
 	return &((struct MonoSynthPrivate*)kc->priv)->ms;
 }
+
+struct PolyVoicePrivate {
+	int            key;
+	bool           active;
+	/* the frame of the coming block to drop the trigger at, or -1 */
+	int            retrigger;
+	unsigned long  started;
+};
+
+struct PolySynthPrivate {
+	PolySynth      ps;
+	struct PolyVoicePrivate *vp;
+	unsigned long  notes;
+};
+
+static unsigned PolySynthSteal(struct PolySynthPrivate *ps) {
+	PolyVoice *v = ps->ps.voices;
+	struct PolyVoicePrivate *vp = ps->vp;
+	unsigned i, best = 0;
+	double level, quietest = INFINITY;
+	unsigned long oldest = ~0UL;
+
+	for (i=0; i<ps->ps.nvoices; i++) {
+		if (!vp[i].active)
+			return i;
+	}
+
+	for (i=0; i<ps->ps.nvoices; i++) {
+		if (vp[i].key != -1)
+			continue;
+		level = ModuleOut(v[i].env, 0)[MODULAR_BLOCK_SIZE - 1];
+		if (level < quietest) {
+			quietest = level;
+			best = i;
+		}
+	}
+	if (quietest != INFINITY)
+		return best;
+
+	for (i=0; i<ps->ps.nvoices; i++) {
+		if (vp[i].started < oldest) {
+			oldest = vp[i].started;
+			best = i;
+		}
+	}
+	return best;
+}
+
+static void PolySynthKeyDown(KeyController *kc, int k, int v) {
+	struct PolySynthPrivate *ps = kc->priv;
+	PolyVoice *voice;
+	unsigned i;
+
+	for (i=0; i<ps->ps.nvoices && ps->vp[i].key != k; i++);
+	if (i == ps->ps.nvoices)
+		i = PolySynthSteal(ps);
+	voice = &ps->ps.voices[i];
+
+	KeyControllerSet(kc, voice->freq, MidiNoteTo440Freq(k));
+	KeyControllerSet(kc, voice->vel, v / 127.0);
+	KeyControllerSet(kc, voice->trig, 1.0);
+
+	/* a voice taken while its key is still down needs the trigger to
+	   drop for a sample, or its envelope won't start again */
+	if (ps->vp[i].key != -1)
+		ps->vp[i].retrigger = kc->offset;
+
+	ps->vp[i].key = k;
+	ps->vp[i].active = true;
+	ps->vp[i].started = ps->notes++;
+}
+
+static void PolySynthKeyUp(KeyController *kc, int k) {
+	struct PolySynthPrivate *ps = kc->priv;
+	unsigned i;
+
+	for (i=0; i<ps->ps.nvoices; i++) {
+		if (ps->vp[i].key != k)
+			continue;
+		ps->vp[i].key = -1;
+		KeyControllerSet(kc, ps->ps.voices[i].trig, 0.0);
+	}
+}
+
+static void PolySynthUpdate(KeyController *kc) {
+	struct PolySynthPrivate *ps = kc->priv;
+	Signal *trig;
+	unsigned i;
+
+	for (i=0; i<ps->ps.nvoices; i++) {
+		if (ps->vp[i].key == -1 && ADSRIdle(ps->ps.voices[i].env))
+			ps->vp[i].active = false;
+
+		/* the trigger is raised again when the block is settled, if
+		   the key is still down */
+		if (ps->vp[i].retrigger >= 0) {
+			trig = ps->ps.voices[i].trig;
+			trig[ps->vp[i].retrigger] = 0.0;
+			if (ps->vp[i].key != -1)
+				SignalSetFrom(&kc->partial, trig, 1.0,
+				              MODULAR_BLOCK_SIZE);
+			ps->vp[i].retrigger = -1;
+		}
+	}
+}
+
+KeyController *NewPolySynth(ModularContext *ctx, unsigned nvoices,
+                            PolyVoiceBuilder build, void *user) {
+	KeyController *kc = calloc(1, sizeof(*kc));
+	struct PolySynthPrivate *ps = calloc(1, sizeof(*ps));
+	PolyVoice *v;
+	Module *m, *before;
+	unsigned i;
+
+	kc->keydown     = PolySynthKeyDown;
+	kc->keyup       = PolySynthKeyUp;
+	kc->update      = PolySynthUpdate;
+	kc->priv        = ps;
+
+	ps->ps.nvoices  = nvoices;
+	ps->ps.voices   = calloc(nvoices, sizeof(*ps->ps.voices));
+	ps->vp          = calloc(nvoices, sizeof(*ps->vp));
+	ps->ps.out      = NewModule(ctx, &ModMixer);
+
+	PartialSignalsReserve(&kc->partial, 3 * nvoices);
+
+	for (i=0; i<nvoices; i++) {
+		v = &ps->ps.voices[i];
+		v->freq = NewSignal(0.0);
+		v->vel  = NewSignal(0.0);
+		v->trig = NewSignal(0.0);
+
+		before = ModularNewest(ctx);
+		build(ctx, v, user);
+		if (v->out == NULL || v->env == NULL)
+			Abort("poly voice builder must set out and env");
+
+		for (m = before->next; m; m = m->next)
+			m->active = &ps->vp[i].active;
+
+		ps->vp[i].key = -1;
+		ps->vp[i].retrigger = -1;
+		MixerAddSlot(ctx, ps->ps.out, v->out, 1.0, 0.0);
+	}
+
+	return kc;
+}
+
+PolySynth *PolySynthGet(KeyController *kc) {
+	return &((struct PolySynthPrivate*)kc->priv)->ps;
+}
@@ -7,6 +7,9 @@ typedef struct KeyController       KeyController;
 
 typedef struct MonoSynth           MonoSynth;
 typedef struct PolySynth           PolySynth;
+typedef struct PolyVoice           PolyVoice;
+
+#include <stdbool.h>
 
 #include "modular.h"
 
@@ -15,11 +18,23 @@ extern double MidiNoteTo440Freq(double);
 struct KeyController {
 	void          (*keydown) (KeyController*, int k, int v);
 	void          (*keyup)   (KeyController*, int k);
+	/* fills in the next block of the controller's outputs. call it once
+	   before each ModularStep */
 	void          (*update)  (KeyController*);
 
 	void           *priv;
+
+	/* the frame of the coming block that key events take effect at. the
+	   outputs keep their old values before it */
+	unsigned        offset;
+	PartialSignals  partial;
+	bool            settle;
 };
 
+/* sets one of the controller's outputs from offset onwards */
+extern void KeyControllerSet(KeyController*, Signal*, double);
+extern void KeyControllerSettle(KeyController*);
+
 static inline void KeyControllerKeyDown(KeyController *kc, int k, int v) {
 	if (kc->keydown)
 		kc->keydown(kc, k, v);
@@ -30,9 +45,13 @@ static inline void KeyControllerKeyUp(KeyController *kc, int k) {
 		kc->keyup(kc, k);
 }
 
+/* key events for a block come before its update, and the outputs set
+   partway through it are settled on the first event or update after */
 static inline void KeyControllerUpdate(KeyController *kc) {
+	KeyControllerSettle(kc);
 	if (kc->update)
 		kc->update(kc);
+	kc->settle = true;
 }
 
 struct MonoSynth {
@@ -48,4 +67,41 @@ struct MonoSynth {
 extern KeyController *NewMonoSynth(void);
 extern MonoSynth *MonoSynthGet(KeyController*);
 
+/* A PolySynth plays each key on its own voice, out of a fixed pool of
+   voices that are all built up front. A voice whose key has been released
+   and whose envelope has finished is idle, and none of its modules are
+   updated until it is given another key, so the cost of the synth follows
+   the number of notes sounding rather than the size of the pool. When
+   every voice is busy, a new key takes the quietest released voice, or if
+   there isn't one, the voice that has been held the longest. */
+
+struct PolyVoice {
+	/* inputs, as for MonoSynth */
+	Signal         *freq;
+	Signal         *vel;
+	Signal         *trig;
+
+	/* set by the builder. out is what the voice sounds like, and env is
+	   the ADSR that decides when it has finished */
+	Module         *out;
+	Module         *env;
+};
+
+/* builds the modules of one voice. everything it creates belongs to the
+   voice, and is skipped while the voice is idle, so anything shared
+   between voices has to be created beforehand */
+typedef void (*PolyVoiceBuilder) (ModularContext*, PolyVoice*, void *user);
+
+struct PolySynth {
+	/* mixer with every voice's out */
+	Module         *out;
+
+	unsigned        nvoices;
+	PolyVoice      *voices;
+};
+
+extern KeyController *NewPolySynth(ModularContext*, unsigned nvoices,
+                                   PolyVoiceBuilder, void *user);
+extern PolySynth *PolySynthGet(KeyController*);
+
 #endif
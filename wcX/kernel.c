@@ -0,0 +1,319 @@
+/* sample processing kernels */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "kernel.h"
+
+#ifdef KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/*  SCALAR KERNELS                                                          */
+/*  ======================================================================  */
+
+static void ScalarBiquad(Biquad *f, Signal *L, Signal *R,
+                         const Signal *Lin, const Signal *Rin, unsigned n) {
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		L[i] = Lin[i] * f->a0
+		     + f->x1[0] * f->a1
+		     + f->x2[0] * f->a2
+		     - f->y1[0] * f->b1
+		     - f->y2[0] * f->b2;
+		R[i] = Rin[i] * f->a0
+		     + f->x1[1] * f->a1
+		     + f->x2[1] * f->a2
+		     - f->y1[1] * f->b1
+		     - f->y2[1] * f->b2;
+
+		f->x2[0] = f->x1[0];
+		f->y2[0] = f->y1[0];
+		f->x2[1] = f->x1[1];
+		f->y2[1] = f->y1[1];
+		f->x1[0] = Lin[i];
+		f->x1[1] = Rin[i];
+		f->y1[0] = L[i];
+		f->y1[1] = R[i];
+	}
+}
+
+static void ScalarMatrix(Signal *L, Signal *R,
+                         const Signal *Lin, const Signal *Rin,
+                         const Signal *LL, const Signal *RL,
+                         const Signal *LR, const Signal *RR,
+                         const Signal *Loffs, const Signal *Roffs,
+                         unsigned n) {
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		L[i] = LL[i] * Lin[i] + RL[i] * Rin[i] + Loffs[i];
+		R[i] = LR[i] * Lin[i] + RR[i] * Rin[i] + Roffs[i];
+	}
+}
+
+static void ScalarMix(Signal *out, const Signal *in,
+                      const Signal *gain, const Signal *pan, unsigned n) {
+	unsigned i;
+
+	for (i=0; i<n; i++)
+		out[i] += in[i] * gain[i] * pan[i];
+}
+
+static void ScalarClamp(Signal *out, const Signal *in,
+                        const Signal *limit, unsigned n) {
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		out[i] = in[i];
+
+		if (out[i] > limit[i])
+			out[i] = limit[i];
+		if (out[i] < -limit[i])
+			out[i] = -limit[i];
+	}
+}
+
+Kernels KernelsScalar = {
+	.name          = "scalar",
+	.biquad        = ScalarBiquad,
+	.matrix        = ScalarMatrix,
+	.mix           = ScalarMix,
+	.clamp         = ScalarClamp,
+};
+
+#ifdef KERNELS_X86
+
+/*  SSE2 KERNELS                                                            */
+/*  ======================================================================  */
+
+/* The biquad is recursive, so successive samples can't be worked on at
+   once, but the two channels can. The same goes for AVX2, which has
+   nothing to add */
+__attribute__((target("sse2")))
+static void SSE2Biquad(Biquad *f, Signal *L, Signal *R,
+                       const Signal *Lin, const Signal *Rin, unsigned n) {
+	__m128d a0 = _mm_set1_pd(f->a0), a1 = _mm_set1_pd(f->a1);
+	__m128d a2 = _mm_set1_pd(f->a2), b1 = _mm_set1_pd(f->b1);
+	__m128d b2 = _mm_set1_pd(f->b2);
+	__m128d x1 = _mm_loadu_pd(f->x1), x2 = _mm_loadu_pd(f->x2);
+	__m128d y1 = _mm_loadu_pd(f->y1), y2 = _mm_loadu_pd(f->y2);
+	__m128d x, y;
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		x = _mm_set_pd(Rin[i], Lin[i]);
+		y = _mm_mul_pd(x, a0);
+		y = _mm_add_pd(y, _mm_mul_pd(x1, a1));
+		y = _mm_add_pd(y, _mm_mul_pd(x2, a2));
+		y = _mm_sub_pd(y, _mm_mul_pd(y1, b1));
+		y = _mm_sub_pd(y, _mm_mul_pd(y2, b2));
+		_mm_storel_pd(&L[i], y);
+		_mm_storeh_pd(&R[i], y);
+
+		x2 = x1;
+		y2 = y1;
+		x1 = x;
+		y1 = y;
+	}
+
+	_mm_storeu_pd(f->x1, x1);
+	_mm_storeu_pd(f->x2, x2);
+	_mm_storeu_pd(f->y1, y1);
+	_mm_storeu_pd(f->y2, y2);
+}
+
+__attribute__((target("sse2")))
+static void SSE2Matrix(Signal *L, Signal *R,
+                       const Signal *Lin, const Signal *Rin,
+                       const Signal *LL, const Signal *RL,
+                       const Signal *LR, const Signal *RR,
+                       const Signal *Loffs, const Signal *Roffs,
+                       unsigned n) {
+	__m128d l, r;
+	unsigned i;
+
+	for (i=0; i+2<=n; i+=2) {
+		l = _mm_loadu_pd(Lin + i);
+		r = _mm_loadu_pd(Rin + i);
+		_mm_storeu_pd(L + i, _mm_add_pd(_mm_add_pd(
+			_mm_mul_pd(_mm_loadu_pd(LL + i), l),
+			_mm_mul_pd(_mm_loadu_pd(RL + i), r)),
+			_mm_loadu_pd(Loffs + i)));
+		_mm_storeu_pd(R + i, _mm_add_pd(_mm_add_pd(
+			_mm_mul_pd(_mm_loadu_pd(LR + i), l),
+			_mm_mul_pd(_mm_loadu_pd(RR + i), r)),
+			_mm_loadu_pd(Roffs + i)));
+	}
+
+	ScalarMatrix(L + i, R + i, Lin + i, Rin + i, LL + i, RL + i,
+	             LR + i, RR + i, Loffs + i, Roffs + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void SSE2Mix(Signal *out, const Signal *in,
+                    const Signal *gain, const Signal *pan, unsigned n) {
+	unsigned i;
+
+	for (i=0; i+2<=n; i+=2) {
+		_mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(out + i),
+			_mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(in + i),
+			                      _mm_loadu_pd(gain + i)),
+			           _mm_loadu_pd(pan + i))));
+	}
+
+	ScalarMix(out + i, in + i, gain + i, pan + i, n - i);
+}
+
+/* min and max give back their second operand when either is NaN, which
+   with the operands this way around is what the comparisons in
+   ScalarClamp do */
+__attribute__((target("sse2")))
+static void SSE2Clamp(Signal *out, const Signal *in,
+                      const Signal *limit, unsigned n) {
+	__m128d sign = _mm_set1_pd(-0.0), lim, x;
+	unsigned i;
+
+	for (i=0; i+2<=n; i+=2) {
+		lim = _mm_loadu_pd(limit + i);
+		x = _mm_min_pd(lim, _mm_loadu_pd(in + i));
+		x = _mm_max_pd(_mm_xor_pd(lim, sign), x);
+		_mm_storeu_pd(out + i, x);
+	}
+
+	ScalarClamp(out + i, in + i, limit + i, n - i);
+}
+
+Kernels KernelsSSE2 = {
+	.name          = "sse2",
+	.biquad        = SSE2Biquad,
+	.matrix        = SSE2Matrix,
+	.mix           = SSE2Mix,
+	.clamp         = SSE2Clamp,
+};
+
+/*  AVX2 KERNELS                                                            */
+/*  ======================================================================  */
+
+/* Nothing here needs more than AVX, but AVX2 is what is checked for,
+   since machines that have it also run 256 bit floating point at full
+   speed, which not every AVX machine does. No FMA, so that the results
+   match the scalar kernels.
+
+   The upper halves of the YMM registers are cleared before the scalar
+   tails. The compiler turns those calls into plain jumps without doing
+   it, and dirty upper state slows down every SSE instruction after, in
+   libm too, until something clears it */
+__attribute__((target("avx2")))
+static void AVX2Matrix(Signal *L, Signal *R,
+                       const Signal *Lin, const Signal *Rin,
+                       const Signal *LL, const Signal *RL,
+                       const Signal *LR, const Signal *RR,
+                       const Signal *Loffs, const Signal *Roffs,
+                       unsigned n) {
+	__m256d l, r;
+	unsigned i;
+
+	for (i=0; i+4<=n; i+=4) {
+		l = _mm256_loadu_pd(Lin + i);
+		r = _mm256_loadu_pd(Rin + i);
+		_mm256_storeu_pd(L + i, _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(_mm256_loadu_pd(LL + i), l),
+			_mm256_mul_pd(_mm256_loadu_pd(RL + i), r)),
+			_mm256_loadu_pd(Loffs + i)));
+		_mm256_storeu_pd(R + i, _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(_mm256_loadu_pd(LR + i), l),
+			_mm256_mul_pd(_mm256_loadu_pd(RR + i), r)),
+			_mm256_loadu_pd(Roffs + i)));
+	}
+
+	_mm256_zeroupper();
+	ScalarMatrix(L + i, R + i, Lin + i, Rin + i, LL + i, RL + i,
+	             LR + i, RR + i, Loffs + i, Roffs + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void AVX2Mix(Signal *out, const Signal *in,
+                    const Signal *gain, const Signal *pan, unsigned n) {
+	unsigned i;
+
+	for (i=0; i+4<=n; i+=4) {
+		_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(out + i),
+			_mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(in + i),
+			                            _mm256_loadu_pd(gain + i)),
+			              _mm256_loadu_pd(pan + i))));
+	}
+
+	_mm256_zeroupper();
+	ScalarMix(out + i, in + i, gain + i, pan + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void AVX2Clamp(Signal *out, const Signal *in,
+                      const Signal *limit, unsigned n) {
+	__m256d sign = _mm256_set1_pd(-0.0), lim, x;
+	unsigned i;
+
+	for (i=0; i+4<=n; i+=4) {
+		lim = _mm256_loadu_pd(limit + i);
+		x = _mm256_min_pd(lim, _mm256_loadu_pd(in + i));
+		x = _mm256_max_pd(_mm256_xor_pd(lim, sign), x);
+		_mm256_storeu_pd(out + i, x);
+	}
+
+	_mm256_zeroupper();
+	ScalarClamp(out + i, in + i, limit + i, n - i);
+}
+
+Kernels KernelsAVX2 = {
+	.name          = "avx2",
+	.biquad        = SSE2Biquad,
+	.matrix        = AVX2Matrix,
+	.mix           = AVX2Mix,
+	.clamp         = AVX2Clamp,
+};
+
+#endif
+
+/*  KERNEL SELECTION                                                        */
+/*  ======================================================================  */
+
+Kernels *kernels = &KernelsScalar;
+
+static bool KernelsSupported(Kernels *k) {
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	if (k == &KernelsSSE2)
+		return __builtin_cpu_supports("sse2");
+	if (k == &KernelsAVX2)
+		return __builtin_cpu_supports("avx2");
+#endif
+	return k == &KernelsScalar;
+}
+
+void KernelsInitialize(void) {
+	static Kernels *all[] = {
+#ifdef KERNELS_X86
+		&KernelsAVX2,
+		&KernelsSSE2,
+#endif
+		&KernelsScalar,
+	};
+	const char *want = getenv("WCX_KERNELS");
+	unsigned i;
+
+	for (i=0; i<sizeof(all)/sizeof(*all); i++) {
+		if (want && strcmp(want, all[i]->name))
+			continue;
+		if (!KernelsSupported(all[i]))
+			continue;
+
+		kernels = all[i];
+		Log(DEBUG, "Using %s kernels", kernels->name);
+		return;
+	}
+
+	Abort("kernels \"%s\" unknown or not supported", want);
+}
@@ -0,0 +1,62 @@
+/* sample processing kernels */
+
+#ifndef __INC_KERNEL_H__
+#define __INC_KERNEL_H__
+
+typedef struct Kernels         Kernels;
+typedef struct Biquad          Biquad;
+
+#include "modular.h"
+
+/* Coefficients and state of a stereo biquad. The state is kept as
+   left/right pairs so both channels can be run side by side */
+struct Biquad {
+	double          a0, a1, a2, b1, b2;
+	double          x1[2], x2[2], y1[2], y2[2];
+};
+
+/* The inner loops of the modules that do plain arithmetic on whole blocks.
+   Every implementation does the same operations in the same order as the
+   scalar one, and so gives the same results bit for bit */
+struct Kernels {
+	char           *name;
+
+	/* L, R = filtered Lin, Rin, n samples */
+	void          (*biquad)  (Biquad*, Signal *L, Signal *R,
+	                          const Signal *Lin, const Signal *Rin,
+	                          unsigned n);
+
+	/* L = LL Lin + RL Rin + Loffs, and likewise for R */
+	void          (*matrix)  (Signal *L, Signal *R,
+	                          const Signal *Lin, const Signal *Rin,
+	                          const Signal *LL, const Signal *RL,
+	                          const Signal *LR, const Signal *RR,
+	                          const Signal *Loffs, const Signal *Roffs,
+	                          unsigned n);
+
+	/* out += in * gain * pan */
+	void          (*mix)     (Signal *out, const Signal *in,
+	                          const Signal *gain, const Signal *pan,
+	                          unsigned n);
+
+	/* out = in, clamped to [-limit, limit] */
+	void          (*clamp)   (Signal *out, const Signal *in,
+	                          const Signal *limit, unsigned n);
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#endif
+
+extern Kernels          KernelsScalar;
+#ifdef KERNELS_X86
+extern Kernels          KernelsSSE2;
+extern Kernels          KernelsAVX2;
+#endif
+
+/* The best kernels this CPU supports, or the ones named by the
+   WCX_KERNELS environment variable */
+extern Kernels         *kernels;
+extern void             KernelsInitialize(void);
+
+#endif
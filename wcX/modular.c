@@ -2,11 +2,16 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "common.h"
 #include "container.h"
 #include "modular.h"
+#include "kernel.h"
 
 /*  FILTER MODULE                                                           */
 /*  ======================================================================  */
@@ -20,9 +25,7 @@ struct FilterPrivate {
 	Signal *in[2];
 
 	double cutoff, reso;
-	double Lx1, Lx2, Ly1, Ly2;
-	double Rx1, Rx2, Ry1, Ry2;
-	double a0, a1, b1, a2, b2;
+	Biquad bq;
 };
 
 Filter *FilterGet(Module *m) {
@@ -35,7 +38,7 @@ void FilterSetInput(ModularContext *ctx, Module *m, Module *in) {
 	priv->in[0] = in->out;
 	priv->in[1] = in->out;
 	if (in->nout == 2) {
-		priv->in[1] = in->out + 1;
+		priv->in[1] = ModuleOut(in, 1);
 	} else if (in->nout != 1) {
 		Abort("filter can only take mono or stereo inputs");
 	}
@@ -52,79 +55,79 @@ static void FilterInitialize(ModularContext *ctx, Module *m) {
 	priv->cutoff = 0.0;
 }
 
+static void FilterCoefficients(ModularContext *ctx, struct FilterPrivate *filt,
+                               Signal cutoff, Signal reso) {
+	Biquad *bq = &filt->bq;
+	double x, q;
+	double omega, sn, cs, alpha, inv;
+
+	filt->cutoff = cutoff;
+	filt->reso   = reso;
+
+	x = tan(M_PI * filt->cutoff / (2.0 * ctx->rate));
+	q = 1.0 / (1.0 + x);
+
+	omega = 2 * M_PI * filt->cutoff / ctx->rate;
+	sn = sin(omega);
+	cs = cos(omega);
+	alpha = sn / (2 * filt->reso);
+	inv = 1.0 / (1.0 + alpha);
+
+	switch (filt->f.type) {
+	case FILTER_LOWPASS_ONE:
+		bq->a0 = x * q;
+		bq->a1 = bq->a0;
+		bq->b1 = (x - 1) * q;
+		bq->a2 = 0;
+		bq->b2 = 0;
+		break;
+
+	case FILTER_HIGHPASS_ONE:
+		bq->a0 = q;
+		bq->a1 = -bq->a0;
+		bq->b1 = (x - 1) * q;
+		bq->a2 = 0;
+		bq->b2 = 0;
+		break;
+
+	case FILTER_LOWPASS_TWO:
+		bq->a2 = bq->a0 = inv * (1 - cs) * 0.5;
+		bq->a1 = bq->a0 + bq->a0;
+		bq->b1 = -2 * cs * inv;
+		bq->b2 = (1 - alpha) * inv;
+		break;
+
+	case FILTER_HIGHPASS_TWO:
+
+		bq->a0 = inv * (1 + cs) / 2;
+		bq->a1 = -2 * bq->a0;
+		bq->a2 = bq->a0;
+		bq->b1 = -2 * cs * inv;
+		bq->b2 = (1 - alpha) * inv;
+		break;
+	}
+}
+
+/* the coefficients are worked out again whenever the cutoff or resonance
+   change, and the biquad runs over the stretches where they don't */
 static void FilterUpdate(ModularContext *ctx, Module *m) {
 	struct FilterPrivate *filt = m->user;
+	Signal *cutoff = filt->f.cutoff, *reso = filt->f.reso;
+	int i, j;
 
-	if (filt->cutoff != *filt->f.cutoff || filt->reso != *filt->f.reso) {
-		double x, q;
-		double omega, sn, cs, alpha, inv;
-
-		filt->cutoff = *filt->f.cutoff;
-		filt->reso   = *filt->f.reso;
-
-		x = tan(M_PI * filt->cutoff / (2.0 * ctx->rate));
-		q = 1.0 / (1.0 + x);
-
-		omega = 2 * M_PI * filt->cutoff / ctx->rate;
-		sn = sin(omega);
-		cs = cos(omega);
-		alpha = sn / (2 * filt->reso);
-		inv = 1.0 / (1.0 + alpha);
-
-		switch (filt->f.type) {
-		case FILTER_LOWPASS_ONE:
-			filt->a0 = x * q;
-			filt->a1 = filt->a0;
-			filt->b1 = (x - 1) * q;
-			filt->a2 = 0;
-			filt->b2 = 0;
-			break;
-
-		case FILTER_HIGHPASS_ONE:
-			filt->a0 = q;
-			filt->a1 = -filt->a0;
-			filt->b1 = (x - 1) * q;
-			filt->a2 = 0;
-			filt->b2 = 0;
-			break;
-
-		case FILTER_LOWPASS_TWO:
-			filt->a2 = filt->a0 = inv * (1 - cs) * 0.5;
-			filt->a1 = filt->a0 + filt->a0;
-			filt->b1 = -2 * cs * inv;
-			filt->b2 = (1 - alpha) * inv;
-			break;
+	for (i=0; i<MODULAR_BLOCK_SIZE; i=j) {
+		if (filt->cutoff != cutoff[i] || filt->reso != reso[i])
+			FilterCoefficients(ctx, filt, cutoff[i], reso[i]);
 
-		case FILTER_HIGHPASS_TWO:
-
-			filt->a0 = inv * (1 + cs) / 2;
-			filt->a1 = -2 * filt->a0;
-			filt->a2 = filt->a0;
-			filt->b1 = -2 * cs * inv;
-			filt->b2 = (1 - alpha) * inv;
-			break;
+		for (j=i+1; j<MODULAR_BLOCK_SIZE; j++) {
+			if (cutoff[j] != filt->cutoff || reso[j] != filt->reso)
+				break;
 		}
-	}
 
-	m->out[0] = *filt->in[0] * filt->a0
-	             + filt->Lx1 * filt->a1
-	             + filt->Lx2 * filt->a2
-	             - filt->Ly1 * filt->b1
-	             - filt->Ly2 * filt->b2;
-	m->out[1] = *filt->in[1] * filt->a0
-	             + filt->Rx1 * filt->a1
-	             + filt->Rx2 * filt->a2
-	             - filt->Ry1 * filt->b1
-	             - filt->Ry2 * filt->b2;
-
-	filt->Lx2 = filt->Lx1;
-	filt->Ly2 = filt->Ly1;
-	filt->Rx2 = filt->Rx1;
-	filt->Ry2 = filt->Ry1;
-	filt->Lx1 = *filt->in[0];
-	filt->Rx1 = *filt->in[1];
-	filt->Ly1 = m->out[0];
-	filt->Ry1 = m->out[1];
+		kernels->biquad(&filt->bq, ModuleOut(m, 0) + i,
+		                ModuleOut(m, 1) + i, filt->in[0] + i,
+		                filt->in[1] + i, j - i);
+	}
 }
 
 ModuleSpec ModFilter = {
@@ -161,12 +164,10 @@ static void MatrixInitialize(ModularContext *ctx, Module *m) {
 
 static void MatrixUpdate(ModularContext *ctx, Module *m) {
 	Matrix *M = MatrixGet(m);
-	if (!M->Lin || !M->Rin) {
-		m->out[0] = m->out[1] = 0.0;
-		return;
-	}
-	m->out[0] = *M->LL * *M->Lin + *M->RL * *M->Rin + *M->Loffs;
-	m->out[1] = *M->LR * *M->Lin + *M->RR * *M->Rin + *M->Roffs;
+
+	kernels->matrix(ModuleOut(m, 0), ModuleOut(m, 1), M->Lin, M->Rin,
+	                M->LL, M->RL, M->LR, M->RR, M->Loffs, M->Roffs,
+	                MODULAR_BLOCK_SIZE);
 }
 
 void MatrixSetInput(ModularContext *ctx, Module *m, Module *in) {
@@ -175,7 +176,7 @@ void MatrixSetInput(ModularContext *ctx, Module *m, Module *in) {
 	M->Lin = in->out;
 	M->Rin = in->out;
 	if (in->nout == 2) {
-		M->Rin = in->out + 1;
+		M->Rin = ModuleOut(in, 1);
 	} else if (in->nout != 1) {
 		Abort("matrix can only take mono or stereo inputs");
 	}
@@ -183,36 +184,36 @@ void MatrixSetInput(ModularContext *ctx, Module *m, Module *in) {
 	AddDependency(ctx, m, in);
 }
 
+static void MatrixSet(Matrix *M, double LL, double RL, double Loffs,
+                                  double LR, double RR, double Roffs) {
+	SignalSet(M->LL, LL); SignalSet(M->RL, RL); SignalSet(M->Loffs, Loffs);
+	SignalSet(M->LR, LR); SignalSet(M->RR, RR); SignalSet(M->Roffs, Roffs);
+}
+
 void MatrixIdentity(Module *m) {
-	Matrix *M = MatrixGet(m);
-	*M->LL =  1.0; *M->RL =  0.0; *M->Loffs = 0.0;
-	*M->LR =  0.0; *M->RR =  1.0; *M->Roffs = 0.0;
+	MatrixSet(MatrixGet(m),  1.0,  0.0,  0.0,
+	                         0.0,  1.0,  0.0);
 }
 
 void MatrixMSSplit(Module *m) {
-	Matrix *M = MatrixGet(m);
-	*M->LL =  0.5; *M->RL =  0.5; *M->Loffs = 0.0;
-	*M->LR =  0.5; *M->RR = -0.5; *M->Roffs = 0.0;
+	MatrixSet(MatrixGet(m),  0.5,  0.5,  0.0,
+	                         0.5, -0.5,  0.0);
 }
 
 void MatrixMSJoin(Module *m) {
-	Matrix *M = MatrixGet(m);
-	*M->LL =  1.0; *M->RL =  1.0; *M->Loffs = 0.0;
-	*M->LR =  1.0; *M->RR = -1.0; *M->Roffs = 0.0;
+	MatrixSet(MatrixGet(m),  1.0,  1.0,  0.0,
+	                         1.0, -1.0,  0.0);
 }
 
 void MatrixGainPan(Module *m, double gain, double pan) {
-	Matrix *M = MatrixGet(m);
-	*M->LL = gain * (1.0 - pan);
-	*M->RR = gain * (1.0 + pan);
-	*M->LR = *M->RL = *M->Loffs = *M->Roffs = 0.0;
+	MatrixSet(MatrixGet(m),  gain * (1.0 - pan),  0.0,  0.0,
+	                         0.0,  gain * (1.0 + pan),  0.0);
 }
 
 void MatrixScale(Module *m, double a1, double b1, double a2, double b2) {
-	Matrix *M = MatrixGet(m);
-	*M->LL = *M->RR = (b2 - a2) / (b1 - a1);
-	*M->Loffs = *M->Roffs = a2 - a1;
-	*M->LR = *M->RL = 0.0;
+	double k = (b2 - a2) / (b1 - a1);
+	MatrixSet(MatrixGet(m),  k,  0.0,  a2 - a1,
+	                         0.0,  k,  a2 - a1);
 }
 
 ModuleSpec ModMatrix = {
@@ -257,32 +258,42 @@ static void ADSRInitialize(ModularContext *ctx, Module *m) {
 
 static void ADSRUpdate(ModularContext *ctx, Module *m) {
 	struct ADSRPrivate *priv = m->user;
+	ADSR *env = &priv->env;
+	int i;
 
-	if (*priv->env.trig < ADSR_TRIGGER) {
-		priv->amt -= priv->rfrom / (ctx->rate * *priv->env.R);
-		if (priv->amt < 0)
-			priv->amt = 0;
-	} else {
-		if (priv->ptrig < ADSR_TRIGGER && *priv->env.trig > ADSR_TRIGGER)
-			priv->attack = true;
-
-		if (priv->attack) {
-			priv->amt += 1.0 / (ctx->rate * *priv->env.A);
-			if (priv->amt > 1.0) {
-				priv->amt = 1.0;
-				priv->attack = false;
-			}
+	for (i=0; i<MODULAR_BLOCK_SIZE; i++) {
+		if (env->trig[i] < ADSR_TRIGGER) {
+			priv->amt -= priv->rfrom / (ctx->rate * env->R[i]);
+			if (priv->amt < 0)
+				priv->amt = 0;
 		} else {
-			priv->amt -= 1.0 / (ctx->rate * *priv->env.D);
-			if (priv->amt < *priv->env.S)
-				priv->amt = *priv->env.S;
+			if (priv->ptrig < ADSR_TRIGGER && env->trig[i] > ADSR_TRIGGER)
+				priv->attack = true;
+
+			if (priv->attack) {
+				priv->amt += 1.0 / (ctx->rate * env->A[i]);
+				if (priv->amt > 1.0) {
+					priv->amt = 1.0;
+					priv->attack = false;
+				}
+			} else {
+				priv->amt -= 1.0 / (ctx->rate * env->D[i]);
+				if (priv->amt < env->S[i])
+					priv->amt = env->S[i];
+			}
+
+			priv->rfrom = priv->amt;
 		}
 
-		priv->rfrom = priv->amt;
+		priv->ptrig = env->trig[i];
+		m->out[i] = env->shape(env, priv->amt);
 	}
+}
 
-	priv->ptrig = *priv->env.trig;
-	m->out[0] = priv->env.shape(&priv->env, priv->amt);
+/* released, and all the way back down */
+bool ADSRIdle(Module *m) {
+	struct ADSRPrivate *priv = m->user;
+	return priv->ptrig < ADSR_TRIGGER && priv->amt <= 0.0;
 }
 
 Signal ADSRLinear(ADSR *env, Signal f) {
@@ -313,6 +324,106 @@ Oscillator *OscillatorGet(Module *m) {
 	return &priv->osc;
 }
 
+/* The band-limited waveforms are the sums of the harmonics of the plain
+   ones below the Nyquist frequency, 1/n sin(2 pi n phase) for the nth. The
+   sums are precomputed into tables, one per semitone, and the table used
+   for a given frequency is the one with all the harmonics that stay below
+   Nyquist anywhere in its semitone. Only harmonics in the top semitone
+   below Nyquist can be missing, in exchange for one table lookup per
+   sample rather than a sin for every harmonic.
+
+   Each table has at least 8 samples per cycle of its highest harmonic,
+   up to OSC_TABLE_SIZE, and notes low enough to have more than
+   OSC_TABLE_SIZE / 8 harmonics use the last table. The tables are shared
+   by every oscillator and are never written to once built */
+
+#define OSC_NYQUIST     24000.0
+#define OSC_TABLE_SIZE  8192
+#define OSC_TABLES      (12 * 10) /* up to 2^10 harmonics */
+
+struct OscTable {
+	unsigned size;
+	Signal *s; /* size + 1 samples, the last a copy of the first */
+};
+
+static struct OscTable osc_saw_tables[OSC_TABLES];
+static struct OscTable osc_square_tables[OSC_TABLES];
+static double osc_semitones[12];
+
+static Signal osc_sine[OSC_TABLE_SIZE];
+
+/* each table starts from the one before it, and only adds the harmonics
+   the one before it doesn't have, unless the size differs */
+static void OscBuildTables(struct OscTable *tables, int step) {
+	struct OscTable *tab, *prev = NULL;
+	int t, k, n, first, harmonics, stride;
+
+	for (t=0; t<OSC_TABLES; t++, prev = tab) {
+		tab = &tables[t];
+		harmonics = floor(pow(2.0, t / 12.0));
+
+		for (tab->size = 64; tab->size < OSC_TABLE_SIZE &&
+		                     tab->size < 8 * harmonics; tab->size <<= 1);
+		tab->s = calloc(tab->size + 1, sizeof(Signal));
+
+		first = 1;
+		if (prev && prev->size == tab->size) {
+			memcpy(tab->s, prev->s, tab->size * sizeof(Signal));
+			first = floor(pow(2.0, (t - 1) / 12.0)) + 1;
+		}
+
+		stride = OSC_TABLE_SIZE / tab->size;
+		for (n=first; n<=harmonics; n++) {
+			if ((n - 1) % step != 0)
+				continue;
+			for (k=0; k<tab->size; k++) {
+				tab->s[k] += osc_sine[(n * k) % tab->size * stride]
+				             / n;
+			}
+		}
+
+		tab->s[tab->size] = tab->s[0];
+	}
+}
+
+static void OscInitializeTables(void) {
+	int i;
+
+	if (osc_saw_tables[0].s != NULL)
+		return;
+
+	for (i=0; i<12; i++)
+		osc_semitones[i] = pow(2.0, i / 12.0);
+	for (i=0; i<OSC_TABLE_SIZE; i++)
+		osc_sine[i] = sin(2 * M_PI * i / OSC_TABLE_SIZE);
+
+	OscBuildTables(osc_saw_tables, 1);
+	OscBuildTables(osc_square_tables, 2);
+}
+
+static Signal OscTableLookup(struct OscTable *tables, Signal phase,
+                             Signal freq) {
+	struct OscTable *tab;
+	double m, pos;
+	int e, t, i;
+
+	if (freq >= OSC_NYQUIST)
+		return 0.0;
+
+	/* the table is the number of semitones freq is below Nyquist. the
+	   octaves come from the exponent, and the rest from the mantissa */
+	m = 2 * frexp(OSC_NYQUIST / freq, &e);
+	for (t=0; t<11 && m >= osc_semitones[t + 1]; t++);
+	t += 12 * (e - 1);
+	if (t >= OSC_TABLES)
+		t = OSC_TABLES - 1;
+
+	tab = &tables[t];
+	pos = phase * tab->size;
+	i = pos;
+	return tab->s[i] + (pos - i) * (tab->s[i + 1] - tab->s[i]);
+}
+
 static void OscillatorInitialize(ModularContext *ctx, Module *m) {
 	struct OscillatorPrivate *priv = calloc(1, sizeof(*priv));
 	m->user = priv;
@@ -320,62 +431,55 @@ static void OscillatorInitialize(ModularContext *ctx, Module *m) {
 	priv->osc.gain = NewSignal(1.0);
 	priv->osc.waveform = OscSine;
 	priv->phase = (rand() % 500) / 500.0;
+	OscInitializeTables();
 }
 
 static void OscillatorUpdate(ModularContext *ctx, Module *m) {
 	struct OscillatorPrivate *priv = m->user;
-	priv->phase = fmod(priv->phase + *priv->osc.freq / ctx->rate, 1.0);
-	m->out[0] = priv->osc.waveform(&priv->osc, priv->phase) * *priv->osc.gain;
+	Oscillator *osc = &priv->osc;
+	int i;
+
+	for (i=0; i<MODULAR_BLOCK_SIZE; i++) {
+		priv->phase = fmod(priv->phase + osc->freq[i] / ctx->rate, 1.0);
+		m->out[i] = osc->waveform(osc, priv->phase, osc->freq[i]) *
+		            osc->gain[i];
+	}
 }
 
-Signal OscSine(Oscillator *osc, Signal phase) {
+Signal OscSine(Oscillator *osc, Signal phase, Signal freq) {
 	return sin(2 * M_PI * phase);
 }
 
-Signal OscTriangle(Oscillator *osc, Signal phase) {
+Signal OscTriangle(Oscillator *osc, Signal phase, Signal freq) {
 	if (phase < 0.5)
 		return  1.0 - 4.0 * phase;
 	else
 		return -3.0 + 4.0 * phase;
 }
 
-Signal OscSquare(Oscillator *osc, Signal phase) {
+Signal OscSquare(Oscillator *osc, Signal phase, Signal freq) {
 	if (phase < 0.5)
 		return  1.0;
 	else
 		return -1.0;
 }
 
-Signal OscSawtooth(Oscillator *osc, Signal phase) {
+Signal OscSawtooth(Oscillator *osc, Signal phase, Signal freq) {
 	return -1.0 + 2.0 * phase;
 }
 
-Signal OscBandlimitedSquare(Oscillator *osc, Signal phase) {
-	int i;
-	double f;
-	Signal out = 0.0;
-
-	if (*osc->freq < 1)
-		return OscSquare(osc, phase);
-
-	for (i=1, f=*osc->freq; f < 24000; i+=2, f = *osc->freq * i)
-		out += sin(2 * M_PI * phase * i) / i;
+Signal OscBandlimitedSquare(Oscillator *osc, Signal phase, Signal freq) {
+	if (freq < 1)
+		return OscSquare(osc, phase, freq);
 
-	return out;
+	return OscTableLookup(osc_square_tables, phase, freq);
 }
 
-Signal OscBandlimitedSaw(Oscillator *osc, Signal phase) {
-	int i;
-	double f;
-	Signal out = 0.0;
-
-	if (*osc->freq < 1)
-		return OscSawtooth(osc, phase);
-
-	for (i=1, f=*osc->freq; f < 24000; i++, f = *osc->freq * i)
-		out += sin(2 * M_PI * phase * i) / i;
+Signal OscBandlimitedSaw(Oscillator *osc, Signal phase, Signal freq) {
+	if (freq < 1)
+		return OscSawtooth(osc, phase, freq);
 
-	return out;
+	return OscTableLookup(osc_saw_tables, phase, freq);
 }
 
 ModuleSpec ModOscillator = {
@@ -407,7 +511,7 @@ MixerSlot *MixerAddSlot(ModularContext *ctx, Module *m,
 	slot->in[0] = in->out;
 	slot->in[1] = in->out;
 	if (in->nout == 2) {
-		slot->in[1] = in->out + 1;
+		slot->in[1] = ModuleOut(in, 1);
 	} else if (in->nout != 1) {
 		Abort("mixer can only take mono or stereo inputs");
 	}
@@ -431,16 +535,31 @@ static void MixerInitialize(ModularContext *ctx, Module *m) {
 
 static void MixerUpdate(ModularContext *ctx, Module *m) {
 	struct MixerPrivate *priv = m->user;
+	Signal *L = ModuleOut(m, 0), *R = ModuleOut(m, 1);
+	Signal panL[MODULAR_BLOCK_SIZE], panR[MODULAR_BLOCK_SIZE];
 	MixerSlot **slot;
+	int i;
 
-	m->out[0] = 0.0;
-	m->out[1] = 0.0;
+	for (i=0; i<MODULAR_BLOCK_SIZE; i++)
+		L[i] = R[i] = 0.0;
 
 	VEC_EACH(&priv->slots, slot) {
 		MixerSlot *s = *slot;
 
-		m->out[0] += *s->in[0] * *s->gain * priv->pan( *s->pan);
-		m->out[1] += *s->in[1] * *s->gain * priv->pan(-*s->pan);
+		/* pan is usually set once and left alone, so the pan law is
+		   only applied again when it changes */
+		for (i=0; i<MODULAR_BLOCK_SIZE; i++) {
+			if (i > 0 && s->pan[i] == s->pan[i - 1]) {
+				panL[i] = panL[i - 1];
+				panR[i] = panR[i - 1];
+			} else {
+				panL[i] = priv->pan( s->pan[i]);
+				panR[i] = priv->pan(-s->pan[i]);
+			}
+		}
+
+		kernels->mix(L, s->in[0], s->gain, panL, MODULAR_BLOCK_SIZE);
+		kernels->mix(R, s->in[1], s->gain, panR, MODULAR_BLOCK_SIZE);
 	}
 }
 
@@ -469,7 +588,7 @@ void LimiterSetInput(ModularContext *ctx, Module *m, Module *in) {
 	priv->in[0] = in->out;
 	priv->in[1] = in->out;
 	if (in->nout == 2) {
-		priv->in[1] = in->out + 1;
+		priv->in[1] = ModuleOut(in, 1);
 	} else if (in->nout != 1) {
 		Abort("limiter can only take mono or stereo inputs");
 	}
@@ -485,15 +604,11 @@ static void LimiterInitialize(ModularContext *ctx, Module *m) {
 
 static void LimiterUpdate(ModularContext *ctx, Module *m) {
 	struct LimiterPrivate *priv = m->user;
-	int i;
+	int c;
 
-	for (i=0; i<m->nout; i++) {
-		m->out[i] = *priv->in[i];
-
-		if (m->out[i] > *priv->limit)
-			m->out[i] = *priv->limit;
-		if (m->out[i] < -*priv->limit)
-			m->out[i] = -*priv->limit;
+	for (c=0; c<m->nout; c++) {
+		kernels->clamp(ModuleOut(m, c), priv->in[c], priv->limit,
+		               MODULAR_BLOCK_SIZE);
 	}
 }
 
@@ -508,11 +623,58 @@ ModuleSpec ModLimiter = {
 /*  ======================================================================  */
 
 Signal *NewSignal(double init) {
-	Signal *s = calloc(1, sizeof(*s));
-	*s = init;
+	Signal *s = calloc(MODULAR_BLOCK_SIZE, sizeof(*s));
+	SignalSet(s, init);
 	return s;
 }
 
+void SignalSet(Signal *s, double v) {
+	int i;
+
+	for (i=0; i<MODULAR_BLOCK_SIZE; i++)
+		s[i] = v;
+}
+
+void SignalSetFrom(PartialSignals *p, Signal *s, double v, unsigned offset) {
+	unsigned i;
+
+	for (i=offset; i<MODULAR_BLOCK_SIZE; i++)
+		s[i] = v;
+
+	/* a signal set again in the same block settles to the last value */
+	for (i=0; i<p->len && p->sigs[i].sig != s; i++)
+		;
+	if (i < p->len) {
+		p->sigs[i].v = v;
+		return;
+	}
+	if (offset == 0)
+		return;
+
+	if (p->len == p->cap)
+		PartialSignalsReserve(p, p->cap ? p->cap * 2 : 8);
+	p->sigs[p->len].sig = s;
+	p->sigs[p->len].v = v;
+	p->len++;
+}
+
+/* so that the render thread doesn't have to allocate */
+void PartialSignalsReserve(PartialSignals *p, unsigned n) {
+	if (n <= p->cap)
+		return;
+
+	p->cap = n;
+	p->sigs = realloc(p->sigs, p->cap * sizeof(*p->sigs));
+}
+
+void PartialSignalsSettle(PartialSignals *p) {
+	unsigned i;
+
+	for (i=0; i<p->len; i++)
+		SignalSet(p->sigs[i].sig, p->sigs[i].v);
+	p->len = 0;
+}
+
 Module  *modules_head  =  NULL;
 Module  *modules_tail  =  NULL;
 int      module_count  =  0;
@@ -521,7 +683,15 @@ unsigned this_step = 0;
 Module *master = NULL;
 Module *output = NULL;
 
+/* The order modules are updated in, dependencies first. It only changes
+   when modules or dependencies are added, so it is worked out again then
+   rather than on every block */
+Vector   schedule;
+bool     schedule_stale = true;
+
 void ModularInitialize(ModularContext *ctx) {
+	KernelsInitialize();
+
 	master = NewModule(ctx, &ModMixer);
 	output = NewModule(ctx, &ModLimiter);
 
@@ -536,7 +706,7 @@ Module *ModularOutput(ModularContext *ctx) {
 	return output;
 }
 
-static void StepOne(ModularContext *ctx, Module *m, int depth) {
+static void ScheduleOne(ModularContext *ctx, Module *m, int depth) {
 	Module **cur;
 
 	if (m->step >= this_step)
@@ -546,15 +716,211 @@ static void StepOne(ModularContext *ctx, Module *m, int depth) {
 		Abort("Module cycle detected; exiting");
 
 	VEC_EACH(&m->deps, cur)
-		StepOne(ctx, *cur, depth + 1);
+		ScheduleOne(ctx, *cur, depth + 1);
 
-	m->spec->update(ctx, m);
+	Vec_Push(&schedule, m);
 	m->step = this_step;
 }
 
-void ModularStep(ModularContext *ctx) {
+/* With more than one thread, the subgraphs feeding the master mixer that
+   share no modules are run side by side, each group of them on a lane of
+   its own. Whatever is left (the master mixer and the limiter) runs after
+   them on the calling thread, which also runs lane 0 */
+struct Lane {
+	pthread_t       thread;
+	ModularContext *ctx;
+	Vector          schedule;
+	atomic_uint     start, done;
+} __attribute__((aligned(64)));
+
+unsigned     nthreads       = 1;
+struct Lane *lanes          = NULL;
+unsigned     nlanes         = 0; /* lanes with work in this schedule */
+unsigned     lanes_block    = 0;
+atomic_bool  lanes_quit;
+Vector       schedule_tail;
+
+static int GroupFind(int *parent, int g) {
+	while (parent[g] != g)
+		g = parent[g] = parent[parent[g]];
+	return g;
+}
+
+/* Puts m and everything it depends on in group g. Groups found to share
+   a module are joined */
+static void GroupMark(Module *m, int *parent, int g) {
+	Module **cur;
+	int h;
+
+	if (m->group >= 0) {
+		h = GroupFind(parent, m->group);
+		g = GroupFind(parent, g);
+		if (h != g)
+			parent[h] = g;
+		return;
+	}
+
+	m->group = g;
+
+	VEC_EACH(&m->deps, cur)
+		GroupMark(*cur, parent, g);
+}
+
+static void ScheduleLanes(ModularContext *ctx) {
+	Module **cur;
+	int n = master->deps.len, g;
+	int *parent = calloc(n, sizeof(*parent));
+	int *lane = calloc(n, sizeof(*lane));
+	unsigned i, groups = 0;
+
+	for (i=0; i<nthreads; i++)
+		lanes[i].schedule.len = 0;
+	schedule_tail.len = 0;
+
+	VEC_EACH(&schedule, cur)
+		(*cur)->group = -1;
+
+	for (g=0; g<n; g++)
+		parent[g] = g;
+	for (g=0; g<n; g++)
+		GroupMark(master->deps.base[g], parent, g);
+
+	/* the independent groups are dealt out to the lanes in turn */
+	for (g=0; g<n; g++) {
+		if (GroupFind(parent, g) == g)
+			lane[g] = groups++ % nthreads;
+	}
+	nlanes = groups < nthreads ? groups : nthreads;
+
+	/* each lane keeps the order of the full schedule */
+	VEC_EACH(&schedule, cur) {
+		if ((*cur)->group < 0) {
+			Vec_Push(&schedule_tail, *cur);
+		} else {
+			g = GroupFind(parent, (*cur)->group);
+			Vec_Push(&lanes[lane[g]].schedule, *cur);
+		}
+	}
+
+	Log(DEBUG, "%u independent subgraphs on %u lanes", groups, nlanes);
+
+	free(parent);
+	free(lane);
+}
+
+static void Schedule(ModularContext *ctx) {
 	this_step++;
-	StepOne(ctx, output, 0);
+	schedule.len = 0;
+	ScheduleOne(ctx, output, 0);
+
+	nlanes = 0;
+	if (nthreads > 1)
+		ScheduleLanes(ctx);
+
+	schedule_stale = false;
+}
+
+static void ModularRun(ModularContext *ctx, Vector *sched) {
+	Module **cur, *m;
+
+	VEC_EACH(sched, cur) {
+		m = *cur;
+
+		if (m->active && !*m->active) {
+			if (!m->silent) {
+				memset(m->out, 0, m->nout * MODULAR_BLOCK_SIZE *
+				                  sizeof(Signal));
+				m->silent = true;
+			}
+			continue;
+		}
+
+		m->silent = false;
+		m->spec->update(ctx, m);
+	}
+}
+
+/* A block is only a few microseconds of work, too short to sleep and be
+   woken between, so the lanes poll, yielding in case they share a
+   processor with the thread they are waiting on */
+static void *LaneThread(void *arg) {
+	struct Lane *lane = arg;
+	unsigned seen = 0, block;
+
+	for (;;) {
+		while ((block = atomic_load(&lane->start)) == seen)
+			sched_yield();
+		if (atomic_load(&lanes_quit))
+			break;
+
+		seen = block;
+		ModularRun(lane->ctx, &lane->schedule);
+		atomic_store(&lane->done, block);
+	}
+
+	return NULL;
+}
+
+void ModularSetThreads(ModularContext *ctx, unsigned n) {
+	unsigned i;
+
+	if (n < 1)
+		n = 1;
+
+	if (lanes) {
+		atomic_store(&lanes_quit, true);
+		for (i=1; i<nthreads; i++) {
+			atomic_store(&lanes[i].start, lanes_block + 1);
+			pthread_join(lanes[i].thread, NULL);
+		}
+		for (i=0; i<nthreads; i++)
+			free(lanes[i].schedule.base);
+		free(lanes);
+		lanes = NULL;
+	}
+
+	nthreads = n;
+	schedule_stale = true;
+
+	if (nthreads == 1)
+		return;
+
+	lanes = aligned_alloc(64, nthreads * sizeof(*lanes));
+	memset(lanes, 0, nthreads * sizeof(*lanes));
+	atomic_store(&lanes_quit, false);
+	lanes_block = 0;
+
+	for (i=1; i<nthreads; i++) {
+		if (pthread_create(&lanes[i].thread, NULL, LaneThread, &lanes[i]))
+			Abort("could not start render thread");
+	}
+}
+
+void ModularStep(ModularContext *ctx) {
+	unsigned i;
+
+	if (schedule_stale)
+		Schedule(ctx);
+
+	if (nlanes <= 1) {
+		ModularRun(ctx, &schedule);
+		return;
+	}
+
+	lanes_block++;
+	for (i=1; i<nlanes; i++) {
+		lanes[i].ctx = ctx;
+		atomic_store(&lanes[i].start, lanes_block);
+	}
+
+	ModularRun(ctx, &lanes[0].schedule);
+
+	for (i=1; i<nlanes; i++) {
+		while (atomic_load(&lanes[i].done) != lanes_block)
+			sched_yield();
+	}
+
+	ModularRun(ctx, &schedule_tail);
 }
 
 Module *NewModule(ModularContext *ctx, ModuleSpec *spec) {
@@ -565,7 +931,7 @@ Module *NewModule(ModularContext *ctx, ModuleSpec *spec) {
 	m->spec = spec;
 
 	m->nout = spec->nout;
-	m->out = calloc(m->nout, sizeof(Signal));
+	m->out = calloc(m->nout * MODULAR_BLOCK_SIZE, sizeof(Signal));
 
 	if (modules_tail) {
 		modules_tail->next = m;
@@ -577,10 +943,16 @@ Module *NewModule(ModularContext *ctx, ModuleSpec *spec) {
 
 	modules_tail = m;
 	module_count++;
+	schedule_stale = true;
 
 	return m;
 }
 
+Module *ModularNewest(ModularContext *ctx) {
+	return modules_tail;
+}
+
 void AddDependency(ModularContext *ctx, Module *m, Module *on) {
 	Vec_Push(&m->deps, on);
+	schedule_stale = true;
 }
@@ -7,6 +7,13 @@
 
 typedef double                 Signal;
 
+/* Modules are run a block of frames at a time. Every Signal is a buffer of
+   one block's worth of values, whether it is a module output or a
+   parameter set with SignalSet */
+#ifndef MODULAR_BLOCK_SIZE
+#define MODULAR_BLOCK_SIZE     64
+#endif
+
 typedef struct ModularContext  ModularContext;
 
 typedef struct Module          Module;
@@ -18,6 +25,8 @@ typedef struct ADSR            ADSR;
 typedef struct Oscillator      Oscillator;
 typedef struct MixerSlot       MixerSlot;
 
+typedef struct PartialSignals  PartialSignals;
+
 #include "container.h"
 
 struct ModularContext {
@@ -38,11 +47,18 @@ struct Module {
 	   are not allowed, however there are ways around it. */
 	Vector          deps;
 
+	/* nout channels of MODULAR_BLOCK_SIZE samples, one after another */
 	unsigned        nout;
 	Signal         *out;
 
 	Module         *next;
 	unsigned        step;
+	int             group; /* the subgraph it is rendered in */
+
+	/* When set, the module is only updated while *active is true, and its
+	   outputs are silent otherwise */
+	bool           *active;
+	bool            silent;
 };
 
 struct ModuleSpec {
@@ -51,6 +67,8 @@ struct ModuleSpec {
 	unsigned        nout;
 
 	void          (*initialize)  (ModularContext*, Module*);
+	/* Fills in one block of out. The dependencies have already been
+	   updated for the same block */
 	void          (*update)      (ModularContext*, Module*);
 };
 
@@ -98,6 +116,7 @@ struct ADSR {
 	Signal        (*shape)       (ADSR*, Signal time);
 };
 extern ADSR            *ADSRGet(Module*);
+extern bool             ADSRIdle     (Module*);
 extern Signal           ADSRLinear   (ADSR*, Signal);
 extern Signal           ADSRExp      (ADSR*, Signal);
 
@@ -105,15 +124,17 @@ extern ModuleSpec       ModOscillator;
 struct Oscillator {
 	Signal         *freq;
 	Signal         *gain;
-	Signal        (*waveform)            (Oscillator*, Signal phase);
+	/* freq is the frequency at the sample being generated */
+	Signal        (*waveform)            (Oscillator*, Signal phase,
+	                                                   Signal freq);
 };
 extern Oscillator      *OscillatorGet        (Module*);
-extern Signal           OscSine              (Oscillator*, Signal);
-extern Signal           OscTriangle          (Oscillator*, Signal);
-extern Signal           OscSquare            (Oscillator*, Signal);
-extern Signal           OscSawtooth          (Oscillator*, Signal);
-extern Signal           OscBandlimitedSquare (Oscillator*, Signal);
-extern Signal           OscBandlimitedSaw    (Oscillator*, Signal);
+extern Signal           OscSine              (Oscillator*, Signal, Signal);
+extern Signal           OscTriangle          (Oscillator*, Signal, Signal);
+extern Signal           OscSquare            (Oscillator*, Signal, Signal);
+extern Signal           OscSawtooth          (Oscillator*, Signal, Signal);
+extern Signal           OscBandlimitedSquare (Oscillator*, Signal, Signal);
+extern Signal           OscBandlimitedSaw    (Oscillator*, Signal, Signal);
 
 extern ModuleSpec       ModMixer;
 struct MixerSlot {
@@ -130,13 +151,35 @@ extern void             LimiterSetInput(ModularContext*, Module*, Module*);
 /* Module Manager */
 
 extern Signal          *NewSignal(double init);
+extern void             SignalSet(Signal*, double);
+
+/* Signals set from partway through a block, which keep their old values
+   up to that point. Settling fills them with their new values entirely,
+   and has to be done once the block has been rendered */
+struct PartialSignals {
+	unsigned        len, cap;
+	struct PartialSignal {
+		Signal *sig;
+		Signal  v;
+	}              *sigs;
+};
+extern void             SignalSetFrom(PartialSignals*, Signal*, double,
+                                      unsigned offset);
+extern void             PartialSignalsReserve(PartialSignals*, unsigned);
+extern void             PartialSignalsSettle(PartialSignals*);
+
+static inline Signal *ModuleOut(Module *m, unsigned ch) {
+	return m->out + ch * MODULAR_BLOCK_SIZE;
+}
 
 extern void             ModularInitialize(ModularContext*);
 extern Module          *ModularMaster(ModularContext*);
 extern Module          *ModularOutput(ModularContext*);
-extern void             ModularStep(ModularContext*);
+extern void             ModularStep(ModularContext*); /* one block */
+extern void             ModularSetThreads(ModularContext*, unsigned);
 
 extern Module          *NewModule(ModularContext*, ModuleSpec*);
+extern Module          *ModularNewest(ModularContext*);
 extern void             AddDependency(ModularContext*, Module*, Module *on);
 
 #endif
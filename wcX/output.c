@@ -0,0 +1,153 @@
+/* audio output */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "output.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define OUTPUT_SCALE       32767
+
+#define WAVE_FORMAT_PCM         1
+#define WAVE_FORMAT_IEEE_FLOAT  3
+
+struct Output {
+	int             fd;
+	OutputFormat    format;
+	bool            wav;
+	unsigned        rate;
+
+	unsigned long   frames;
+
+	size_t          len;
+	unsigned char   buf[OUTPUT_BUFFER_SIZE];
+};
+
+static void WriteAll(int fd, const void *p, size_t n) {
+	ssize_t done;
+
+	while (n > 0) {
+		done = write(fd, p, n);
+		if (done < 0 && errno == EINTR)
+			continue;
+		if (done <= 0)
+			Abort("could not write output: %s", strerror(errno));
+		p = (const char*)p + done;
+		n -= done;
+	}
+}
+
+static unsigned char *Put16(unsigned char *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	return p + 2;
+}
+
+static unsigned char *Put32(unsigned char *p, uint32_t v) {
+	p = Put16(p, v);
+	return Put16(p, v >> 16);
+}
+
+static unsigned FrameSize(Output *o) {
+	return o->format == OUTPUT_F32 ? 8 : 4;
+}
+
+/* RIFF header, fmt chunk, and the start of the data chunk. Float data
+   also has a fact chunk with the number of frames */
+static size_t WAVHeader(Output *o, unsigned char *h, uint32_t frames) {
+	unsigned char *p = h;
+	uint32_t data = frames * FrameSize(o);
+	bool f32 = o->format == OUTPUT_F32;
+
+	if (frames >= UINT32_MAX / FrameSize(o))
+		data = UINT32_MAX;
+
+	memcpy(p, "RIFF", 4);                 p += 4;
+	p = Put32(p, data == UINT32_MAX ? UINT32_MAX :
+	             data + (f32 ? 50 : 36));
+	memcpy(p, "WAVE", 4);                 p += 4;
+
+	memcpy(p, "fmt ", 4);                 p += 4;
+	p = Put32(p, f32 ? 18 : 16);
+	p = Put16(p, f32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+	p = Put16(p, 2);
+	p = Put32(p, o->rate);
+	p = Put32(p, o->rate * FrameSize(o));
+	p = Put16(p, FrameSize(o));
+	p = Put16(p, f32 ? 32 : 16);
+	if (f32) {
+		p = Put16(p, 0);
+		memcpy(p, "fact", 4);         p += 4;
+		p = Put32(p, 4);
+		p = Put32(p, frames);
+	}
+
+	memcpy(p, "data", 4);                 p += 4;
+	p = Put32(p, data);
+
+	return p - h;
+}
+
+Output *NewOutput(int fd, OutputFormat format, bool wav, unsigned rate) {
+	Output *o = calloc(1, sizeof(*o));
+
+	o->fd = fd;
+	o->format = format;
+	o->wav = wav;
+	o->rate = rate;
+
+	if (o->wav)
+		o->len = WAVHeader(o, o->buf, UINT32_MAX);
+
+	return o;
+}
+
+void OutputFrames(Output *o, const Signal *L, const Signal *R, unsigned n) {
+	unsigned char *p;
+	unsigned i;
+	union { float f; uint32_t u; } f;
+
+	for (i=0; i<n; i++) {
+		if (o->len + FrameSize(o) > OUTPUT_BUFFER_SIZE)
+			OutputFlush(o);
+		p = o->buf + o->len;
+
+		if (o->format == OUTPUT_F32) {
+			f.f = L[i];
+			p = Put32(p, f.u);
+			f.f = R[i];
+			p = Put32(p, f.u);
+		} else {
+			p = Put16(p, (int16_t)(L[i] * OUTPUT_SCALE));
+			p = Put16(p, (int16_t)(R[i] * OUTPUT_SCALE));
+		}
+
+		o->len = p - o->buf;
+	}
+
+	o->frames += n;
+}
+
+void OutputFlush(Output *o) {
+	WriteAll(o->fd, o->buf, o->len);
+	o->len = 0;
+}
+
+void OutputClose(Output *o) {
+	unsigned char h[64];
+	size_t len;
+
+	OutputFlush(o);
+
+	/* pipes can't be seeked, and keep the unknown lengths */
+	if (o->wav && lseek(o->fd, 0, SEEK_SET) == 0) {
+		len = WAVHeader(o, h, o->frames);
+		WriteAll(o->fd, h, len);
+	}
+
+	free(o);
+}
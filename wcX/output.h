@@ -0,0 +1,27 @@
+/* audio output */
+
+#ifndef __INC_OUTPUT_H__
+#define __INC_OUTPUT_H__
+
+#include <stdbool.h>
+
+typedef struct Output          Output;
+
+#include "modular.h"
+
+typedef enum {
+	OUTPUT_S16,               /* signed 16 bit, little endian */
+	OUTPUT_F32,               /* 32 bit float, little endian */
+} OutputFormat;
+
+/* Interleaved stereo frames, written to a file descriptor in large
+   chunks. With a WAV header, the header is written first with unknown
+   lengths, and filled in by OutputClose if the file can be seeked */
+extern Output          *NewOutput(int fd, OutputFormat, bool wav,
+                                  unsigned rate);
+extern void             OutputFrames(Output*, const Signal *L,
+                                     const Signal *R, unsigned n);
+extern void             OutputFlush(Output*);
+extern void             OutputClose(Output*);
+
+#endif
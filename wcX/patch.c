@@ -0,0 +1,137 @@
+/* the demo patch */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "modular.h"
+#include "kctl.h"
+#include "event.h"
+#include "patch.h"
+
+static int bass[16] = {
+	36, 36, 48, 36,
+	36, 48, 36, 31,
+	33, 33, 48, 33,
+	33, 48, 33, 31,
+};
+static int seqs[2][4] = {
+	{ 69, 72, 74, 76 },
+	{ 72, 76, 79, 81 },
+};
+
+DemoPatch *NewDemoPatch(ModularContext *ctx) {
+	DemoPatch *p = calloc(1, sizeof(*p));
+	Module *master = ModularMaster(ctx);
+
+	p->seq = seqs[1];
+	p->events = NewEventQueue(256);
+
+	Module *osc = NewModule(ctx, &ModOscillator);
+	Module *env = NewModule(ctx, &ModADSR);
+
+	OscillatorGet(osc)->waveform = OscBandlimitedSaw;
+
+	SignalSet(ADSRGet(env)->A, 0.006);
+	SignalSet(ADSRGet(env)->D, 0.700);
+	SignalSet(ADSRGet(env)->S, 0.000);
+	SignalSet(ADSRGet(env)->R, 0.100);
+	SignalSet(ADSRGet(env)->trig, 0.0);
+
+	OscillatorGet(osc)->gain = env->out;
+	AddDependency(ctx, osc, env);
+
+	Module *filt = NewModule(ctx, &ModFilter);
+	FilterSetInput(ctx, filt, osc);
+
+	Module *env2filt = NewModule(ctx, &ModMatrix);
+	MatrixSetInput(ctx, env2filt, env);
+	MatrixScale(env2filt, 0.0, 1.0, 10.0, 10000.0);
+	FilterGet(filt)->cutoff = env2filt->out;
+	AddDependency(ctx, filt, env2filt);
+
+	Module *env2reso = NewModule(ctx, &ModMatrix);
+	MatrixSetInput(ctx, env2reso, env);
+	MatrixScale(env2reso, 0.0, 1.0, 0.1, 2.0);
+	FilterGet(filt)->reso = env2reso->out;
+	AddDependency(ctx, filt, env2reso);
+
+	MixerAddSlot(ctx, master, filt, 0.3, 0.0);
+
+	p->lead = NewMonoSynth();
+	OscillatorGet(osc)->freq  = MonoSynthGet(p->lead)->freq;
+	ADSRGet(env)->trig        = MonoSynthGet(p->lead)->trig;
+
+
+	Module *bassosc = NewModule(ctx, &ModOscillator);
+	Module *bassenv = NewModule(ctx, &ModADSR);
+
+	OscillatorGet(bassosc)->waveform = OscBandlimitedSaw;
+
+	SignalSet(ADSRGet(bassenv)->A, 0.006);
+	SignalSet(ADSRGet(bassenv)->D, 0.200);
+	SignalSet(ADSRGet(bassenv)->S, 0.000);
+	SignalSet(ADSRGet(bassenv)->R, 0.100);
+	SignalSet(ADSRGet(bassenv)->trig, 0.0);
+
+	//OscillatorGet(bassosc)->gain = bassenv->out;
+	AddDependency(ctx, bassosc, bassenv);
+
+	Module *bassfilt = NewModule(ctx, &ModFilter);
+	FilterSetInput(ctx, bassfilt, bassosc);
+
+	Module *bassenv2filt = NewModule(ctx, &ModMatrix);
+	MatrixSetInput(ctx, bassenv2filt, bassenv);
+	MatrixScale(bassenv2filt, 0.0, 1.0, 50.0, 5000.0);
+	FilterGet(bassfilt)->cutoff = bassenv2filt->out;
+	AddDependency(ctx, bassfilt, bassenv2filt);
+	SignalSet(FilterGet(bassfilt)->reso, 0.4);
+
+	MixerAddSlot(ctx, master, bassfilt, 0.3, 0.0);
+
+	p->bass = NewMonoSynth();
+	OscillatorGet(bassosc)->freq  = MonoSynthGet(p->bass)->freq;
+	ADSRGet(bassenv)->trig        = MonoSynthGet(p->bass)->trig;
+
+	return p;
+}
+
+static void DemoPatchPush(DemoPatch *p, unsigned long t, int type,
+                          KeyController *kc, int key) {
+	Event e = { .time = t, .type = type, .kc = kc, .key = key, .vel = 64 };
+
+	/* the sequence runs ahead of the render until the queue is full */
+	while (!EventQueuePush(p->events, &e))
+		nanosleep(&(struct timespec) { 0, 1000000 }, NULL);
+}
+
+void DemoPatchSequence(DemoPatch *p, unsigned long from, unsigned long to) {
+	unsigned long t;
+
+	for (t=from; t<to; t++) {
+		if (t % 96000 == 84000)
+			p->seq = seqs[((t / 96000) % 2)];
+
+		if (t % 12000 == 0)
+			DemoPatchPush(p, t, EVENT_KEYDOWN, p->lead,
+			              p->seq[(t / 12000) % 4] - 12);
+		if (t % 24000 == 22000)
+			DemoPatchPush(p, t, EVENT_KEYUP, p->lead,
+			              p->seq[(t / 12000) % 4] - 12);
+
+		if (t % 12000 == 0)
+			DemoPatchPush(p, t, EVENT_KEYDOWN, p->bass,
+			              bass[(t / 12000) % 16]);
+		if (t % 12000 == 11000)
+			DemoPatchPush(p, t, EVENT_KEYUP, p->bass,
+			              bass[(t / 12000) % 16]);
+	}
+
+	EventQueueAdvance(p->events, to);
+}
+
+void DemoPatchBlock(DemoPatch *p, unsigned long timer) {
+	EventQueueRun(p->events, timer);
+
+	KeyControllerUpdate(p->lead);
+	KeyControllerUpdate(p->bass);
+}
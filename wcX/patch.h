@@ -0,0 +1,32 @@
+/* the demo patch */
+
+#ifndef __INC_PATCH_H__
+#define __INC_PATCH_H__
+
+typedef struct DemoPatch       DemoPatch;
+
+#include "modular.h"
+#include "kctl.h"
+#include "event.h"
+
+/* A lead and a bass line, each an oscillator, envelope and filter played
+   by a MonoSynth, on two slots of the master mixer. The notes are played
+   through an event queue, so they can be sequenced on a thread of their
+   own */
+struct DemoPatch {
+	KeyController  *lead;
+	KeyController  *bass;
+
+	EventQueue     *events;
+	int            *seq;
+};
+
+extern DemoPatch       *NewDemoPatch(ModularContext*);
+/* control thread. queues the notes from frame from up to frame to */
+extern void             DemoPatchSequence(DemoPatch*, unsigned long from,
+                                          unsigned long to);
+/* render thread. plays the queued notes in the block starting at frame
+   timer, and updates the key controllers for it */
+extern void             DemoPatchBlock(DemoPatch*, unsigned long timer);
+
+#endif
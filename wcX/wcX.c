@@ -1,131 +1,120 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "modular.h"
-#include "kctl.h"
+#include "patch.h"
+#include "output.h"
 
 #define SAMPLE_RATE (48000)
-#define OUTPUT_SCALE 32767
+#define SEQUENCE_STEP (SAMPLE_RATE / 10)
 
-static void put_frame(int16_t L, int16_t R) {
-	write(1, &L, 2);
-	write(1, &R, 2);
+/* the notes are sequenced on a thread of their own, a step at a time */
+static void *sequencer(void *arg) {
+	DemoPatch *patch = arg;
+	unsigned long t;
+
+	for (t=0; ; t+=SEQUENCE_STEP)
+		DemoPatchSequence(patch, t, t + SEQUENCE_STEP);
+
+	return NULL;
 }
 
-static int bass[16] = {
-	36, 36, 48, 36,
-	36, 48, 36, 31,
-	33, 33, 48, 33,
-	33, 48, 33, 31,
-};
-static int seqs[2][4] = {
-	{ 69, 72, 74, 76 },
-	{ 72, 76, 79, 81 },
-};
-static int *seq = seqs[1];
+static void usage(char *argv0) {
+	fprintf(stderr, "usage: %s [--wav] [--float] [--threads N] "
+	                "[--render SECONDS] [-o FILE]\n", argv0);
+	exit(1);
+}
 
 int main(int argc, char *argv[]) {
 	ModularContext mctx;
-	Module *master;
 	Module *output;
-	int timer;
+	DemoPatch *patch;
+	pthread_t seq;
+	Output *out;
+	OutputFormat format = OUTPUT_S16;
+	bool wav = false;
+	char *file = NULL;
+	double seconds = 0.0, took;
+	long frames = -1;
+	unsigned threads = 0;
+	struct timespec t0, t1;
+	int fd = 1, timer, i, n;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "--wav")) {
+			wav = true;
+		} else if (!strcmp(argv[i], "--float")) {
+			format = OUTPUT_F32;
+		} else if (!strcmp(argv[i], "--threads") && i+1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--render") && i+1 < argc) {
+			seconds = atof(argv[++i]);
+			frames = seconds * SAMPLE_RATE;
+		} else if (!strcmp(argv[i], "-o") && i+1 < argc) {
+			file = argv[++i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	/* unless told otherwise, a render uses every CPU, since nothing is
+	   waiting on its output */
+	if (threads == 0)
+		threads = frames >= 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+	if (file) {
+		fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(file);
+			return 1;
+		}
+		n = strlen(file);
+		if (n > 4 && !strcmp(file + n - 4, ".wav"))
+			wav = true;
+	}
 
 	srand(0);
 
 	mctx.rate = SAMPLE_RATE;
 
 	ModularInitialize(&mctx);
-	master = ModularMaster(&mctx);
+	ModularSetThreads(&mctx, threads);
+	out = NewOutput(fd, format, wav, SAMPLE_RATE);
 	output = ModularOutput(&mctx);
 
-	Module *osc = NewModule(&mctx, &ModOscillator);
-	Module *env = NewModule(&mctx, &ModADSR);
-
-	OscillatorGet(osc)->waveform = OscBandlimitedSaw;
-
-	*ADSRGet(env)->A = 0.006;
-	*ADSRGet(env)->D = 0.700;
-	*ADSRGet(env)->S = 0.000;
-	*ADSRGet(env)->R = 0.100;
-	*ADSRGet(env)->trig = 0.0;
-
-	OscillatorGet(osc)->gain = env->out;
-	AddDependency(&mctx, osc, env);
-
-	Module *filt = NewModule(&mctx, &ModFilter);
-	FilterSetInput(&mctx, filt, osc);
-
-	Module *env2filt = NewModule(&mctx, &ModMatrix);
-	MatrixSetInput(&mctx, env2filt, env);
-	MatrixScale(env2filt, 0.0, 1.0, 10.0, 10000.0);
-	FilterGet(filt)->cutoff = env2filt->out;
-	AddDependency(&mctx, filt, env2filt);
-
-	Module *env2reso = NewModule(&mctx, &ModMatrix);
-	MatrixSetInput(&mctx, env2reso, env);
-	MatrixScale(env2reso, 0.0, 1.0, 0.1, 2.0);
-	FilterGet(filt)->reso = env2reso->out;
-	AddDependency(&mctx, filt, env2reso);
+	patch = NewDemoPatch(&mctx);
+	pthread_create(&seq, NULL, sequencer, patch);
 
-	MixerSlot *slot = MixerAddSlot(&mctx, master, filt, 0.3, 0.0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 
-	KeyController *kc = NewMonoSynth();
-	OscillatorGet(osc)->freq  = MonoSynthGet(kc)->freq;
-	ADSRGet(env)->trig        = MonoSynthGet(kc)->trig;
+	for (timer=0; frames < 0 || timer < frames; timer+=MODULAR_BLOCK_SIZE) {
+		EventQueueWait(patch->events, timer + MODULAR_BLOCK_SIZE);
+		DemoPatchBlock(patch, timer);
 
-
-	Module *bassosc = NewModule(&mctx, &ModOscillator);
-	Module *bassenv = NewModule(&mctx, &ModADSR);
-
-	OscillatorGet(bassosc)->waveform = OscBandlimitedSaw;
-
-	*ADSRGet(bassenv)->A = 0.006;
-	*ADSRGet(bassenv)->D = 0.200;
-	*ADSRGet(bassenv)->S = 0.000;
-	*ADSRGet(bassenv)->R = 0.100;
-	*ADSRGet(bassenv)->trig = 0.0;
-
-	//OscillatorGet(bassosc)->gain = bassenv->out;
-	AddDependency(&mctx, bassosc, bassenv);
-
-	Module *bassfilt = NewModule(&mctx, &ModFilter);
-	FilterSetInput(&mctx, bassfilt, bassosc);
-
-	Module *bassenv2filt = NewModule(&mctx, &ModMatrix);
-	MatrixSetInput(&mctx, bassenv2filt, bassenv);
-	MatrixScale(bassenv2filt, 0.0, 1.0, 50.0, 5000.0);
-	FilterGet(bassfilt)->cutoff = bassenv2filt->out;
-	AddDependency(&mctx, bassfilt, bassenv2filt);
-	*FilterGet(bassfilt)->reso = 0.4;
-
-	MixerSlot *bassslot = MixerAddSlot(&mctx, master, bassfilt, 0.3, 0.0);
-
-	KeyController *bkc = NewMonoSynth();
-	OscillatorGet(bassosc)->freq  = MonoSynthGet(bkc)->freq;
-	ADSRGet(bassenv)->trig        = MonoSynthGet(bkc)->trig;
-
-
-	for (timer=0; ; timer++) {
 		ModularStep(&mctx);
 
-		if (timer % 96000 == 84000)
-			seq = seqs[((timer / 96000) % 2)];
+		n = MODULAR_BLOCK_SIZE;
+		if (frames >= 0 && frames - timer < n)
+			n = frames - timer;
 
-		if (timer % 12000 == 0)
-			KeyControllerKeyDown(kc, seq[(timer / 12000) % 4] - 12, 64);
-		if (timer % 24000 == 22000)
-			KeyControllerKeyUp(kc, seq[(timer / 12000) % 4] - 12);
-		KeyControllerUpdate(kc);
+		OutputFrames(out, ModuleOut(output, 0), ModuleOut(output, 1), n);
+	}
 
-		if (timer % 12000 == 0)
-			KeyControllerKeyDown(bkc, bass[(timer / 12000) % 16], 64);
-		if (timer % 12000 == 11000)
-			KeyControllerKeyUp(bkc, bass[(timer / 12000) % 16]);
-		KeyControllerUpdate(bkc);
+	OutputClose(out);
 
-		put_frame(output->out[0] * OUTPUT_SCALE,
-		          output->out[1] * OUTPUT_SCALE);
+	if (frames >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		took = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+		fprintf(stderr, "rendered %.2f s in %.3f s, %.1fx realtime "
+		                "(%u threads)\n", seconds, took, seconds / took,
+		                threads);
 	}
 
 	return 0;